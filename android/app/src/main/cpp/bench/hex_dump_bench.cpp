@@ -0,0 +1,122 @@
+// Payload hex rendering benchmark: the stringstream bytesToHex this
+// replaced versus HexDump's table and SIMD paths.
+//
+//   g++ -O2 -std=c++14 -I.. hex_dump_bench.cpp ../hex_dump.cpp -o hex_dump_bench
+
+#include "hex_dump.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Copy of the original PacketParser::bytesToHex, kept as the "before" baseline
+std::string legacyBytesToHex(const uint8_t *data, int length, int max_bytes)
+{
+    std::stringstream ss;
+    int bytes_to_show = std::min(length, max_bytes);
+
+    for (int i = 0; i < bytes_to_show; ++i)
+    {
+        ss << std::hex << std::setfill('0') << std::setw(2) << (int)data[i];
+        if (i < bytes_to_show - 1)
+            ss << " ";
+    }
+
+    if (length > max_bytes)
+    {
+        ss << "...";
+    }
+
+    return ss.str();
+}
+
+template <typename Fn>
+void run(const char *name, const std::vector<uint8_t> &payload, size_t length, size_t iterations, Fn fn)
+{
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        // Vary the start so the compiler cannot hoist the work out of the loop
+        sink += fn(payload.data() + (i & 63), length);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-30s %6zu B %12.0f calls/sec %8.2f GB/s  (checksum %llu)\n",
+                name, length, iterations / seconds, iterations * length / seconds / 1e9,
+                static_cast<unsigned long long>(sink));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<uint8_t> payload(1600 + 64);
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+
+    // The fast paths must produce exactly what the UI used to get
+    for (size_t length = 0; length <= 100; ++length)
+    {
+        std::string expected = legacyBytesToHex(payload.data(), static_cast<int>(length), 64);
+        char out[256];
+        size_t written = HexDump::formatSpaced(payload.data(), length, 64, out, sizeof(out));
+        if (std::string(out, written) != expected)
+        {
+            std::printf("formatSpaced mismatch at length %zu\n", length);
+            return 1;
+        }
+    }
+
+    char out[8192];
+    const size_t lengths[] = {64, 1460};
+    for (size_t length : lengths)
+    {
+        size_t max_bytes = length;
+
+        run("legacy stringstream", payload, length, iterations / 10,
+            [max_bytes](const uint8_t *data, size_t n)
+            { return legacyBytesToHex(data, static_cast<int>(n), static_cast<int>(max_bytes)).size(); });
+
+        run("formatSpaced (table)", payload, length, iterations,
+            [&out](const uint8_t *data, size_t n)
+            {
+                HexDump::formatSpacedScalar(data, n, out);
+                return static_cast<size_t>(out[n]);
+            });
+
+        run("formatSpaced", payload, length, iterations,
+            [&out, max_bytes](const uint8_t *data, size_t n)
+            { return HexDump::formatSpaced(data, n, max_bytes, out, sizeof(out)) + out[n]; });
+
+        run("encode (table)", payload, length, iterations,
+            [&out](const uint8_t *data, size_t n)
+            {
+                HexDump::encodeScalar(data, n, out);
+                return static_cast<size_t>(out[n]);
+            });
+
+        run("encode", payload, length, iterations,
+            [&out](const uint8_t *data, size_t n)
+            {
+                HexDump::encode(data, n, out);
+                return static_cast<size_t>(out[n]);
+            });
+
+        run("formatDump", payload, length, iterations,
+            [&out](const uint8_t *data, size_t n)
+            { return HexDump::formatDump(data, n, out, sizeof(out)) + out[n]; });
+    }
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+// Parser throughput benchmark: the original string-building parsePacket
+// versus PacketParser::parseInto.
+//
+//   g++ -O2 -std=c++14 -I.. packet_parser_bench.cpp ../packet_parser.cpp ../hex_dump.cpp -o packet_parser_bench
+
+#include "packet_parser.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+// Copy of the PacketInfo/parsePacket pair this benchmark replaced, kept as
+// the "before" baseline.
+struct LegacyPacketInfo
+{
+    std::string source_ip;
+    std::string dest_ip;
+    uint16_t source_port;
+    uint16_t dest_port;
+    std::string protocol;
+    uint16_t size;
+    std::string payload;
+    uint64_t timestamp;
+};
+
+uint64_t legacyNow()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string legacyIpToString(uint32_t ip)
+{
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, buffer, INET_ADDRSTRLEN);
+    return std::string(buffer);
+}
+
+std::string legacyBytesToHex(const uint8_t *data, int length, int max_bytes = 64)
+{
+    std::stringstream ss;
+    int bytes_to_show = std::min(length, max_bytes);
+    for (int i = 0; i < bytes_to_show; ++i)
+    {
+        ss << std::hex << std::setfill('0') << std::setw(2) << (int)data[i];
+        if (i < bytes_to_show - 1)
+            ss << " ";
+    }
+    if (length > max_bytes)
+        ss << "...";
+    return ss.str();
+}
+
+LegacyPacketInfo legacyParse(const uint8_t *packet, int length)
+{
+    LegacyPacketInfo info;
+    if (length < (int)sizeof(IPHeader))
+        return info;
+    const IPHeader *ip_header = reinterpret_cast<const IPHeader *>(packet);
+    if ((ip_header->version_ihl >> 4) != 4)
+        return info;
+
+    info.source_ip = legacyIpToString(ip_header->source_ip);
+    info.dest_ip = legacyIpToString(ip_header->dest_ip);
+    info.size = ntohs(ip_header->total_length);
+    info.timestamp = legacyNow();
+
+    int ip_header_length = (ip_header->version_ihl & 0x0F) * 4;
+    const uint8_t *l4 = packet + ip_header_length;
+    int l4_length = length - ip_header_length;
+
+    if (ip_header->protocol == 6)
+    {
+        info.protocol = "TCP";
+        info.timestamp = legacyNow();
+        const TCPHeader *tcp = reinterpret_cast<const TCPHeader *>(l4);
+        info.source_port = ntohs(tcp->source_port);
+        info.dest_port = ntohs(tcp->dest_port);
+        int tcp_header_length = (tcp->data_offset_reserved >> 4) * 4;
+        if (l4_length > tcp_header_length)
+            info.payload = legacyBytesToHex(l4 + tcp_header_length, l4_length - tcp_header_length);
+    }
+    else if (ip_header->protocol == 17)
+    {
+        info.protocol = "UDP";
+        info.timestamp = legacyNow();
+        const UDPHeader *udp = reinterpret_cast<const UDPHeader *>(l4);
+        info.source_port = ntohs(udp->source_port);
+        info.dest_port = ntohs(udp->dest_port);
+        if (l4_length > (int)sizeof(UDPHeader))
+            info.payload = legacyBytesToHex(l4 + sizeof(UDPHeader), l4_length - sizeof(UDPHeader));
+    }
+    else
+    {
+        info.protocol = "OTHER";
+    }
+    return info;
+}
+
+std::vector<uint8_t> makePacket(uint8_t protocol, size_t payload_length, uint32_t seed)
+{
+    size_t l4_length = protocol == 6 ? sizeof(TCPHeader) : sizeof(UDPHeader);
+    std::vector<uint8_t> packet(sizeof(IPHeader) + l4_length + payload_length);
+
+    IPHeader *ip = reinterpret_cast<IPHeader *>(packet.data());
+    ip->version_ihl = 0x45;
+    ip->total_length = htons(static_cast<uint16_t>(packet.size()));
+    ip->ttl = 64;
+    ip->protocol = protocol;
+    ip->source_ip = htonl(0x0a000002);
+    ip->dest_ip = htonl(0x8efa0000 | (seed & 0xffff));
+
+    uint8_t *l4 = packet.data() + sizeof(IPHeader);
+    if (protocol == 6)
+    {
+        TCPHeader *tcp = reinterpret_cast<TCPHeader *>(l4);
+        tcp->source_port = htons(static_cast<uint16_t>(40000 + seed % 1000));
+        tcp->dest_port = htons(443);
+        tcp->data_offset_reserved = 5 << 4;
+        tcp->flags = 0x18;
+    }
+    else
+    {
+        UDPHeader *udp = reinterpret_cast<UDPHeader *>(l4);
+        udp->source_port = htons(static_cast<uint16_t>(50000 + seed % 1000));
+        udp->dest_port = htons(53);
+        udp->length = htons(static_cast<uint16_t>(sizeof(UDPHeader) + payload_length));
+    }
+
+    for (size_t i = 0; i < payload_length; ++i)
+    {
+        packet[sizeof(IPHeader) + l4_length + i] = static_cast<uint8_t>(i * 31 + seed);
+    }
+    return packet;
+}
+
+template <typename Fn>
+void run(const char *name, const std::vector<std::vector<uint8_t>> &packets, size_t iterations, Fn fn)
+{
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        const std::vector<uint8_t> &packet = packets[i % packets.size()];
+        sink += fn(packet.data(), packet.size());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-28s %12.0f packets/sec  (checksum %llu)\n",
+                name, iterations / seconds, static_cast<unsigned long long>(sink));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+
+    std::vector<std::vector<uint8_t>> packets;
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        packets.push_back(makePacket(i % 4 == 0 ? 17 : 6, (i * 37) % 1400, i));
+    }
+
+    run("legacy parsePacket", packets, iterations,
+        [](const uint8_t *data, size_t length)
+        {
+            LegacyPacketInfo info = legacyParse(data, static_cast<int>(length));
+            return info.source_port + info.payload.size();
+        });
+
+    run("parseInto", packets, iterations,
+        [](const uint8_t *data, size_t length)
+        {
+            PacketView view;
+            PacketParser::parseInto(data, length, view);
+            return view.source_port + view.payload_length;
+        });
+
+    run("parseInto + format all", packets, iterations,
+        [](const uint8_t *data, size_t length)
+        {
+            PacketView view;
+            PacketParser::parseInto(data, length, view);
+            PacketInfo info(view);
+            return info.sourceIp().size() + info.destIp().size() + info.payloadHex().size();
+        });
+
+    return 0;
+}
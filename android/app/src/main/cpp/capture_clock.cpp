@@ -0,0 +1,77 @@
+#include "capture_clock.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+static const uint64_t NS_PER_SECOND = 1000000000ULL;
+
+uint64_t CaptureClock::monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+uint64_t CaptureClock::realtimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * NS_PER_SECOND + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+TimestampFormatter::TimestampFormatter() : cached_second_(-1)
+{
+    std::memset(prefix_, 0, sizeof(prefix_));
+}
+
+size_t TimestampFormatter::format(uint64_t timestamp_ns, char *out, size_t capacity, int fraction_digits)
+{
+    if (fraction_digits < 0)
+        fraction_digits = 0;
+    if (fraction_digits > 9)
+        fraction_digits = 9;
+
+    size_t length = sizeof(prefix_) + (fraction_digits > 0 ? 1 + fraction_digits : 0);
+    if (capacity < length + 1)
+    {
+        return 0;
+    }
+
+    int64_t second = static_cast<int64_t>(timestamp_ns / NS_PER_SECOND);
+    if (second != cached_second_)
+    {
+        time_t seconds = static_cast<time_t>(second);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char prefix[16];
+        std::snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d", local.tm_hour, local.tm_min, local.tm_sec);
+        std::memcpy(prefix_, prefix, sizeof(prefix_));
+        cached_second_ = second;
+    }
+
+    std::memcpy(out, prefix_, sizeof(prefix_));
+    if (fraction_digits > 0)
+    {
+        out[sizeof(prefix_)] = '.';
+        // Leading digits of the nanosecond field, written right to left
+        uint32_t fraction = static_cast<uint32_t>(timestamp_ns % NS_PER_SECOND);
+        for (int i = fraction_digits; i < 9; i++)
+        {
+            fraction /= 10;
+        }
+        for (int i = fraction_digits; i > 0; i--)
+        {
+            out[sizeof(prefix_) + i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+    }
+    out[length] = '\0';
+    return length;
+}
+
+std::string TimestampFormatter::format(uint64_t timestamp_ns, int fraction_digits)
+{
+    char buffer[MAX_LENGTH + 1];
+    size_t length = format(timestamp_ns, buffer, sizeof(buffer), fraction_digits);
+    return std::string(buffer, length);
+}
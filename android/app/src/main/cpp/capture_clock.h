@@ -0,0 +1,40 @@
+#ifndef CAPTURE_CLOCK_H
+#define CAPTURE_CLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Clocks used across the native layer. Packet timestamps are wall-clock
+// nanoseconds since the Unix epoch; timers and expiry use the monotonic
+// clock so they are immune to wall-clock changes.
+class CaptureClock
+{
+public:
+    static uint64_t monotonicMs();
+    static uint64_t realtimeNs();
+};
+
+// Formats packet timestamps as local "HH:MM:SS.fff". The HH:MM:SS prefix
+// goes through localtime_r() only when the second changes, so a burst of
+// packets costs one calendar conversion per second instead of one each.
+// Not thread-safe; keep one per thread.
+class TimestampFormatter
+{
+public:
+    // Longest output: "HH:MM:SS." plus 9 fraction digits
+    static const size_t MAX_LENGTH = 18;
+
+    TimestampFormatter();
+
+    // Writes the time with `fraction_digits` (0-9) sub-second digits and a
+    // terminating NUL. Returns the length, or 0 if `capacity` is too small.
+    size_t format(uint64_t timestamp_ns, char *out, size_t capacity, int fraction_digits = 3);
+    std::string format(uint64_t timestamp_ns, int fraction_digits = 3);
+
+private:
+    int64_t cached_second_;
+    char prefix_[8]; // "HH:MM:SS", not NUL-terminated
+};
+
+#endif // CAPTURE_CLOCK_H
@@ -0,0 +1,69 @@
+#include "capture_filter.h"
+
+CaptureFilter::CaptureFilter() : compiled_(false)
+{
+    program_.bf_len = 0;
+    program_.bf_insns = nullptr;
+}
+
+CaptureFilter::~CaptureFilter()
+{
+    clear();
+}
+
+bool CaptureFilter::compile(const std::string &expression, int linktype, int snaplen, std::string &error)
+{
+    if (expression.empty())
+    {
+        clear();
+        return true;
+    }
+
+    // pcap_compile() needs a handle only for its link type and snaplen
+    pcap_t *dead = pcap_open_dead(linktype, snaplen);
+    if (!dead)
+    {
+        error = "pcap_open_dead failed";
+        return false;
+    }
+
+    struct bpf_program program;
+    if (pcap_compile(dead, &program, expression.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0)
+    {
+        error = pcap_geterr(dead);
+        pcap_close(dead);
+        return false;
+    }
+    pcap_close(dead);
+
+    clear();
+    program_ = program;
+    compiled_ = true;
+    expression_ = expression;
+    return true;
+}
+
+void CaptureFilter::clear()
+{
+    if (compiled_)
+    {
+        pcap_freecode(&program_);
+        compiled_ = false;
+    }
+    expression_.clear();
+}
+
+bool CaptureFilter::matches(const uint8_t *packet, uint32_t caplen, uint32_t length) const
+{
+    if (!compiled_)
+    {
+        return true;
+    }
+
+    struct pcap_pkthdr header;
+    header.ts.tv_sec = 0;
+    header.ts.tv_usec = 0;
+    header.caplen = caplen;
+    header.len = length;
+    return pcap_offline_filter(&program_, &header, packet) != 0;
+}
@@ -0,0 +1,39 @@
+#ifndef CAPTURE_FILTER_H
+#define CAPTURE_FILTER_H
+
+#include <pcap/pcap.h>
+#include <cstdint>
+#include <string>
+
+// A compiled pcap filter expression (classic BPF). Rooted capture installs
+// the program in the kernel with pcap_setfilter(); in VPN mode, where
+// packets come from the TUN fd rather than a pcap handle, it runs in
+// userspace through pcap_offline_filter() against raw IP.
+class CaptureFilter
+{
+public:
+    CaptureFilter();
+    ~CaptureFilter();
+
+    // Compiles `expression` for packets of `linktype`. An empty expression
+    // clears the filter. On failure the previous program is kept and
+    // `error` holds libpcap's message.
+    bool compile(const std::string &expression, int linktype, int snaplen, std::string &error);
+    void clear();
+
+    // True when no filter is set or the packet passes it
+    bool matches(const uint8_t *packet, uint32_t caplen, uint32_t length) const;
+
+    bool empty() const { return !compiled_; }
+    const std::string &expression() const { return expression_; }
+
+private:
+    CaptureFilter(const CaptureFilter &) = delete;
+    CaptureFilter &operator=(const CaptureFilter &) = delete;
+
+    struct bpf_program program_;
+    bool compiled_;
+    std::string expression_;
+};
+
+#endif // CAPTURE_FILTER_H
@@ -0,0 +1,977 @@
+#include "capture_pipeline.h"
+#include "capture_clock.h"
+#include <algorithm>
+#include <cstring>
+
+#define TAG "CapturePipeline"
+#include "native_log.h"
+
+// Ring sizes in slots, split across the shards; ingress, forward and
+// record slots are buffer descriptors, ui slots 128-byte PacketRecords
+static const size_t INGRESS_RING_SLOTS = 2048;
+static const size_t MIN_SHARD_INGRESS_SLOTS = 512;
+static const size_t FORWARD_RING_SLOTS = 1024;
+static const size_t RECORD_RING_SLOTS = 1024;
+static const size_t UI_RING_SLOTS = 4096;
+static const size_t MIN_SHARD_UI_SLOTS = 1024;
+
+// Enough MTU buffers to fill every ring with some left for the capture
+// thread; jumbo buffers only back oversized rooted captures
+static const size_t POOL_BUFFERS = 5120;
+static const size_t POOL_JUMBO_BUFFERS = 32;
+
+// About 16 MiB of columns plus 8 MiB of payload slices (64 bytes at most
+// per packet), committed as the history fills
+static const size_t HISTORY_PACKETS = 256 * 1024;
+static const size_t HISTORY_PAYLOAD_BYTES = 8 * 1024 * 1024;
+
+// Default flow table bounds across all shards: about 230 bytes per slot,
+// with the table at most half full
+static const size_t DEFAULT_MAX_FLOWS = 64 * 1024;
+static const size_t DEFAULT_FLOW_MEMORY_BYTES = 32 * 1024 * 1024;
+
+// Longest an idle stage sleeps before rechecking for shutdown
+static const int STAGE_IDLE_WAIT_MS = 100;
+// How long a flow query waits for a worker to walk its table; a worker
+// reaches maintain() at least every STAGE_IDLE_WAIT_MS, or after each
+// ring's worth of packets while traffic is flowing
+static const int FLOW_VISIT_TIMEOUT_MS = 500;
+
+static const uint64_t NS_PER_SECOND = 1000000000ULL;
+
+const size_t CapturePipeline::MAX_SHARDS;
+
+CapturePipeline::CapturePipeline(PacketBatcher &batcher)
+    : requested_shards_(0), max_flows_(DEFAULT_MAX_FLOWS), flow_memory_bytes_(DEFAULT_FLOW_MEMORY_BYTES),
+      forward_(FORWARD_RING_SLOTS), record_(RECORD_RING_SLOTS), pool_(POOL_BUFFERS, POOL_JUMBO_BUFFERS),
+      history_(HISTORY_PACKETS, HISTORY_PAYLOAD_BYTES), batcher_(batcher),
+      apply_filter_(false), running_(false), recording_(false), workers_running_(false), sinks_running_(false)
+{
+    createShards(1);
+}
+
+CapturePipeline::~CapturePipeline()
+{
+    stop();
+}
+
+void CapturePipeline::setShardCount(size_t shards)
+{
+    requested_shards_ = shards;
+}
+
+void CapturePipeline::setFlowLimits(size_t max_flows, size_t memory_bytes)
+{
+    max_flows_ = max_flows > 0 ? max_flows : DEFAULT_MAX_FLOWS;
+    flow_memory_bytes_ = memory_bytes;
+}
+
+void CapturePipeline::createShards(size_t count)
+{
+    size_t ingress_slots = std::max(INGRESS_RING_SLOTS / count, MIN_SHARD_INGRESS_SLOTS);
+    size_t ui_slots = std::max(UI_RING_SLOTS / count, MIN_SHARD_UI_SLOTS);
+
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    shards_.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        shards_.push_back(std::make_shared<Shard>(ingress_slots, ui_slots, &ui_signal_));
+    }
+}
+
+void CapturePipeline::start(FlushFn flush, ForwardFn forward, bool apply_filter)
+{
+    stop();
+
+    // Leave cores for the capture, sink and reactor threads
+    size_t count = requested_shards_;
+    if (count == 0)
+    {
+        count = std::thread::hardware_concurrency() / 2;
+    }
+    count = std::min(std::max<size_t>(count, 1), MAX_SHARDS);
+    if (count != shards_.size())
+    {
+        createShards(count);
+    }
+
+    size_t max_flows = std::max<size_t>(max_flows_ / count, 1);
+    if (flow_memory_bytes_ > 0)
+    {
+        max_flows = std::min(max_flows, FlowTable<FlowStats>::maxEntriesWithin(flow_memory_bytes_ / count));
+    }
+    for (auto &shard : shards_)
+    {
+        shard->flows.setMaxFlows(max_flows);
+    }
+
+    flush_ = flush;
+    forward_fn_ = forward;
+    apply_filter_ = apply_filter;
+
+    workers_running_ = true;
+    sinks_running_ = true;
+    {
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        running_ = true;
+    }
+    for (auto &shard : shards_)
+    {
+        Shard *target = shard.get();
+        shard->thread = std::thread([this, target]
+                                    { runWorker(*target); });
+    }
+    ui_thread_ = std::thread(&CapturePipeline::runUiSink, this);
+    if (forward_fn_)
+    {
+        forward_thread_ = std::thread(&CapturePipeline::runForwardSink, this);
+    }
+    // Recording can start at any time, so its sink always runs
+    record_thread_ = std::thread(&CapturePipeline::runRecordSink, this);
+
+    LOGD("Pipeline started with %zu shard worker(s)", shards_.size());
+}
+
+void CapturePipeline::stop()
+{
+    if (!running_)
+    {
+        return;
+    }
+
+    // Stop front to back so each stage drains what the previous one published
+    workers_running_ = false;
+    for (auto &shard : shards_)
+    {
+        shard->ingress.wake();
+    }
+    for (auto &shard : shards_)
+    {
+        shard->thread.join();
+    }
+    {
+        // The shards are the caller's from here on
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        running_ = false;
+    }
+
+    sinks_running_ = false;
+    ui_signal_.wake();
+    forward_.wake();
+    record_.wake();
+    ui_thread_.join();
+    if (forward_thread_.joinable())
+    {
+        forward_thread_.join();
+    }
+    record_thread_.join();
+
+    PacketPoolStats pool = pool_.stats();
+    LOGD("Packet pool: %zu/%zu buffers in use, %llu exhausted; jumbo %zu/%zu, %llu exhausted", pool.in_use,
+         pool.buffers, static_cast<unsigned long long>(pool.exhausted), pool.jumbo_in_use, pool.jumbo_buffers,
+         static_cast<unsigned long long>(pool.jumbo_exhausted));
+
+    for (const PipelineStageStats &stage : stats())
+    {
+        if (stage.ring.pushed > 0 || stage.ring.dropped > 0)
+        {
+            LOGD("%s ring: %llu pushed, %llu dropped, high water %zu/%zu", stage.name.c_str(),
+                 static_cast<unsigned long long>(stage.ring.pushed),
+                 static_cast<unsigned long long>(stage.ring.dropped), stage.ring.high_water, stage.ring.capacity);
+        }
+    }
+}
+
+void CapturePipeline::setFilter(std::shared_ptr<CaptureFilter> filter)
+{
+    std::lock_guard<std::mutex> lock(filter_mutex_);
+    filter_ = filter;
+}
+
+void CapturePipeline::setRecorder(std::shared_ptr<PcapngWriter> recorder)
+{
+    std::lock_guard<std::mutex> lock(recorder_mutex_);
+    recorder_ = recorder;
+    recording_.store(recorder != nullptr, std::memory_order_relaxed);
+}
+
+// Queue a descriptor, shedding it (counted) or waiting when the ring is full
+static bool enqueue(SpscRing<PacketBuffer *> &ring, PacketBuffer *buffer, bool wait_for_space)
+{
+    if (!wait_for_space)
+    {
+        return ring.push(buffer);
+    }
+
+    PacketBuffer **slot;
+    while (!(slot = ring.claim()))
+    {
+        std::this_thread::yield();
+    }
+    *slot = buffer;
+    ring.publish();
+    return true;
+}
+
+void CapturePipeline::submit(PacketBuffer *buffer, bool wait_for_space)
+{
+    size_t shard = static_cast<size_t>(
+        (static_cast<uint64_t>(FlowShard::flowHash(buffer->data, buffer->length)) * shards_.size()) >> 32);
+
+    if (forward_fn_)
+    {
+        // The relay is never shed: a full forward ring holds up reading,
+        // and the packets behind it wait in the TUN queue
+        PacketPool::retain(buffer);
+        enqueue(forward_, buffer, true);
+    }
+
+    if (recording_.load(std::memory_order_relaxed))
+    {
+        PacketPool::retain(buffer);
+        if (!enqueue(record_, buffer, wait_for_space))
+        {
+            pool_.release(buffer);
+        }
+    }
+
+    if (!enqueue(shards_[shard]->ingress, buffer, wait_for_space))
+    {
+        pool_.release(buffer);
+    }
+}
+
+void CapturePipeline::runWorker(Shard &shard)
+{
+    while (true)
+    {
+        bool ready = shard.ingress.waitForData(STAGE_IDLE_WAIT_MS);
+        shard.flows.maintain();
+        if (!ready)
+        {
+            if (!workers_running_)
+            {
+                // Leave the final numbers readable after stop()
+                shard.flows.publishTalkers();
+                break;
+            }
+            continue;
+        }
+
+        std::shared_ptr<CaptureFilter> filter;
+        if (apply_filter_)
+        {
+            std::lock_guard<std::mutex> lock(filter_mutex_);
+            filter = filter_;
+        }
+
+        // Bounded so resets, flow visits and expiry still run under a sustained stream
+        size_t budget = shard.ingress.capacity();
+        PacketBuffer **slot;
+        while (budget-- > 0 && (slot = shard.ingress.peek()))
+        {
+            PacketBuffer *buffer = *slot;
+            shard.ingress.release();
+
+            PacketView view;
+            if (PacketParser::parseInto(buffer->data, buffer->length, view) &&
+                (!filter || filter->matches(buffer->data, buffer->length, buffer->wire_length)))
+            {
+                view.timestamp_ns = buffer->timestamp_ns;
+                shard.flows.process(view);
+
+                PacketRecord *record = shard.ui.claim();
+                if (record)
+                {
+                    PacketBatcher::toRecord(view, *record);
+                    shard.ui.publish();
+                }
+                else
+                {
+                    shard.ui.markDropped();
+                }
+            }
+            pool_.release(buffer);
+        }
+    }
+}
+
+void CapturePipeline::flushBatch()
+{
+    if (batcher_.empty())
+    {
+        return;
+    }
+    history_.append(batcher_.records(), batcher_.count());
+    if (flush_)
+    {
+        flush_(batcher_);
+    }
+    batcher_.clear();
+}
+
+void CapturePipeline::runUiSink()
+{
+    auto readable = [this]
+    {
+        for (const auto &shard : shards_)
+        {
+            if (shard->ui.readable())
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (true)
+    {
+        int timeout = batcher_.msUntilDue(CaptureClock::monotonicMs());
+        if (timeout < 0 || timeout > STAGE_IDLE_WAIT_MS)
+        {
+            timeout = STAGE_IDLE_WAIT_MS;
+        }
+
+        if (!readable())
+        {
+            ui_signal_.wait(timeout, readable);
+        }
+        uint64_t now_ms = CaptureClock::monotonicMs();
+
+        bool drained = false;
+        for (auto &shard : shards_)
+        {
+            while (PacketRecord *record = shard->ui.peek())
+            {
+                bool full = batcher_.append(*record, now_ms);
+                shard->ui.release();
+                drained = true;
+                if (full)
+                {
+                    flushBatch();
+                }
+            }
+        }
+
+        if (batcher_.due(now_ms))
+        {
+            flushBatch();
+        }
+
+        if (!drained && !sinks_running_)
+        {
+            break;
+        }
+    }
+
+    flushBatch();
+}
+
+void CapturePipeline::runForwardSink()
+{
+    while (true)
+    {
+        if (!forward_.waitForData(STAGE_IDLE_WAIT_MS))
+        {
+            if (!sinks_running_)
+            {
+                break;
+            }
+            continue;
+        }
+
+        while (PacketBuffer **slot = forward_.peek())
+        {
+            PacketBuffer *buffer = *slot;
+            forward_.release();
+
+            PacketView view;
+            if (PacketParser::parseInto(buffer->data, buffer->length, view))
+            {
+                view.timestamp_ns = buffer->timestamp_ns;
+                forward_fn_(view);
+            }
+            pool_.release(buffer);
+        }
+    }
+}
+
+void CapturePipeline::runRecordSink()
+{
+    while (true)
+    {
+        bool ready = record_.waitForData(STAGE_IDLE_WAIT_MS);
+
+        {
+            // Bounded so setRecorder() never waits on a sustained stream
+            std::lock_guard<std::mutex> lock(recorder_mutex_);
+            size_t budget = record_.capacity();
+            PacketBuffer **slot;
+            while (budget-- > 0 && (slot = record_.peek()))
+            {
+                PacketBuffer *buffer = *slot;
+                record_.release();
+                // Packets queued for a recorder that has since been removed are discarded
+                if (recorder_)
+                {
+                    recorder_->write(*buffer);
+                }
+                pool_.release(buffer);
+            }
+            if (recorder_)
+            {
+                recorder_->poll(CaptureClock::monotonicMs());
+            }
+        }
+
+        if (!ready && !sinks_running_)
+        {
+            break;
+        }
+    }
+}
+
+std::vector<ProtocolStats> CapturePipeline::protocolStats() const
+{
+    ProtocolTotals merged;
+    {
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        for (const auto &shard : shards_)
+        {
+            shard->flows.addProtocolTotals(merged);
+        }
+    }
+
+    std::vector<ProtocolStats> totals;
+    for (size_t i = 0; i < PROTOCOL_COUNT; ++i)
+    {
+        if (merged.packets[i] == 0)
+        {
+            continue;
+        }
+        totals.push_back(ProtocolStats(PacketParser::protocolName(static_cast<Protocol>(i))));
+        totals.back().packet_count = merged.packets[i];
+        totals.back().total_bytes = merged.bytes[i];
+    }
+
+    // Sort by packet count (descending)
+    std::sort(totals.begin(), totals.end(),
+              [](const ProtocolStats &a, const ProtocolStats &b)
+              {
+                  return a.packet_count > b.packet_count;
+              });
+    return totals;
+}
+
+size_t CapturePipeline::flowCount() const
+{
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    size_t flows = 0;
+    for (const auto &shard : shards_)
+    {
+        flows += shard->flows.flowCount();
+    }
+    return flows;
+}
+
+// Space-Saving counts are upper bounds. A key one shard does not monitor
+// may still have sent up to that shard's smallest count there, so those
+// are added to both its merged count and its error.
+struct MergedTalker
+{
+    TalkerEntry entry;
+    uint64_t monitored_min; // summed minimums of the shards monitoring it
+};
+
+// JSON names for what a set of summaries ranks by and what rides along
+struct TalkerWeight
+{
+    const char *count_name;
+    const char *other_name;
+    const char *total_name;
+};
+
+static const TalkerWeight BY_BYTES = {"bytes", "packets", "totalBytes"};
+static const TalkerWeight BY_PACKETS = {"packets", "bytes", "totalPackets"};
+
+static std::string mergedTalkersJson(const std::vector<const SpaceSaving *> &summaries, size_t count,
+                                     bool conversations, const TalkerWeight &weight)
+{
+    FlowTable<MergedTalker> merged(TopTalkers::CAPACITY * summaries.size());
+    uint64_t total = 0;
+    uint64_t min_sum = 0;
+    for (const SpaceSaving *summary : summaries)
+    {
+        total += summary->total();
+        uint64_t min_count = summary->minCount();
+        min_sum += min_count;
+        for (const TalkerEntry &entry : summary->entries())
+        {
+            bool inserted = false;
+            MergedTalker *talker = merged.findOrInsert(entry.key, inserted);
+            if (inserted)
+            {
+                talker->entry = entry;
+                talker->monitored_min = min_count;
+                continue;
+            }
+            talker->entry.count += entry.count;
+            talker->entry.error += entry.error;
+            talker->entry.other += entry.other;
+            talker->monitored_min += min_count;
+        }
+    }
+
+    std::vector<TalkerEntry> top;
+    merged.forEach([&top, min_sum](const SessionKey &, MergedTalker &talker)
+                   {
+                       uint64_t unmonitored = min_sum - talker.monitored_min;
+                       talker.entry.count += unmonitored;
+                       talker.entry.error += unmonitored;
+                       top.push_back(talker.entry);
+                   });
+    count = std::min(count, top.size());
+    std::partial_sort(top.begin(), top.begin() + count, top.end(),
+                      [](const TalkerEntry &a, const TalkerEntry &b)
+                      {
+                          return a.count > b.count;
+                      });
+
+    std::string json = "{\"" + std::string(weight.total_name) + "\":" + std::to_string(total) + ",";
+    json += "\"errorBound\":" + std::to_string(min_sum) + ",\"top\":[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        const SessionKey &key = top[i].key;
+        if (i > 0)
+            json += ",";
+        json += "{";
+        if (conversations)
+        {
+            size_t addr_length = key.length / 2;
+            uint8_t version = addr_length == 16 ? 6 : 4;
+            json += "\"hostA\":\"" + PacketParser::addressToString(key.bytes, version) + "\",";
+            json += "\"hostB\":\"" + PacketParser::addressToString(key.bytes + addr_length, version) + "\",";
+        }
+        else
+        {
+            json += "\"host\":\"" + PacketParser::addressToString(key.bytes, key.length == 16 ? 6 : 4) + "\",";
+        }
+        json += "\"" + std::string(weight.count_name) + "\":" + std::to_string(top[i].count) + ",";
+        json += "\"error\":" + std::to_string(top[i].error) + ",";
+        json += "\"" + std::string(weight.other_name) + "\":" + std::to_string(top[i].other);
+        json += "}";
+    }
+    json += "]}";
+    return json;
+}
+
+// The sources, destinations and conversations ranked by one weight, as a
+// JSON object's members
+static std::string talkerSummariesJson(const std::vector<TopTalkers> &shard_talkers,
+                                       TalkerSummaries TopTalkers::*ranking, size_t count, const TalkerWeight &weight)
+{
+    std::vector<const SpaceSaving *> sources;
+    std::vector<const SpaceSaving *> destinations;
+    std::vector<const SpaceSaving *> conversations;
+    for (const TopTalkers &talkers : shard_talkers)
+    {
+        const TalkerSummaries &summaries = talkers.*ranking;
+        sources.push_back(&summaries.sources);
+        destinations.push_back(&summaries.destinations);
+        conversations.push_back(&summaries.conversations);
+    }
+
+    std::string json = "\"sources\":" + mergedTalkersJson(sources, count, false, weight);
+    json += ",\"destinations\":" + mergedTalkersJson(destinations, count, false, weight);
+    json += ",\"conversations\":" + mergedTalkersJson(conversations, count, true, weight);
+    return json;
+}
+
+std::string CapturePipeline::topTalkersJson(size_t count) const
+{
+    std::vector<TopTalkers> shard_talkers;
+    {
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        for (const auto &shard : shards_)
+        {
+            shard_talkers.push_back(shard->flows.topTalkers());
+        }
+    }
+
+    // The byte rankings stay at the top level where callers first found them
+    std::string json = "{" + talkerSummariesJson(shard_talkers, &TopTalkers::by_bytes, count, BY_BYTES);
+    json += ",\"byPackets\":{" + talkerSummariesJson(shard_talkers, &TopTalkers::by_packets, count, BY_PACKETS);
+    json += "}}";
+    return json;
+}
+
+struct FlowMetricsRow
+{
+    SessionKey key;
+    FlowStats flow;
+};
+
+// Flows to one responding address
+struct DestinationMetrics
+{
+    SessionKey host; // filled in when the shards are merged
+    uint64_t flows;
+    uint64_t bytes;
+    uint64_t retransmits;
+    uint64_t out_of_order;
+    uint64_t zero_windows;
+    uint64_t handshake_rtt_sum_us;
+    uint64_t handshakes;
+    uint32_t min_rtt_us; // 0 until a flow has an RTT sample
+
+    DestinationMetrics()
+        : flows(0), bytes(0), retransmits(0), out_of_order(0), zero_windows(0), handshake_rtt_sum_us(0),
+          handshakes(0), min_rtt_us(0)
+    {
+    }
+
+    void add(const DestinationMetrics &other)
+    {
+        flows += other.flows;
+        bytes += other.bytes;
+        retransmits += other.retransmits;
+        out_of_order += other.out_of_order;
+        zero_windows += other.zero_windows;
+        handshake_rtt_sum_us += other.handshake_rtt_sum_us;
+        handshakes += other.handshakes;
+        if (other.min_rtt_us != 0 && (min_rtt_us == 0 || other.min_rtt_us < min_rtt_us))
+        {
+            min_rtt_us = other.min_rtt_us;
+        }
+    }
+};
+
+static uint64_t flowBytes(const FlowStats &flow)
+{
+    return flow.bytes[0] + flow.bytes[1];
+}
+
+static bool moreBytes(const FlowMetricsRow &a, const FlowMetricsRow &b)
+{
+    return flowBytes(a.flow) > flowBytes(b.flow);
+}
+
+// One shard's share of flowMetricsJson(), filled on its worker: the
+// busiest matching flows as a min-heap by bytes, and per-destination sums
+struct FlowMetricsScan
+{
+    size_t count;
+    const HistoryFilter &filter;
+    std::vector<FlowMetricsRow> top;
+    FlowTable<DestinationMetrics> destinations;
+
+    FlowMetricsScan(size_t top_count, const HistoryFilter &flow_filter)
+        : count(top_count), filter(flow_filter), destinations(64)
+    {
+    }
+
+    bool matches(const SessionKey &key) const
+    {
+        if (filter.port != 0 && key.sourcePort() != filter.port && key.destPort() != filter.port)
+        {
+            return false;
+        }
+        if (filter.ip_version == 0)
+        {
+            return true;
+        }
+        return key.ipVersion() == filter.ip_version &&
+               (std::memcmp(key.sourceAddr(), filter.address, key.addressLength()) == 0 ||
+                std::memcmp(key.destAddr(), filter.address, key.addressLength()) == 0);
+    }
+
+    void visit(const SessionKey &key, const FlowStats &flow)
+    {
+        if (key.protocol() != 6 || !matches(key))
+        {
+            return;
+        }
+
+        if (count > 0 && (top.size() < count || moreBytes(FlowMetricsRow{key, flow}, top.front())))
+        {
+            if (top.size() == count)
+            {
+                std::pop_heap(top.begin(), top.end(), moreBytes);
+                top.pop_back();
+            }
+            top.push_back(FlowMetricsRow{key, flow});
+            std::push_heap(top.begin(), top.end(), moreBytes);
+        }
+
+        const uint8_t *responder = flow.initiator == 0 ? key.destAddr() : key.sourceAddr();
+        bool inserted = false;
+        DestinationMetrics *destination =
+            destinations.findOrInsert(TopTalkers::hostKey(responder, key.ipVersion()), inserted);
+
+        const TcpMetrics &tcp = flow.tcp;
+        DestinationMetrics sample;
+        sample.flows = 1;
+        sample.bytes = flowBytes(flow);
+        sample.retransmits = tcp.retransmits[0] + tcp.retransmits[1];
+        sample.out_of_order = tcp.out_of_order[0] + tcp.out_of_order[1];
+        sample.zero_windows = tcp.zero_windows[0] + tcp.zero_windows[1];
+        if (tcp.handshake_rtt_us != 0)
+        {
+            sample.handshake_rtt_sum_us = tcp.handshake_rtt_us;
+            sample.handshakes = 1;
+        }
+        // The round trip to the destination is timed on the initiator's data
+        sample.min_rtt_us = tcp.min_rtt_us[flow.initiator];
+        destination->add(sample);
+    }
+};
+
+// tx fields are from the initiator's side, rx from the responder's
+static std::string flowMetricsRowJson(const FlowMetricsRow &row)
+{
+    const SessionKey &key = row.key;
+    const FlowStats &flow = row.flow;
+    const TcpMetrics &tcp = flow.tcp;
+    uint8_t tx = flow.initiator;
+    uint8_t rx = tx ^ 1;
+    uint8_t version = key.ipVersion();
+    bool swapped = flow.initiator != 0;
+
+    uint64_t duration_ns = flow.last_seen_ns > flow.first_seen_ns ? flow.last_seen_ns - flow.first_seen_ns : 0;
+    uint64_t throughput =
+        duration_ns > 0 ? static_cast<uint64_t>(flowBytes(flow) * 8.0 * NS_PER_SECOND / duration_ns) : 0;
+
+    std::string json = "{";
+    json += "\"src\":\"" + PacketParser::addressToString(swapped ? key.destAddr() : key.sourceAddr(), version) + "\",";
+    json += "\"srcPort\":" + std::to_string(swapped ? key.destPort() : key.sourcePort()) + ",";
+    json += "\"dst\":\"" + PacketParser::addressToString(swapped ? key.sourceAddr() : key.destAddr(), version) + "\",";
+    json += "\"dstPort\":" + std::to_string(swapped ? key.sourcePort() : key.destPort()) + ",";
+    json += "\"durationMs\":" + std::to_string(duration_ns / 1000000) + ",";
+    json += "\"txBytes\":" + std::to_string(flow.txBytes()) + ",";
+    json += "\"rxBytes\":" + std::to_string(flow.rxBytes()) + ",";
+    json += "\"txPackets\":" + std::to_string(flow.txPackets()) + ",";
+    json += "\"rxPackets\":" + std::to_string(flow.rxPackets()) + ",";
+    json += "\"throughputBps\":" + std::to_string(throughput) + ",";
+    json += "\"handshakeRttUs\":" + std::to_string(tcp.handshake_rtt_us) + ",";
+    json += "\"txSrttUs\":" + std::to_string(tcp.srtt_us[tx]) + ",";
+    json += "\"rxSrttUs\":" + std::to_string(tcp.srtt_us[rx]) + ",";
+    json += "\"txMinRttUs\":" + std::to_string(tcp.min_rtt_us[tx]) + ",";
+    json += "\"rxMinRttUs\":" + std::to_string(tcp.min_rtt_us[rx]) + ",";
+    json += "\"txRetransmits\":" + std::to_string(tcp.retransmits[tx]) + ",";
+    json += "\"rxRetransmits\":" + std::to_string(tcp.retransmits[rx]) + ",";
+    json += "\"txOutOfOrder\":" + std::to_string(tcp.out_of_order[tx]) + ",";
+    json += "\"rxOutOfOrder\":" + std::to_string(tcp.out_of_order[rx]) + ",";
+    json += "\"txZeroWindows\":" + std::to_string(tcp.zero_windows[tx]) + ",";
+    json += "\"rxZeroWindows\":" + std::to_string(tcp.zero_windows[rx]);
+    json += "}";
+    return json;
+}
+
+std::string CapturePipeline::flowMetricsJson(size_t count, const HistoryFilter &filter) const
+{
+    // Each shard has a single visit slot, so queries take turns
+    std::lock_guard<std::mutex> visit_lock(flow_visit_mutex_);
+
+    std::vector<std::shared_ptr<Shard>> shards;
+    std::vector<std::unique_ptr<FlowMetricsScan>> scans;
+    std::vector<FlowShard::FlowVisitor> visitors;
+    bool complete = true;
+    {
+        std::lock_guard<std::mutex> lock(shards_mutex_);
+        shards = shards_;
+        for (size_t i = 0; i < shards.size(); ++i)
+        {
+            scans.emplace_back(new FlowMetricsScan(count, filter));
+        }
+        for (size_t i = 0; i < shards.size(); ++i)
+        {
+            FlowMetricsScan *scan = scans[i].get();
+            visitors.push_back([scan](const SessionKey &key, const FlowStats &flow)
+                               {
+                                   scan->visit(key, flow);
+                               });
+        }
+        // Every worker walks its table at once; with none running this
+        // thread is each shard's only user
+        for (size_t i = 0; i < shards.size(); ++i)
+        {
+            shards[i]->flows.requestVisit(visitors[i]);
+            if (!running_)
+            {
+                shards[i]->flows.maintain();
+            }
+        }
+    }
+
+    // Waited out without shards_mutex_, so stats readers and start()/stop()
+    // are not held up behind a busy worker; the copied pointers keep the
+    // shards alive if start() replaces them meanwhile
+    for (const auto &shard : shards)
+    {
+        complete = shard->flows.awaitVisit(FLOW_VISIT_TIMEOUT_MS) && complete;
+    }
+
+    std::vector<FlowMetricsRow> top;
+    FlowTable<DestinationMetrics> destinations(64);
+    for (const auto &scan : scans)
+    {
+        top.insert(top.end(), scan->top.begin(), scan->top.end());
+        scan->destinations.forEach([&destinations](const SessionKey &key, DestinationMetrics &metrics)
+                                   {
+                                       bool inserted = false;
+                                       destinations.findOrInsert(key, inserted)->add(metrics);
+                                   });
+    }
+    // Both lists are capped at the caller's count, whichever is shorter
+    size_t flow_count = std::min(count, top.size());
+    std::partial_sort(top.begin(), top.begin() + flow_count, top.end(), moreBytes);
+
+    std::vector<DestinationMetrics> by_destination;
+    destinations.forEach([&by_destination](const SessionKey &key, DestinationMetrics &metrics)
+                         {
+                             by_destination.push_back(metrics);
+                             by_destination.back().host = key;
+                         });
+    size_t destination_count = std::min(count, by_destination.size());
+    std::partial_sort(by_destination.begin(), by_destination.begin() + destination_count, by_destination.end(),
+                      [](const DestinationMetrics &a, const DestinationMetrics &b)
+                      {
+                          return a.bytes > b.bytes;
+                      });
+
+    std::string json = "{\"complete\":" + std::string(complete ? "true" : "false") + ",\"flows\":[";
+    for (size_t i = 0; i < flow_count; ++i)
+    {
+        if (i > 0)
+            json += ",";
+        json += flowMetricsRowJson(top[i]);
+    }
+    json += "],\"destinations\":[";
+    for (size_t i = 0; i < destination_count; ++i)
+    {
+        const DestinationMetrics &destination = by_destination[i];
+        if (i > 0)
+            json += ",";
+        json += "{";
+        json += "\"host\":\"" +
+                PacketParser::addressToString(destination.host.bytes, destination.host.length == 16 ? 6 : 4) + "\",";
+        json += "\"flows\":" + std::to_string(destination.flows) + ",";
+        json += "\"bytes\":" + std::to_string(destination.bytes) + ",";
+        json += "\"handshakeRttUs\":" +
+                std::to_string(destination.handshakes ? destination.handshake_rtt_sum_us / destination.handshakes : 0) +
+                ",";
+        json += "\"minRttUs\":" + std::to_string(destination.min_rtt_us) + ",";
+        json += "\"retransmits\":" + std::to_string(destination.retransmits) + ",";
+        json += "\"outOfOrder\":" + std::to_string(destination.out_of_order) + ",";
+        json += "\"zeroWindows\":" + std::to_string(destination.zero_windows);
+        json += "}";
+    }
+    json += "]}";
+    return json;
+}
+
+FlowCounts CapturePipeline::flowCounts() const
+{
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    FlowCounts counts;
+    for (const auto &shard : shards_)
+    {
+        shard->flows.addFlowCounts(counts);
+    }
+    return counts;
+}
+
+void CapturePipeline::resetStats()
+{
+    history_.clear();
+
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    for (auto &shard : shards_)
+    {
+        shard->flows.requestReset();
+        // With no worker running this thread is the shard's only user
+        if (!running_)
+        {
+            shard->flows.maintain();
+        }
+    }
+}
+
+std::vector<PipelineStageStats> CapturePipeline::stats() const
+{
+    std::lock_guard<std::mutex> lock(shards_mutex_);
+    std::vector<PipelineStageStats> stats;
+    for (size_t i = 0; i < shards_.size(); ++i)
+    {
+        stats.push_back({"ingress" + std::to_string(i), shards_[i]->ingress.stats()});
+    }
+    stats.push_back({"forward", forward_.stats()});
+    stats.push_back({"record", record_.stats()});
+    for (size_t i = 0; i < shards_.size(); ++i)
+    {
+        stats.push_back({"ui" + std::to_string(i), shards_[i]->ui.stats()});
+    }
+    return stats;
+}
+
+std::string CapturePipeline::statsJson() const
+{
+    std::vector<PipelineStageStats> stages = stats();
+    PacketPoolStats pool = pool_.stats();
+    std::string json = "{\"rings\":[";
+
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const RingStats &ring = stages[i].ring;
+        if (i > 0)
+            json += ",";
+        json += "{";
+        json += "\"ring\":\"" + stages[i].name + "\",";
+        json += "\"capacity\":" + std::to_string(ring.capacity) + ",";
+        json += "\"occupancy\":" + std::to_string(ring.occupancy) + ",";
+        json += "\"highWater\":" + std::to_string(ring.high_water) + ",";
+        json += "\"pushed\":" + std::to_string(ring.pushed) + ",";
+        json += "\"dropped\":" + std::to_string(ring.dropped);
+        json += "}";
+    }
+
+    json += "],\"pool\":{";
+    json += "\"buffers\":" + std::to_string(pool.buffers) + ",";
+    json += "\"inUse\":" + std::to_string(pool.in_use) + ",";
+    json += "\"exhausted\":" + std::to_string(pool.exhausted) + ",";
+    json += "\"jumboBuffers\":" + std::to_string(pool.jumbo_buffers) + ",";
+    json += "\"jumboInUse\":" + std::to_string(pool.jumbo_in_use) + ",";
+    json += "\"jumboExhausted\":" + std::to_string(pool.jumbo_exhausted);
+    json += "}";
+
+    FlowCounts flows = flowCounts();
+    json += ",\"flows\":{";
+    json += "\"active\":" + std::to_string(flows.flows) + ",";
+    json += "\"limit\":" + std::to_string(flows.max_flows) + ",";
+    json += "\"synSent\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::SynSent)]) + ",";
+    json += "\"synReceived\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::SynReceived)]) + ",";
+    json += "\"established\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::Established)]) + ",";
+    json += "\"finWait\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::FinWait)]) + ",";
+    json += "\"timeWait\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::TimeWait)]) + ",";
+    json += "\"closed\":" + std::to_string(flows.tcp_states[static_cast<size_t>(TcpConnState::Closed)]) + ",";
+    json += "\"closedRetired\":" + std::to_string(flows.closed_retired) + ",";
+    json += "\"idleExpired\":" + std::to_string(flows.idle_expired) + ",";
+    json += "\"evicted\":" + std::to_string(flows.evicted);
+    json += "}";
+
+    HistoryStats history = history_.stats();
+    json += ",\"history\":{";
+    json += "\"capacity\":" + std::to_string(history.capacity) + ",";
+    json += "\"stored\":" + std::to_string(history.stored) + ",";
+    json += "\"appended\":" + std::to_string(history.appended) + ",";
+    json += "\"memoryBytes\":" + std::to_string(history.memory_bytes);
+    json += "}";
+
+    std::lock_guard<std::mutex> lock(recorder_mutex_);
+    if (recorder_)
+    {
+        json += ",\"recorder\":" + recorder_->statsJson();
+    }
+    json += "}";
+    return json;
+}
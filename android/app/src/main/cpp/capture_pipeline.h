@@ -0,0 +1,173 @@
+#ifndef CAPTURE_PIPELINE_H
+#define CAPTURE_PIPELINE_H
+
+#include "capture_filter.h"
+#include "flow_shard.h"
+#include "packet_batcher.h"
+#include "packet_history.h"
+#include "packet_parser.h"
+#include "packet_pool.h"
+#include "pcapng_writer.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PipelineStageStats
+{
+    std::string name;
+    RingStats ring;
+};
+
+// Staged packet path, one thread per stage:
+//
+//   capture --ingress[i]--> shard worker i --ui[i]--> UI sink (JNI, history)
+//      |
+//      +------forward-----> forward sink (TunStack, VPN mode only)
+//      |
+//      +------record------> record sink (PcapngWriter, while recording)
+//
+// The capture thread reads straight into pooled buffers and only passes
+// descriptors on; the forward sink and the flow's shard worker each hold a
+// reference to the same buffer, so no stage copies the packet and a slow
+// JNI call or upstream connect no longer holds up reading.
+// Packets are spread over the shard workers RSS-style by a symmetric tuple
+// hash; each worker owns its FlowShard, so parsing and accounting scale
+// with cores without sharing a lock. A full analysis or record ring sheds
+// the packet and counts it, while a full forward ring holds up capture;
+// the forward and record rings are fed straight from capture so display
+// backpressure never costs a relayed or recorded packet.
+class CapturePipeline
+{
+public:
+    // UI sink thread: hand the batcher's records to the UI; cleared afterwards
+    typedef std::function<void(const PacketBatcher &)> FlushFn;
+    // Forward sink thread: one packet read from the TUN interface
+    typedef std::function<void(const PacketView &)> ForwardFn;
+
+    static const size_t MAX_SHARDS = 8;
+
+    explicit CapturePipeline(PacketBatcher &batcher);
+    ~CapturePipeline();
+
+    // Worker count for the next start(); 0 picks one from the core count.
+    // Changing it discards the shards' flow tables and counters.
+    void setShardCount(size_t shards);
+    // Flow table bounds for the next start(), split evenly across the
+    // shards: at most max_flows flows (0 for the default) and memory_bytes
+    // of table in total (0 for no memory bound). Past either, new flows evict the least
+    // recently used.
+    void setFlowLimits(size_t max_flows, size_t memory_bytes);
+
+    // An empty forward callback leaves the forward ring unused. The userspace
+    // filter is only applied when apply_filter is set (VPN mode); rooted
+    // capture filters in the kernel.
+    void start(FlushFn flush, ForwardFn forward, bool apply_filter);
+    // Drains everything already published, then joins the stage threads.
+    // Call after the capture thread has stopped producing.
+    void stop();
+
+    // Filter used by the workers; picked up once per drain
+    void setFilter(std::shared_ptr<CaptureFilter> filter);
+
+    // Packets submitted from now on are also written to the recorder, until
+    // it is replaced. Returns once the record sink no longer uses the
+    // previous recorder, so the caller may close it.
+    void setRecorder(std::shared_ptr<PcapngWriter> recorder);
+
+    // Buffers for the capture thread to read into
+    PacketPool &pool() { return pool_; }
+    // Every batch the UI sink delivers, for paging through past packets
+    const PacketHistory &history() const { return history_; }
+
+    // Capture thread only: hands a filled buffer to the forward and record
+    // sinks (when in use) and to its flow's shard, taking over the caller's
+    // reference. A full analysis or record ring sheds its share and counts
+    // the drop, unless wait_for_space is set (offline replay), in which case
+    // it spins until the consumer catches up. A full forward ring is always
+    // waited out.
+    void submit(PacketBuffer *buffer, bool wait_for_space = false);
+
+    // Protocol totals merged from every shard, most packets first
+    std::vector<ProtocolStats> protocolStats() const;
+    size_t flowCount() const;
+    FlowCounts flowCounts() const;
+    void resetStats();
+
+    // Heaviest sources, destinations and conversations by bytes, and under
+    // "byPackets" by packets, merged from every shard's summaries, at most
+    // `count` of each
+    std::string topTalkersJson(size_t count) const;
+    // TCP metrics of the `count` busiest flows matching the filter's host
+    // and port, and the same summed per destination (the responding
+    // address). Each shard's worker walks its own table for this, so it
+    // waits up to half a second; "complete" is false if a shard timed out.
+    std::string flowMetricsJson(size_t count, const HistoryFilter &filter) const;
+
+    std::vector<PipelineStageStats> stats() const;
+    std::string statsJson() const;
+
+private:
+    struct Shard
+    {
+        SpscRing<PacketBuffer *> ingress;
+        SpscRing<PacketRecord> ui;
+        FlowShard flows;
+        std::thread thread;
+
+        Shard(size_t ingress_slots, size_t ui_slots, RingSignal *ui_signal)
+            : ingress(ingress_slots), ui(ui_slots, ui_signal)
+        {
+        }
+    };
+
+    void createShards(size_t count);
+    void runWorker(Shard &shard);
+    void runUiSink();
+    void runForwardSink();
+    void runRecordSink();
+    void flushBatch();
+
+    // The UI sink drains every shard's ui ring and sleeps on this one signal
+    RingSignal ui_signal_;
+    // Only replaced while stopped; the mutex guards readers of the stats
+    // views. Shared so a flow query can wait on its shards without the mutex.
+    std::vector<std::shared_ptr<Shard>> shards_;
+    mutable std::mutex shards_mutex_;
+    mutable std::mutex flow_visit_mutex_;
+    size_t requested_shards_;
+    size_t max_flows_;
+    size_t flow_memory_bytes_;
+    SpscRing<PacketBuffer *> forward_;
+    SpscRing<PacketBuffer *> record_;
+    PacketPool pool_;
+    PacketHistory history_;
+
+    PacketBatcher &batcher_;
+    FlushFn flush_;
+    ForwardFn forward_fn_;
+    bool apply_filter_;
+    // Set while the workers own the shards; written under shards_mutex_ so
+    // stats readers can tell whether to maintain a shard themselves
+    bool running_;
+
+    std::mutex filter_mutex_;
+    std::shared_ptr<CaptureFilter> filter_;
+
+    // Held by the record sink while it writes, so setRecorder() can wait it out
+    mutable std::mutex recorder_mutex_;
+    std::shared_ptr<PcapngWriter> recorder_;
+    std::atomic<bool> recording_;
+
+    std::atomic<bool> workers_running_;
+    std::atomic<bool> sinks_running_;
+    std::thread ui_thread_;
+    std::thread forward_thread_;
+    std::thread record_thread_;
+};
+
+#endif // CAPTURE_PIPELINE_H
@@ -0,0 +1,398 @@
+#include "flow_shard.h"
+#include "capture_clock.h"
+#include <chrono>
+#include <cstring>
+
+static const uint64_t NS_PER_SECOND = 1000000000ULL;
+static const uint64_t NS_PER_MS = 1000000ULL;
+
+// Flows with no packet for this long are dropped from the shard's table,
+// by TcpConnState. Closed connections linger just long enough to absorb
+// retransmitted FINs and RSTs instead of reappearing as new flows.
+static const uint64_t FLOW_IDLE_NS[TCP_CONN_STATE_COUNT] = {
+    120 * NS_PER_SECOND, // None (UDP and others)
+    30 * NS_PER_SECOND,  // SynSent
+    30 * NS_PER_SECOND,  // SynReceived
+    120 * NS_PER_SECOND, // Established
+    30 * NS_PER_SECOND,  // FinWait
+    5 * NS_PER_SECOND,   // TimeWait
+    2 * NS_PER_SECOND,   // Closed
+};
+// How stale the top talkers other threads see may get, in monotonic time
+static const uint64_t TALKERS_PUBLISH_INTERVAL_MS = 250;
+
+FlowShard::FlowShard()
+    : flow_count_(0), closed_retired_(0), idle_expired_(0), evicted_(0), max_flows_(0), reset_requested_(false),
+      clock_ns_(0), anchor_clock_ns_(0), anchor_monotonic_ms_(0), flow_now_ms_(0), state_flows_(),
+      last_publish_ms_(0), visitor_(nullptr), visit_done_(false), visit_requested_(false)
+{
+    for (auto &count : state_counts_)
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void FlowShard::setMaxFlows(size_t max_flows)
+{
+    flows_.setMaxSize(max_flows);
+    max_flows_.store(max_flows, std::memory_order_relaxed);
+}
+
+void FlowShard::process(const PacketView &view)
+{
+    counters_.add(view.protocol, view.size);
+    talkers_.add(view);
+
+    if (view.timestamp_ns > clock_ns_)
+    {
+        if (clock_ns_ == 0)
+        {
+            // The wheel starts at the first packet's time
+            expiry_wheel_.advance(view.timestamp_ns / NS_PER_MS, [](const TimerWheel::Entry &) {});
+        }
+        clock_ns_ = view.timestamp_ns;
+    }
+
+    uint8_t direction = 0;
+    bool inserted = false;
+    SessionKey key = SessionKey::canonicalFromPacket(view, direction);
+    // An evicted flow's packets stay in the protocol and talker totals; its
+    // wheel entry finds no flow and lapses
+    FlowStats *flow = flows_.findOrInsert(key, inserted,
+                                          [this](const SessionKey &, FlowStats &evicted)
+                                          {
+                                              state_flows_[static_cast<size_t>(evicted.tcp_state)]--;
+                                              evicted_.store(evicted_.load(std::memory_order_relaxed) + 1,
+                                                             std::memory_order_relaxed);
+                                          });
+    TcpConnState previous_state = flow->tcp_state;
+    if (inserted)
+    {
+        flow->initiator = direction;
+        flow_count_.store(flows_.size(), std::memory_order_relaxed);
+    }
+    if (view.ip_protocol == 6 && trackTcp(*flow, view.tcp_flags, direction, inserted))
+    {
+        // A new connection on a reused tuple counts from zero
+        flow->packets[0] = flow->packets[1] = 0;
+        flow->bytes[0] = flow->bytes[1] = 0;
+        inserted = true;
+    }
+    if (inserted)
+    {
+        flow->first_seen_ns = view.timestamp_ns;
+    }
+    flow->packets[direction]++;
+    flow->bytes[direction] += view.size;
+    flow->last_seen_ns = view.timestamp_ns;
+    if (view.ip_protocol == 6)
+    {
+        flow->tcp.update(view, direction, flow->initiator);
+    }
+
+    if (flow->tcp_state != previous_state || flow->expiry_deadline_ms == 0)
+    {
+        if (flow->expiry_deadline_ms != 0)
+        {
+            state_flows_[static_cast<size_t>(previous_state)]--;
+        }
+        state_flows_[static_cast<size_t>(flow->tcp_state)]++;
+
+        // New flows get their first deadline, and closing ones an earlier
+        // one; a later deadline is picked up when the current one fires
+        uint64_t deadline = idleDeadlineMs(*flow);
+        if (flow->expiry_deadline_ms == 0 || deadline < flow->expiry_deadline_ms)
+        {
+            flow->expiry_deadline_ms = deadline;
+            expiry_wheel_.schedule(key, deadline);
+        }
+    }
+}
+
+void FlowShard::maintain()
+{
+    if (reset_requested_.exchange(false, std::memory_order_acquire))
+    {
+        counters_.reset();
+        flows_.clear();
+        expiry_wheel_.clear();
+        flow_count_.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < TCP_CONN_STATE_COUNT; ++i)
+        {
+            state_flows_[i] = 0;
+            state_counts_[i].store(0, std::memory_order_relaxed);
+        }
+        closed_retired_.store(0, std::memory_order_relaxed);
+        idle_expired_.store(0, std::memory_order_relaxed);
+        evicted_.store(0, std::memory_order_relaxed);
+        talkers_.clear();
+        publishTalkers();
+    }
+
+    if (visit_requested_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(visit_mutex_);
+        visit_requested_.store(false, std::memory_order_relaxed);
+        if (visitor_)
+        {
+            const FlowVisitor &visitor = *visitor_;
+            flows_.forEach([&visitor](const SessionKey &key, FlowStats &flow)
+                           {
+                               visitor(key, flow);
+                           });
+            visitor_ = nullptr;
+            visit_done_ = true;
+            visit_cv_.notify_all();
+        }
+    }
+
+    uint64_t now_ms = CaptureClock::monotonicMs();
+    if (now_ms - last_publish_ms_ >= TALKERS_PUBLISH_INTERVAL_MS)
+    {
+        publishTalkers();
+        last_publish_ms_ = now_ms;
+    }
+
+    if (clock_ns_ == 0)
+    {
+        return; // no packets yet
+    }
+    if (clock_ns_ != anchor_clock_ns_)
+    {
+        anchor_clock_ns_ = clock_ns_;
+        anchor_monotonic_ms_ = now_ms;
+    }
+    uint64_t flow_now_ms = anchor_clock_ns_ / NS_PER_MS + (now_ms - anchor_monotonic_ms_);
+    if (flow_now_ms > flow_now_ms_)
+    {
+        flow_now_ms_ = flow_now_ms;
+    }
+    expireFlows(flow_now_ms_);
+
+    flow_count_.store(flows_.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < TCP_CONN_STATE_COUNT; ++i)
+    {
+        state_counts_[i].store(state_flows_[i], std::memory_order_relaxed);
+    }
+}
+
+uint64_t FlowShard::idleDeadlineMs(const FlowStats &flow)
+{
+    return (flow.last_seen_ns + FLOW_IDLE_NS[static_cast<size_t>(flow.tcp_state)]) / NS_PER_MS;
+}
+
+void FlowShard::expireFlows(uint64_t now_ms)
+{
+    uint64_t closed = 0;
+    uint64_t idle = 0;
+    expiry_wheel_.advance(now_ms, [this, now_ms, &closed, &idle](const TimerWheel::Entry &entry)
+                          {
+                              FlowStats *flow = flows_.find(entry.key);
+
+                              // Evicted, or superseded by an earlier deadline
+                              if (!flow || flow->expiry_deadline_ms != entry.deadline_ms)
+                              {
+                                  return;
+                              }
+
+                              uint64_t deadline = idleDeadlineMs(*flow);
+                              if (deadline > now_ms)
+                              {
+                                  flow->expiry_deadline_ms = deadline;
+                                  expiry_wheel_.schedule(entry.key, deadline);
+                                  return;
+                              }
+
+                              if (flow->tcp_state == TcpConnState::TimeWait || flow->tcp_state == TcpConnState::Closed)
+                              {
+                                  closed++;
+                              }
+                              else
+                              {
+                                  idle++;
+                              }
+                              state_flows_[static_cast<size_t>(flow->tcp_state)]--;
+                              flows_.erase(entry.key);
+                          });
+
+    if (closed > 0 || idle > 0)
+    {
+        closed_retired_.store(closed_retired_.load(std::memory_order_relaxed) + closed, std::memory_order_relaxed);
+        idle_expired_.store(idle_expired_.load(std::memory_order_relaxed) + idle, std::memory_order_relaxed);
+    }
+}
+
+void FlowShard::addFlowCounts(FlowCounts &counts) const
+{
+    counts.flows += flow_count_.load(std::memory_order_relaxed);
+    counts.max_flows += max_flows_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < TCP_CONN_STATE_COUNT; ++i)
+    {
+        counts.tcp_states[i] += state_counts_[i].load(std::memory_order_relaxed);
+    }
+    counts.closed_retired += closed_retired_.load(std::memory_order_relaxed);
+    counts.idle_expired += idle_expired_.load(std::memory_order_relaxed);
+    counts.evicted += evicted_.load(std::memory_order_relaxed);
+}
+
+bool FlowShard::trackTcp(FlowStats &flow, uint8_t flags, uint8_t direction, bool inserted)
+{
+    if (flags & TCP_RST)
+    {
+        flow.tcp_state = TcpConnState::Closed;
+        return false;
+    }
+
+    if (flags & TCP_SYN)
+    {
+        if (!(flags & TCP_ACK))
+        {
+            // A SYN on a finished tuple is a new connection reusing the ports
+            if (inserted || flow.tcp_state == TcpConnState::TimeWait || flow.tcp_state == TcpConnState::Closed)
+            {
+                flow.tcp_state = TcpConnState::SynSent;
+                flow.initiator = direction;
+                flow.fin_seen = 0;
+                flow.tcp = TcpMetrics();
+                return !inserted;
+            }
+        }
+        else if (inserted)
+        {
+            // Picked up at the SYN-ACK, which comes from the responder
+            flow.tcp_state = TcpConnState::SynReceived;
+            flow.initiator = direction ^ 1;
+        }
+        else if (flow.tcp_state == TcpConnState::SynSent && direction != flow.initiator)
+        {
+            flow.tcp_state = TcpConnState::SynReceived;
+        }
+        return false;
+    }
+
+    if (inserted)
+    {
+        flow.tcp_state = TcpConnState::Established;
+    }
+    else if (flow.tcp_state == TcpConnState::Closed)
+    {
+        // Stragglers after a reset do not reopen the flow
+        return false;
+    }
+    else if (flow.tcp_state == TcpConnState::SynReceived && direction == flow.initiator && (flags & TCP_ACK))
+    {
+        flow.tcp_state = TcpConnState::Established;
+    }
+
+    if (flags & TCP_FIN)
+    {
+        flow.fin_seen |= static_cast<uint8_t>(1 << direction);
+        flow.tcp_state = flow.fin_seen == 3 ? TcpConnState::TimeWait : TcpConnState::FinWait;
+    }
+    return false;
+}
+
+void FlowShard::requestVisit(const FlowVisitor &visitor)
+{
+    std::lock_guard<std::mutex> lock(visit_mutex_);
+    visitor_ = &visitor;
+    visit_done_ = false;
+    visit_requested_.store(true, std::memory_order_release);
+}
+
+bool FlowShard::awaitVisit(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(visit_mutex_);
+    bool done = visit_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                   [this]
+                                   {
+                                       return visit_done_;
+                                   });
+    visitor_ = nullptr;
+    return done;
+}
+
+TopTalkers FlowShard::topTalkers() const
+{
+    std::lock_guard<std::mutex> lock(talkers_mutex_);
+    return published_talkers_;
+}
+
+// The copy reuses the published summaries' storage, so publishing never allocates
+void FlowShard::publishTalkers()
+{
+    std::lock_guard<std::mutex> lock(talkers_mutex_);
+    published_talkers_ = talkers_;
+}
+
+// Mixes one endpoint (address and port); the two endpoints are then
+// combined with an addition so the order does not matter
+static uint64_t endpointHash(const uint8_t *addr, size_t addr_length, uint16_t port)
+{
+    uint64_t hash = (port + 1) * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < addr_length; i += 4)
+    {
+        uint32_t word;
+        std::memcpy(&word, addr + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+uint32_t FlowShard::flowHash(const uint8_t *packet, size_t length)
+{
+    if (length < 20)
+    {
+        return 0;
+    }
+
+    const uint8_t *source;
+    const uint8_t *dest;
+    size_t addr_length;
+    size_t l4_offset;
+    uint8_t protocol;
+    bool has_ports;
+
+    uint8_t version = packet[0] >> 4;
+    if (version == 4)
+    {
+        source = packet + 12;
+        dest = packet + 16;
+        addr_length = 4;
+        l4_offset = (packet[0] & 0x0F) * 4;
+        protocol = packet[9];
+        // Fragments are hashed on addresses only so every piece of a datagram stays together
+        has_ports = (packet[6] & 0x3F) == 0 && packet[7] == 0;
+    }
+    else if (version == 6 && length >= 40)
+    {
+        source = packet + 8;
+        dest = packet + 24;
+        addr_length = 16;
+        l4_offset = 40;
+        protocol = packet[6];
+        has_ports = true;
+    }
+    else
+    {
+        return 0;
+    }
+
+    uint16_t source_port = 0;
+    uint16_t dest_port = 0;
+    if (has_ports && (protocol == 6 || protocol == 17) && l4_offset + 4 <= length)
+    {
+        source_port = static_cast<uint16_t>((packet[l4_offset] << 8) | packet[l4_offset + 1]);
+        dest_port = static_cast<uint16_t>((packet[l4_offset + 2] << 8) | packet[l4_offset + 3]);
+    }
+
+    uint64_t hash = endpointHash(source, addr_length, source_port) +
+                    endpointHash(dest, addr_length, dest_port) + protocol;
+
+    // murmur3 finalizer
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return static_cast<uint32_t>(hash);
+}
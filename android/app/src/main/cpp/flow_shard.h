@@ -0,0 +1,179 @@
+#ifndef FLOW_SHARD_H
+#define FLOW_SHARD_H
+
+#include "flow_table.h"
+#include "packet_parser.h"
+#include "protocol_counters.h"
+#include "session_key.h"
+#include "tcp_metrics.h"
+#include "timer_wheel.h"
+#include "top_talkers.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProtocolStats
+{
+    std::string protocol;
+    uint64_t packet_count;
+    uint64_t total_bytes;
+
+    ProtocolStats(const std::string &proto = "") : protocol(proto), packet_count(0), total_bytes(0) {}
+};
+
+// Passive view of a TCP connection, driven by the flags seen in either
+// direction. A connection picked up after its handshake starts out
+// Established.
+enum class TcpConnState : uint8_t
+{
+    None, // not TCP
+    SynSent,
+    SynReceived,
+    Established,
+    FinWait,  // one side has sent FIN
+    TimeWait, // both sides have sent FIN
+    Closed,   // reset
+};
+
+static const size_t TCP_CONN_STATE_COUNT = 7;
+
+// Flow table occupancy, by TCP state as of the last maintain(), and flows
+// dropped since the last reset
+struct FlowCounts
+{
+    size_t flows;
+    size_t max_flows;
+    size_t tcp_states[TCP_CONN_STATE_COUNT];
+    uint64_t closed_retired; // after FIN or RST
+    uint64_t idle_expired;
+    uint64_t evicted; // to make room at the size limit
+
+    FlowCounts() : flows(0), max_flows(0), tcp_states(), closed_retired(0), idle_expired(0), evicted(0) {}
+};
+
+// Counters kept per analysed flow. Flows are keyed by
+// SessionKey::canonicalFromPacket(), so both directions share one entry;
+// the counters are indexed by that key's direction bit.
+struct FlowStats
+{
+    uint64_t packets[2];
+    uint64_t bytes[2];
+    uint64_t first_seen_ns;
+    uint64_t last_seen_ns;
+    uint64_t expiry_deadline_ms; // deadline of this flow's live timer-wheel entry
+    uint8_t initiator;           // direction of the flow's first packet, or of its SYN
+    TcpConnState tcp_state;
+    uint8_t fin_seen; // one bit per direction
+    TcpMetrics tcp;   // TCP only; reset when a new connection reuses the tuple
+
+    FlowStats()
+        : packets(), bytes(), first_seen_ns(0), last_seen_ns(0), expiry_deadline_ms(0), initiator(0),
+          tcp_state(TcpConnState::None), fin_seen(0)
+    {
+    }
+
+    // Sent by and to the endpoint that opened the flow
+    uint64_t txPackets() const { return packets[initiator]; }
+    uint64_t rxPackets() const { return packets[initiator ^ 1]; }
+    uint64_t txBytes() const { return bytes[initiator]; }
+    uint64_t rxBytes() const { return bytes[initiator ^ 1]; }
+};
+
+// One analysis worker's slice of the flow and protocol state. Packets are
+// assigned to shards by a symmetric tuple hash, so both directions of a
+// flow land in the same shard and only that shard's worker ever writes
+// here. Other threads read the protocol counters through relaxed atomics,
+// the top talkers through a copy the worker republishes a few times a
+// second, and request a reset instead of clearing state under the worker.
+class FlowShard
+{
+public:
+    typedef std::function<void(const SessionKey &, const FlowStats &)> FlowVisitor;
+
+    FlowShard();
+
+    FlowShard(const FlowShard &) = delete;
+    FlowShard &operator=(const FlowShard &) = delete;
+
+    // Worker thread only, or before the worker starts. Once the table holds
+    // this many flows, each new flow evicts the least recently used one.
+    void setMaxFlows(size_t max_flows);
+
+    // Worker thread only
+    void process(const PacketView &view);
+    // Worker thread only: applies a pending reset and drops flows idle past
+    // their state's timeout. TCP flows go within seconds of closing, half-
+    // open ones sooner than established ones. Flow age is measured on the
+    // capture clock, so replays age correctly, and carried forward by the
+    // monotonic clock while no packets arrive. Deadlines sit in a timer
+    // wheel, so each call touches only the flows that came due.
+    void maintain();
+    // Worker thread only: makes the current top talkers visible to
+    // topTalkers(); maintain() does so a few times a second
+    void publishTalkers();
+
+    // Any thread
+    void addProtocolTotals(ProtocolTotals &totals) const { counters_.addTo(totals); }
+    size_t flowCount() const { return flow_count_.load(std::memory_order_relaxed); }
+    void addFlowCounts(FlowCounts &counts) const;
+    // Any thread: the top talkers as of the worker's last publish
+    TopTalkers topTalkers() const;
+    void requestReset() { reset_requested_.store(true, std::memory_order_release); }
+    // Any thread: asks the worker to pass every flow to `visitor` at its
+    // next maintain(). One visit may be pending per shard; the visitor must
+    // outlive awaitVisit().
+    void requestVisit(const FlowVisitor &visitor);
+    // Waits up to timeout_ms for the requested visit to finish. On timeout
+    // the request is withdrawn, so the visitor is never used after this
+    // returns. True if the visit ran.
+    bool awaitVisit(int timeout_ms);
+
+    // Hash of the IP addresses, ports and protocol read straight from the
+    // header, equal for both directions of a flow. Cheap enough to run on
+    // the capture thread before anything is parsed.
+    static uint32_t flowHash(const uint8_t *packet, size_t length);
+
+private:
+    // True when the packet opens a new connection on a tuple already in use
+    static bool trackTcp(FlowStats &flow, uint8_t flags, uint8_t direction, bool inserted);
+    static uint64_t idleDeadlineMs(const FlowStats &flow);
+    void expireFlows(uint64_t now_ms);
+
+    ProtocolCounterBlock counters_;
+    FlowTable<FlowStats> flows_;
+    std::atomic<size_t> flow_count_;
+    std::atomic<size_t> state_counts_[TCP_CONN_STATE_COUNT];
+    std::atomic<uint64_t> closed_retired_;
+    std::atomic<uint64_t> idle_expired_;
+    std::atomic<uint64_t> evicted_;
+    std::atomic<size_t> max_flows_;
+    std::atomic<bool> reset_requested_;
+    uint64_t clock_ns_;
+
+    // Flow clock for expiry: the capture clock as of the last maintain()
+    // that saw it move, plus monotonic time since then
+    uint64_t anchor_clock_ns_;
+    uint64_t anchor_monotonic_ms_;
+    uint64_t flow_now_ms_;
+    TimerWheel expiry_wheel_;
+    size_t state_flows_[TCP_CONN_STATE_COUNT]; // worker's counts behind state_counts_
+
+    TopTalkers talkers_;
+    TopTalkers published_talkers_;
+    mutable std::mutex talkers_mutex_;
+    uint64_t last_publish_ms_;
+
+    // The worker holds visit_mutex_ while it runs the visitor
+    const FlowVisitor *visitor_;
+    bool visit_done_;
+    std::atomic<bool> visit_requested_;
+    std::mutex visit_mutex_;
+    std::condition_variable visit_cv_;
+};
+
+#endif // FLOW_SHARD_H
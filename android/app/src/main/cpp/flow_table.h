@@ -0,0 +1,281 @@
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include "session_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash table keyed by SessionKey with the per-flow value
+// stored inline in the slot. Lookups probe linearly from the key's hash
+// and compare a 32-bit hash tag before touching the key, so hits do not
+// allocate. Erased slots become tombstones; the table is rebuilt when
+// live entries plus tombstones pass 3/4 of the capacity.
+//
+// A size limit turns the table into a cache: once full, each insertion
+// evicts an entry chosen by CLOCK, an approximate LRU. Lookups set a
+// per-slot reference bit; a hand sweeps the slots, clearing set bits and
+// evicting the first entry whose bit is already clear. New entries start
+// unreferenced, so a flood of one-packet flows (a port scan) is evicted
+// before flows that keep being used.
+//
+// Pointers returned by find()/findOrInsert() stay valid until the next
+// insertion that triggers a rebuild or an eviction.
+template <typename Value, typename Hash = SessionKeyHash>
+class FlowTable
+{
+public:
+    explicit FlowTable(size_t initial_capacity = 1024)
+        : slots_(roundUpPow2(initial_capacity)), size_(0), tombstones_(0), max_size_(0), hand_(0)
+    {
+    }
+
+    Value *find(const SessionKey &key)
+    {
+        size_t hash = Hash()(key);
+        size_t index = probe(key, hash);
+        if (slots_[index].state != FULL)
+        {
+            return nullptr;
+        }
+        slots_[index].referenced = 1;
+        return &slots_[index].value;
+    }
+
+    Value *findOrInsert(const SessionKey &key, bool &inserted)
+    {
+        return findOrInsert(key, inserted, [](const SessionKey &, Value &) {});
+    }
+
+    // As above; when the table is at its size limit, first evicts an entry,
+    // calling on_evict(const SessionKey &, Value &) just before dropping it.
+    // Amortised O(1): the hand clears each bit at most once per pass.
+    template <typename EvictFn>
+    Value *findOrInsert(const SessionKey &key, bool &inserted, EvictFn on_evict)
+    {
+        size_t hash = Hash()(key);
+        size_t index = probe(key, hash);
+        if (slots_[index].state == FULL)
+        {
+            slots_[index].referenced = 1;
+            inserted = false;
+            return &slots_[index].value;
+        }
+
+        if (max_size_ != 0 && size_ >= max_size_)
+        {
+            evictOne(on_evict);
+            index = probe(key, hash);
+        }
+
+        if ((size_ + tombstones_ + 1) * 4 > slots_.size() * 3)
+        {
+            rebuild(size_ * 2 + 2 > slots_.size() ? slots_.size() * 2 : slots_.size());
+            index = probe(key, hash);
+        }
+
+        Slot &slot = slots_[index];
+        if (slot.state == TOMBSTONE)
+        {
+            --tombstones_;
+        }
+        slot.state = FULL;
+        slot.referenced = 0;
+        slot.tag = static_cast<uint32_t>(hash);
+        slot.key = key;
+        slot.value = Value();
+        ++size_;
+        inserted = true;
+        return &slot.value;
+    }
+
+    bool erase(const SessionKey &key)
+    {
+        size_t index = probe(key, Hash()(key));
+        if (slots_[index].state != FULL)
+        {
+            return false;
+        }
+
+        slots_[index].state = TOMBSTONE;
+        slots_[index].value = Value();
+        --size_;
+        ++tombstones_;
+        return true;
+    }
+
+    // fn(const SessionKey &, Value &) returns true to erase the entry
+    template <typename Fn>
+    void eraseIf(Fn fn)
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.state == FULL && fn(slot.key, slot.value))
+            {
+                slot.state = TOMBSTONE;
+                slot.value = Value();
+                --size_;
+                ++tombstones_;
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEach(Fn fn)
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.state == FULL)
+            {
+                fn(slot.key, slot.value);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for (Slot &slot : slots_)
+        {
+            slot.state = EMPTY;
+            slot.value = Value();
+        }
+        size_ = 0;
+        tombstones_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+
+    // Most live entries before insertions evict; 0 for no limit. Lowering
+    // it below size() takes effect as entries are inserted.
+    void setMaxSize(size_t max_entries) { max_size_ = max_entries; }
+    size_t maxSize() const { return max_size_; }
+
+    // Largest size limit whose slot array, grown as the table fills, stays
+    // within `bytes`
+    static size_t maxEntriesWithin(size_t bytes)
+    {
+        size_t capacity = 16;
+        while (capacity * 2 * sizeof(Slot) <= bytes)
+        {
+            capacity <<= 1;
+        }
+        // The table doubles once live entries pass half its slots
+        return capacity / 2 - 1;
+    }
+
+private:
+    enum SlotState : uint8_t
+    {
+        EMPTY = 0,
+        FULL,
+        TOMBSTONE
+    };
+
+    struct Slot
+    {
+        uint8_t state;
+        uint8_t referenced; // CLOCK bit, set by lookups
+        uint32_t tag;
+        SessionKey key;
+        Value value;
+
+        Slot() : state(EMPTY), referenced(0), tag(0) {}
+    };
+
+    static size_t roundUpPow2(size_t value)
+    {
+        size_t capacity = 16;
+        while (capacity < value)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    // Index of the slot holding `key`, or of the slot it should be inserted
+    // into (the first tombstone on the probe path, else the empty slot).
+    size_t probe(const SessionKey &key, size_t hash) const
+    {
+        size_t mask = slots_.size() - 1;
+        size_t index = hash & mask;
+        size_t first_tombstone = slots_.size();
+        uint32_t tag = static_cast<uint32_t>(hash);
+
+        while (true)
+        {
+            const Slot &slot = slots_[index];
+            if (slot.state == EMPTY)
+            {
+                return first_tombstone != slots_.size() ? first_tombstone : index;
+            }
+            if (slot.state == FULL && slot.tag == tag && slot.key == key)
+            {
+                return index;
+            }
+            if (slot.state == TOMBSTONE && first_tombstone == slots_.size())
+            {
+                first_tombstone = index;
+            }
+            index = (index + 1) & mask;
+        }
+    }
+
+    template <typename EvictFn>
+    void evictOne(EvictFn &on_evict)
+    {
+        size_t mask = slots_.size() - 1;
+        while (true)
+        {
+            Slot &slot = slots_[hand_ & mask];
+            hand_ = (hand_ + 1) & mask;
+            if (slot.state != FULL)
+            {
+                continue;
+            }
+            if (slot.referenced)
+            {
+                slot.referenced = 0;
+                continue;
+            }
+
+            on_evict(slot.key, slot.value);
+            slot.state = TOMBSTONE;
+            slot.value = Value();
+            --size_;
+            ++tombstones_;
+            return;
+        }
+    }
+
+    void rebuild(size_t capacity)
+    {
+        std::vector<Slot> old(capacity);
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+
+        for (Slot &slot : old)
+        {
+            if (slot.state != FULL)
+            {
+                continue;
+            }
+
+            size_t index = slot.tag & mask;
+            while (slots_[index].state != EMPTY)
+            {
+                index = (index + 1) & mask;
+            }
+            slots_[index] = slot;
+        }
+        tombstones_ = 0;
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_;
+    size_t tombstones_;
+    size_t max_size_;
+    size_t hand_;
+};
+
+#endif // FLOW_TABLE_H
@@ -0,0 +1,192 @@
+#include "hex_dump.h"
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HEX_DUMP_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HEX_DUMP_SSE2 1
+#endif
+
+static const size_t DUMP_BYTES_PER_LINE = 16;
+// "00000000  " + 16 x "xx " + 1 extra gap + " |" + 16 ASCII + "|\n"
+static const size_t DUMP_LINE_LENGTH = 10 + DUMP_BYTES_PER_LINE * 3 + 1 + 2 + DUMP_BYTES_PER_LINE + 2;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Both digits of every byte value, so one lookup renders a byte
+struct HexTable
+{
+    char pairs[256][2];
+
+    HexTable()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            pairs[i][0] = HEX_DIGITS[i >> 4];
+            pairs[i][1] = HEX_DIGITS[i & 0x0F];
+        }
+    }
+};
+
+static const HexTable HEX_TABLE;
+
+void HexDump::encodeScalar(const uint8_t *data, size_t length, char *out)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        std::memcpy(out + i * 2, HEX_TABLE.pairs[data[i]], 2);
+    }
+}
+
+// `count` bytes as "xx xx xx", 3 * count - 1 chars
+void HexDump::formatSpacedScalar(const uint8_t *data, size_t count, char *out)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        std::memcpy(out + i * 3, HEX_TABLE.pairs[data[i]], 2);
+        out[i * 3 + 2] = ' ';
+    }
+    std::memcpy(out + (count - 1) * 3, HEX_TABLE.pairs[data[count - 1]], 2);
+}
+
+void HexDump::encode(const uint8_t *data, size_t length, char *out)
+{
+    size_t i = 0;
+
+#if defined(HEX_DUMP_NEON)
+    const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t *>(HEX_DIGITS));
+    const uint8x16_t low_mask = vdupq_n_u8(0x0F);
+    for (; i + 16 <= length; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(data + i);
+        uint8x16x2_t pairs;
+        pairs.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(bytes, 4));
+        pairs.val[1] = vqtbl1q_u8(digits, vandq_u8(bytes, low_mask));
+        vst2q_u8(reinterpret_cast<uint8_t *>(out + i * 2), pairs);
+    }
+#elif defined(HEX_DUMP_SSE2)
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask);
+        __m128i low = _mm_and_si128(bytes, low_mask);
+        // nibble + '0', plus the gap up to 'a' for nibbles above 9
+        high = _mm_add_epi8(_mm_add_epi8(high, zero_char), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letter_gap));
+        low = _mm_add_epi8(_mm_add_epi8(low, zero_char), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letter_gap));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 2), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 2 + 16), _mm_unpackhi_epi8(high, low));
+    }
+#endif
+
+    encodeScalar(data + i, length - i, out + i * 2);
+}
+
+size_t HexDump::spacedLength(size_t length, size_t max_bytes)
+{
+    size_t count = length < max_bytes ? length : max_bytes;
+    size_t chars = count > 0 ? count * 3 - 1 : 0;
+    return length > max_bytes ? chars + 3 : chars;
+}
+
+size_t HexDump::formatSpaced(const uint8_t *data, size_t length, size_t max_bytes,
+                             char *out, size_t capacity)
+{
+    size_t needed = spacedLength(length, max_bytes);
+    if (needed > capacity)
+    {
+        return 0;
+    }
+
+    size_t count = length < max_bytes ? length : max_bytes;
+    size_t i = 0;
+
+#if defined(HEX_DUMP_NEON)
+    // vst3q interleaves high digit, low digit and a space per byte. The last
+    // block always goes through the scalar path so no trailing space is
+    // written past the end.
+    const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t *>(HEX_DIGITS));
+    const uint8x16_t low_mask = vdupq_n_u8(0x0F);
+    uint8x16x3_t triples;
+    triples.val[2] = vdupq_n_u8(' ');
+    for (; i + 16 < count; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(data + i);
+        triples.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(bytes, 4));
+        triples.val[1] = vqtbl1q_u8(digits, vandq_u8(bytes, low_mask));
+        vst3q_u8(reinterpret_cast<uint8_t *>(out + i * 3), triples);
+    }
+#endif
+
+    formatSpacedScalar(data + i, count - i, out + i * 3);
+
+    if (length > max_bytes)
+    {
+        std::memcpy(out + needed - 3, "...", 3);
+    }
+    return needed;
+}
+
+size_t HexDump::dumpLength(size_t length)
+{
+    return (length + DUMP_BYTES_PER_LINE - 1) / DUMP_BYTES_PER_LINE * DUMP_LINE_LENGTH;
+}
+
+size_t HexDump::formatDump(const uint8_t *data, size_t length, char *out, size_t capacity)
+{
+    size_t needed = dumpLength(length);
+    if (needed > capacity)
+    {
+        return 0;
+    }
+
+    char *line = out;
+    for (size_t offset = 0; offset < length; offset += DUMP_BYTES_PER_LINE)
+    {
+        size_t count = length - offset < DUMP_BYTES_PER_LINE ? length - offset : DUMP_BYTES_PER_LINE;
+        const uint8_t *bytes = data + offset;
+
+        std::memset(line, ' ', DUMP_LINE_LENGTH);
+
+        uint32_t position = static_cast<uint32_t>(offset);
+        for (int shift = 28, column = 0; shift >= 0; shift -= 4, column++)
+        {
+            line[column] = HEX_DIGITS[(position >> shift) & 0x0F];
+        }
+
+        char *hex = line + 10;
+        for (size_t i = 0; i < count; i++)
+        {
+            // Extra gap between the two groups of eight
+            std::memcpy(hex + i * 3 + (i >= 8 ? 1 : 0), HEX_TABLE.pairs[bytes[i]], 2);
+        }
+
+        char *ascii = line + 10 + DUMP_BYTES_PER_LINE * 3 + 1 + 1;
+        ascii[0] = '|';
+        for (size_t i = 0; i < count; i++)
+        {
+            ascii[1 + i] = (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? static_cast<char>(bytes[i]) : '.';
+        }
+        // Short last line: close the ASCII column right after its bytes
+        ascii[1 + count] = '|';
+        ascii[2 + count] = '\n';
+        if (count < DUMP_BYTES_PER_LINE)
+        {
+            return static_cast<size_t>(ascii + 3 + count - out);
+        }
+
+        line += DUMP_LINE_LENGTH;
+    }
+
+    return static_cast<size_t>(line - out);
+}
@@ -0,0 +1,36 @@
+#ifndef HEX_DUMP_H
+#define HEX_DUMP_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Payload rendering. Everything writes into a caller-supplied buffer and
+// nothing allocates, so a packet's payload slice only costs anything when
+// somebody actually looks at it. Full 16-byte blocks go through a NEON
+// (AArch64) or SSE2 nibble-to-ASCII kernel; tails and other targets use a
+// 256-entry lookup table. Output is lowercase and not NUL-terminated.
+class HexDump
+{
+public:
+    // Two hex digits per byte, no separators; `out` needs 2 * length bytes
+    static void encode(const uint8_t *data, size_t length, char *out);
+
+    // "de ad be ef..." as shown in the packet list: at most `max_bytes`
+    // bytes, space separated, "..." appended when truncated. Returns the
+    // number of chars written, or 0 if `capacity` is too small.
+    static size_t formatSpaced(const uint8_t *data, size_t length, size_t max_bytes,
+                               char *out, size_t capacity);
+    static size_t spacedLength(size_t length, size_t max_bytes);
+
+    // hexdump -C style: offset, 16 hex columns split 8/8, printable ASCII.
+    // Returns the number of chars written, or 0 if `capacity` is too small.
+    static size_t formatDump(const uint8_t *data, size_t length, char *out, size_t capacity);
+    // Upper bound on formatDump()'s output for `length` bytes
+    static size_t dumpLength(size_t length);
+
+    // Table-only variants, kept for the tails and as the benchmark baseline
+    static void encodeScalar(const uint8_t *data, size_t length, char *out);
+    static void formatSpacedScalar(const uint8_t *data, size_t count, char *out);
+};
+
+#endif // HEX_DUMP_H
@@ -0,0 +1,99 @@
+#include "link_layer.h"
+#include <pcap/sll.h>
+#include <pcap/vlan.h>
+
+static const uint16_t ETHERTYPE_IPV4 = 0x0800;
+static const uint16_t ETHERTYPE_IPV6 = 0x86DD;
+static const uint16_t ETHERTYPE_8021Q = 0x8100;
+static const uint16_t ETHERTYPE_8021AD = 0x88A8;
+static const uint16_t ETHERTYPE_QINQ_OLD = 0x9100;
+
+static const uint16_t ETHER_HEADER_LENGTH = 14;
+static const uint16_t ETHER_TYPE_OFFSET = 12;
+static const uint16_t SLL_PROTOCOL_OFFSET = 14;
+static const uint16_t SLL2_PROTOCOL_OFFSET = 0;
+// DLT_NULL/DLT_LOOP carry a 4-byte address family; the IP version nibble is checked by the parser
+static const uint16_t NULL_HEADER_LENGTH = 4;
+static const uint16_t MIN_IP_HEADER_LENGTH = 20;
+
+static inline uint16_t readBe16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t isVlanTpid(uint16_t type)
+{
+    return static_cast<uint32_t>(type == ETHERTYPE_8021Q) |
+           static_cast<uint32_t>(type == ETHERTYPE_8021AD) |
+           static_cast<uint32_t>(type == ETHERTYPE_QINQ_OLD);
+}
+
+LinkDecoder::LinkDecoder(int linktype)
+    : linktype_(linktype), supported_(true), header_length_(0), ethertype_offset_(-1)
+{
+    switch (linktype)
+    {
+    case DLT_EN10MB:
+        header_length_ = ETHER_HEADER_LENGTH;
+        ethertype_offset_ = ETHER_TYPE_OFFSET;
+        break;
+    case DLT_LINUX_SLL:
+        header_length_ = SLL_HDR_LEN;
+        ethertype_offset_ = SLL_PROTOCOL_OFFSET;
+        break;
+    case DLT_LINUX_SLL2:
+        header_length_ = SLL2_HDR_LEN;
+        ethertype_offset_ = SLL2_PROTOCOL_OFFSET;
+        break;
+    case DLT_RAW:
+    case DLT_IPV4:
+    case DLT_IPV6:
+        break;
+    case DLT_NULL:
+    case DLT_LOOP:
+        header_length_ = NULL_HEADER_LENGTH;
+        break;
+    default:
+        supported_ = false;
+        break;
+    }
+}
+
+const char *LinkDecoder::name() const
+{
+    const char *dlt_name = pcap_datalink_val_to_name(linktype_);
+    return dlt_name ? dlt_name : "unknown";
+}
+
+int LinkDecoder::networkOffset(const uint8_t *frame, uint32_t caplen) const
+{
+    // Anything shorter cannot hold an IP header; it also keeps the two
+    // VLAN lookahead reads below inside the frame
+    if (!supported_ || caplen < static_cast<uint32_t>(header_length_) + MIN_IP_HEADER_LENGTH)
+    {
+        return -1;
+    }
+
+    if (ethertype_offset_ < 0)
+    {
+        return header_length_;
+    }
+
+    uint32_t offset = header_length_;
+    uint16_t type = readBe16(frame + ethertype_offset_);
+
+    // A tag is TCI(2) + inner type(2) at the current L3 offset; each one
+    // present moves L3 along by VLAN_TAG_LEN. Selects, not branches.
+    uint32_t tagged = isVlanTpid(type);
+    uint16_t inner = readBe16(frame + offset + 2);
+    type = tagged ? inner : type;
+    offset += tagged * VLAN_TAG_LEN;
+
+    tagged = isVlanTpid(type);
+    inner = readBe16(frame + offset + 2);
+    type = tagged ? inner : type;
+    offset += tagged * VLAN_TAG_LEN;
+
+    bool is_ip = (type == ETHERTYPE_IPV4) | (type == ETHERTYPE_IPV6);
+    return is_ip ? static_cast<int>(offset) : -1;
+}
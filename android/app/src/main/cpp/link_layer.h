@@ -0,0 +1,35 @@
+#ifndef LINK_LAYER_H
+#define LINK_LAYER_H
+
+#include <pcap/pcap.h>
+#include <cstdint>
+
+// Finds the IP header inside frames of one pcap link type. The link type
+// is fixed for the life of a handle, so the layout is resolved once when
+// capture opens. Per frame, the offset to L3 is then computed arithmetically
+// from the EtherType field, stepping over up to two VLAN tags (802.1Q,
+// 802.1ad QinQ) without branching on the tag type.
+//
+// Supported: DLT_EN10MB, DLT_LINUX_SLL, DLT_LINUX_SLL2, DLT_RAW,
+// DLT_IPV4, DLT_IPV6, DLT_NULL and DLT_LOOP.
+class LinkDecoder
+{
+public:
+    explicit LinkDecoder(int linktype);
+
+    bool supported() const { return supported_; }
+    int linktype() const { return linktype_; }
+    const char *name() const;
+
+    // Offset of the IPv4/IPv6 header in `frame`, or -1 if the frame does
+    // not carry IP or is too short to hold an IP header
+    int networkOffset(const uint8_t *frame, uint32_t caplen) const;
+
+private:
+    int linktype_;
+    bool supported_;
+    uint16_t header_length_;  // fixed link header in front of L3 (or the first VLAN tag)
+    int16_t ethertype_offset_; // position of the protocol field, -1 when there is none
+};
+
+#endif // LINK_LAYER_H
@@ -1,35 +1,71 @@
 #include <jni.h>
 #include <string>
-#include <android/log.h>
 #include <unistd.h>
 #include <pcap/pcap.h>
 #include <thread>
+#include <chrono>
 #include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #include "packet_parser.h"
+#include "capture_clock.h"
+#include "capture_pipeline.h"
+#include "packet_batcher.h"
+#include "capture_filter.h"
+#include "pcap_capture.h"
+#include "pcapng_writer.h"
+#include "link_layer.h"
 #include "session_manager.h"
 #include "socket_forwarder.h"
+#include "tun_stack.h"
 
 #define TAG "PacketAnalyzer"
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+#include "native_log.h"
+
+// Upper bound on packets drained from the TUN fd per poll() wakeup
+static const int VPN_READ_BATCH = 256;
+// Pause before retrying while every pooled buffer is in flight
+static const int POOL_RETRY_US = 200;
+
+// Packets are handed to Kotlin once this many are queued or the oldest has waited this long
+static const size_t PACKET_BATCH_RECORDS = 256;
+static const uint64_t PACKET_BATCH_DELAY_MS = 100;
+
+// Most records one getPackets call returns
+static const size_t MAX_HISTORY_PAGE = 1024;
+
+// How often the VPN loop advances the session expiry wheel
+static const int SESSION_EXPIRY_TICK_MS = 1000;
 
 // Global JNI references - CRITICAL FOR FIXING ClassNotFoundException
 static JavaVM *g_javaVM = nullptr;
 static jclass g_nativeInterfaceClass = nullptr;
-static jmethodID g_sendPacketMethod = nullptr;
+static jmethodID g_sendPacketBatchMethod = nullptr;
 static jmethodID g_sendStatsMethod = nullptr;
 static jmethodID g_sendStatusMethod = nullptr;
+static jmethodID g_protectSocketMethod = nullptr;
+static jobject g_batchBuffer = nullptr; // DirectByteBuffer over g_batcher's records
 
-// Forward declarations
-void sendPacketToJava(const PacketInfo &packet);
+// Records waiting to be delivered to Kotlin; only touched by the pipeline's UI sink
+static PacketBatcher g_batcher(PACKET_BATCH_RECORDS, PACKET_BATCH_DELAY_MS);
+static CapturePipeline g_pipeline(g_batcher);
 
 // Global variables
 static std::atomic<bool> g_capture_running{false};
 static std::thread g_capture_thread;
 static int g_tun_fd = -1;
-static pcap_t *g_pcap_handle = nullptr;
+static int g_wake_fd = -1;
+static PcapCapture g_pcap_capture;
+// Applied the next time rooted capture starts; only touched on the JNI caller's thread
+static CaptureTunables g_capture_tunables;
+// Active pcapng recording, if any; only touched on the JNI caller's thread
+static std::shared_ptr<PcapngWriter> g_recorder;
 
 // JNI_OnLoad - Called when library is loaded - FIXES ClassNotFoundException
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
@@ -58,8 +94,8 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
     env->DeleteLocalRef(localRef);
 
     // Cache method IDs
-    g_sendPacketMethod = env->GetStaticMethodID(g_nativeInterfaceClass, "sendPacketToFlutter",
-                                                "(Ljava/lang/String;Ljava/lang/String;IILjava/lang/String;ILjava/lang/String;Ljava/lang/String;)V");
+    g_sendPacketBatchMethod = env->GetStaticMethodID(g_nativeInterfaceClass, "sendPacketBatchToFlutter",
+                                                     "(Ljava/nio/ByteBuffer;I)V");
 
     g_sendStatsMethod = env->GetStaticMethodID(g_nativeInterfaceClass, "sendStatsToFlutter",
                                                "(Ljava/lang/String;)V");
@@ -67,12 +103,25 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
     g_sendStatusMethod = env->GetStaticMethodID(g_nativeInterfaceClass, "sendStatusUpdate",
                                                 "(ZLjava/lang/String;)V");
 
-    if (g_sendPacketMethod == nullptr || g_sendStatsMethod == nullptr || g_sendStatusMethod == nullptr)
+    g_protectSocketMethod = env->GetStaticMethodID(g_nativeInterfaceClass, "protectSocket", "(I)Z");
+
+    if (g_sendPacketBatchMethod == nullptr || g_sendStatsMethod == nullptr || g_sendStatusMethod == nullptr ||
+        g_protectSocketMethod == nullptr)
     {
         LOGE("JNI_OnLoad: Failed to find one or more method IDs");
         return JNI_ERR;
     }
 
+    // The batch storage never moves, so one ByteBuffer view of it is reused for every flush
+    jobject buffer = env->NewDirectByteBuffer(g_batcher.data(), g_batcher.capacityBytes());
+    if (buffer == nullptr)
+    {
+        LOGE("JNI_OnLoad: Failed to create packet batch buffer");
+        return JNI_ERR;
+    }
+    g_batchBuffer = env->NewGlobalRef(buffer);
+    env->DeleteLocalRef(buffer);
+
     LOGD("JNI_OnLoad: Native library loaded successfully");
     return JNI_VERSION_1_6;
 }
@@ -88,189 +137,350 @@ JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *reserved)
             env->DeleteGlobalRef(g_nativeInterfaceClass);
             g_nativeInterfaceClass = nullptr;
         }
+        if (g_batchBuffer != nullptr)
+        {
+            env->DeleteGlobalRef(g_batchBuffer);
+            g_batchBuffer = nullptr;
+        }
     }
     LOGD("JNI_OnUnload: Native library unloaded");
 }
 
-// VPN packet processing function
+// Attaches the calling thread to the JVM once for its whole lifetime
+class ScopedJniAttach
+{
+public:
+    ScopedJniAttach() : env_(nullptr), attached_(false)
+    {
+        if (!g_javaVM)
+        {
+            return;
+        }
+
+        int getEnvStat = g_javaVM->GetEnv(reinterpret_cast<void **>(&env_), JNI_VERSION_1_6);
+        if (getEnvStat == JNI_EDETACHED)
+        {
+            if (g_javaVM->AttachCurrentThread(&env_, nullptr) == 0)
+            {
+                attached_ = true;
+            }
+            else
+            {
+                LOGE("Failed to attach native thread to the JVM");
+                env_ = nullptr;
+            }
+        }
+        else if (getEnvStat != JNI_OK)
+        {
+            LOGE("Unsupported JNI version");
+            env_ = nullptr;
+        }
+    }
+
+    ~ScopedJniAttach()
+    {
+        if (attached_)
+        {
+            g_javaVM->DetachCurrentThread();
+        }
+    }
+
+    JNIEnv *env() const { return env_; }
+
+private:
+    JNIEnv *env_;
+    bool attached_;
+};
+
+// Pipeline threads call into Java from their own threads; each attaches on
+// first use and detaches when it exits
+static JNIEnv *currentJniEnv()
+{
+    static thread_local ScopedJniAttach jni;
+    return jni.env();
+}
+
+// Hand every queued record to Kotlin in a single call; runs on the UI sink thread
+static void flushPacketBatch(const PacketBatcher &batcher)
+{
+    JNIEnv *env = currentJniEnv();
+    if (env && g_nativeInterfaceClass && g_sendPacketBatchMethod && g_batchBuffer)
+    {
+        env->CallStaticVoidMethod(g_nativeInterfaceClass, g_sendPacketBatchMethod,
+                                  g_batchBuffer, (jint)batcher.count());
+
+        if (env->ExceptionCheck())
+        {
+            LOGE("flushPacketBatch: Exception occurred");
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+    }
+}
+
+// Terminate the connection locally and relay it through a protected socket;
+// runs on the forward sink thread
+static void forwardVpnPacket(const PacketView &view)
+{
+    TunStack::getInstance().handleOutbound(view);
+}
+
+// Wake the capture thread out of poll() so it notices shutdown immediately
+static void wakeCaptureThread()
+{
+    if (g_wake_fd != -1)
+    {
+        uint64_t one = 1;
+        ssize_t written = write(g_wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// VPN packet processing function. Only reads: each packet goes straight into
+// a pooled buffer that the forward sink and the parse worker share.
 void processVpnPackets()
 {
-    uint8_t buffer[4096];
+    PacketPool &pool = g_pipeline.pool();
 
     LOGD("Starting VPN packet processing thread");
 
-    while (g_capture_running && g_tun_fd != -1)
+    // The fd must be non-blocking so a batch can be drained until EAGAIN
+    int flags = fcntl(g_tun_fd, F_GETFL, 0);
+    if (flags != -1)
     {
-        ssize_t length = read(g_tun_fd, buffer, sizeof(buffer));
+        fcntl(g_tun_fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = g_tun_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = g_wake_fd;
+    fds[1].events = POLLIN;
 
-        if (length > 0)
+    SessionManager &session_mgr = SessionManager::getInstance();
+    uint64_t last_expiry_ms = CaptureClock::monotonicMs();
+
+    bool tun_ok = true;
+    while (g_capture_running && tun_ok)
+    {
+        // Sleep until traffic arrives, shutdown is requested or the session wheel needs to tick
+        int ready = poll(fds, 2, SESSION_EXPIRY_TICK_MS);
+        if (ready < 0)
         {
-            PacketInfo packet = PacketParser::parsePacket(buffer, length);
+            if (errno == EINTR)
+                continue;
+            LOGE("poll on TUN failed: %d", errno);
+            break;
+        }
 
-            if (!packet.protocol.empty())
-            {
-                // Update statistics
-                SessionManager::getInstance().updateProtocolStats(packet.protocol, packet.size);
+        uint64_t now_ms = CaptureClock::monotonicMs();
+        if (now_ms - last_expiry_ms >= SESSION_EXPIRY_TICK_MS)
+        {
+            session_mgr.expireSessions(now_ms);
+            last_expiry_ms = now_ms;
+        }
 
-                // Send to Java/Flutter
-                sendPacketToJava(packet);
+        if (ready == 0)
+        {
+            continue;
+        }
 
-                // Forward packet through socket
-                SessionKey key{packet.source_ip, packet.source_port,
-                               packet.dest_ip, packet.dest_port, packet.protocol};
-                SocketForwarder::getInstance().forwardPacket(key, buffer, length);
-            }
+        if (fds[1].revents & POLLIN)
+        {
+            break;
         }
-        else if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
         {
-            LOGE("Error reading from TUN: %d", errno);
+            LOGE("TUN interface closed (revents 0x%x)", fds[0].revents);
             break;
         }
 
-        // Small delay to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // TUN reads carry no kernel timestamp; one clock read stamps the whole drain
+        uint64_t capture_ns = CaptureClock::realtimeNs();
+
+        // Drain what the kernel has queued; the cap keeps the wake fd responsive under a flood
+        for (int i = 0; i < VPN_READ_BATCH; i++)
+        {
+            PacketBuffer *buffer = pool.acquire(PacketPool::BUFFER_SIZE);
+            if (!buffer)
+            {
+                // Every buffer is in flight. Packets wait in the TUN queue until
+                // one comes back, so each is still relayed in order by the
+                // forward sink; the kernel drops only once that queue fills.
+                std::this_thread::sleep_for(std::chrono::microseconds(POOL_RETRY_US));
+                break;
+            }
+
+            ssize_t length = read(g_tun_fd, buffer->data, buffer->capacity);
+            if (length > 0)
+            {
+                buffer->timestamp_ns = capture_ns;
+                buffer->length = static_cast<uint32_t>(length);
+                buffer->wire_length = static_cast<uint32_t>(length);
+                g_pipeline.submit(buffer);
+                continue;
+            }
+
+            pool.release(buffer);
+
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                {
+                    LOGE("Error reading from TUN: %d", length == 0 ? 0 : errno);
+                    tun_ok = false;
+                }
+                break;
+            }
+        }
     }
 
     LOGD("VPN packet processing thread stopped");
 }
 
-// Pcap packet handler for rooted capture
+// Pcap packet handler for rooted capture; user_data is the handle's LinkDecoder
 void packet_handler(u_char *user_data, const struct pcap_pkthdr *header, const u_char *packet)
 {
     if (!g_capture_running)
         return;
 
-    PacketInfo parsed_packet = PacketParser::parsePacket(packet, header->len);
+    const LinkDecoder *decoder = reinterpret_cast<const LinkDecoder *>(user_data);
 
-    if (!parsed_packet.protocol.empty())
+    // Skip the link-layer header (Ethernet, SLL, VLAN tags) to reach IP
+    int offset = decoder->networkOffset(packet, header->caplen);
+    if (offset < 0)
     {
-        SessionManager::getInstance().updateProtocolStats(parsed_packet.protocol, parsed_packet.size);
-        sendPacketToJava(parsed_packet);
+        return;
     }
+
+    // libpcap reuses its ring block after the callback, so this is the one copy
+    size_t length = std::min<size_t>(header->caplen - offset, PacketPool::JUMBO_BUFFER_SIZE);
+    PacketBuffer *buffer = g_pipeline.pool().acquire(length);
+    if (!buffer)
+    {
+        return;
+    }
+
+    buffer->timestamp_ns = g_pcap_capture.timestampNs(header);
+    buffer->length = static_cast<uint32_t>(length);
+    buffer->wire_length = header->len - offset;
+    std::memcpy(buffer->data, packet + offset, length);
+    g_pipeline.submit(buffer);
 }
 
 // Rooted capture using libpcap
-void processRootedCapture()
+void processRootedCapture(CaptureTunables tunables)
 {
-    char errbuf[PCAP_ERRBUF_SIZE];
-
     LOGD("Attempting to open pcap interface");
 
     // Try different interface names for Android
     const char *interfaces[] = {"any", "wlan0", "eth0", "rmnet0", "rmnet_data0"};
     int interface_count = sizeof(interfaces) / sizeof(interfaces[0]);
 
-    for (int i = 0; i < interface_count && !g_pcap_handle; i++)
-    {
-        g_pcap_handle = pcap_open_live(interfaces[i], 65536, 1, 1000, errbuf);
-        if (g_pcap_handle)
-        {
-            LOGD("Successfully opened pcap on interface: %s", interfaces[i]);
-            break;
-        }
-        else
-        {
-            LOGD("Failed to open interface %s: %s", interfaces[i], errbuf);
-        }
-    }
-
-    if (!g_pcap_handle)
+    if (!g_pcap_capture.open(interfaces, interface_count, tunables))
     {
         LOGE("Failed to open any pcap interface");
         return;
     }
 
-    LOGD("Started rooted packet capture");
-
-    // Start packet capture loop
-    int result = pcap_loop(g_pcap_handle, -1, packet_handler, nullptr);
-    if (result < 0)
-    {
-        LOGE("pcap_loop failed: %s", pcap_geterr(g_pcap_handle));
-    }
-
-    LOGD("Rooted packet capture stopped");
-}
-
-// Helper function to send packet data to Java/Flutter - COMPLETELY REWRITTEN FOR THREAD SAFETY
-void sendPacketToJava(const PacketInfo &packet)
-{
-    if (!g_javaVM || !g_nativeInterfaceClass || !g_sendPacketMethod)
+    // The link type is fixed per handle, so the frame layout is resolved once here
+    LinkDecoder decoder(g_pcap_capture.datalink());
+    if (!decoder.supported())
     {
-        LOGE("sendPacketToJava: JNI not properly initialized");
+        LOGE("Unsupported link type %d (%s) on %s", decoder.linktype(), decoder.name(),
+             g_pcap_capture.device().c_str());
+        // Nothing will read it, so the kernel ring is given back now rather than at stop
+        g_pcap_capture.close();
         return;
     }
 
-    JNIEnv *env;
-    bool needDetach = false;
+    LOGD("Started rooted packet capture on %s, link type %s", g_pcap_capture.device().c_str(), decoder.name());
 
-    // Get JNI environment for current thread
-    int getEnvStat = g_javaVM->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6);
-    if (getEnvStat == JNI_EDETACHED)
+    // Each wakeup hands over whole ring blocks, copied straight into ingress slots
+    while (g_capture_running)
     {
-        // Thread not attached, attach it
-        if (g_javaVM->AttachCurrentThread(&env, nullptr) != 0)
+        int result = g_pcap_capture.dispatch(packet_handler, reinterpret_cast<u_char *>(&decoder));
+        if (result == PCAP_ERROR_BREAK)
         {
-            LOGE("sendPacketToJava: Failed to attach current thread");
-            return;
+            break;
+        }
+        if (result < 0)
+        {
+            LOGE("pcap_dispatch failed: %s", g_pcap_capture.lastError());
+            break;
         }
-        needDetach = true;
     }
-    else if (getEnvStat == JNI_EVERSION)
+
+    uint64_t received = 0;
+    uint64_t dropped = 0;
+    if (g_pcap_capture.stats(received, dropped))
     {
-        LOGE("sendPacketToJava: Unsupported JNI version");
-        return;
+        LOGD("Rooted packet capture stopped: %llu received, %llu dropped",
+             static_cast<unsigned long long>(received), static_cast<unsigned long long>(dropped));
     }
+    else
+    {
+        LOGD("Rooted packet capture stopped");
+    }
+}
 
-    // Create Java strings
-    jstring sourceIp = env->NewStringUTF(packet.source_ip.c_str());
-    jstring destIp = env->NewStringUTF(packet.dest_ip.c_str());
-    jstring protocol = env->NewStringUTF(packet.protocol.c_str());
-    jstring timestamp = env->NewStringUTF(PacketParser::getCurrentTimestamp().c_str());
-    jstring payload = env->NewStringUTF(packet.payload.c_str());
-
-    // Call the cached method using global class reference
-    env->CallStaticVoidMethod(g_nativeInterfaceClass, g_sendPacketMethod,
-                              sourceIp, destIp,
-                              (jint)packet.source_port, (jint)packet.dest_port,
-                              protocol, (jint)packet.size, timestamp, payload);
-
-    // Clean up local references
-    env->DeleteLocalRef(sourceIp);
-    env->DeleteLocalRef(destIp);
-    env->DeleteLocalRef(protocol);
-    env->DeleteLocalRef(timestamp);
-    env->DeleteLocalRef(payload);
-
-    // Check for exceptions
-    if (env->ExceptionCheck())
+// Exempt a forwarding socket from the VPN so its traffic does not loop back
+// into the TUN interface. Called on the forward sink thread.
+static bool protectSocket(int socket_fd)
+{
+    JNIEnv *env = currentJniEnv();
+    if (env == nullptr)
     {
-        LOGE("sendPacketToJava: Exception occurred");
-        env->ExceptionDescribe();
-        env->ExceptionClear();
+        return false;
     }
 
-    // Detach thread if we attached it
-    if (needDetach)
+    jboolean ok = env->CallStaticBooleanMethod(g_nativeInterfaceClass, g_protectSocketMethod, socket_fd);
+    if (env->ExceptionCheck())
     {
-        g_javaVM->DetachCurrentThread();
+        env->ExceptionClear();
+        return false;
     }
+    return ok == JNI_TRUE;
 }
 
 // JNI function implementations
 extern "C" JNIEXPORT jboolean JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_initializeVpnCapture(JNIEnv *env, jobject thiz, jint fd)
+Java_com_example_packet_1analyzer_NativeInterface_nativeInitializeVpnCapture(JNIEnv *env, jobject thiz, jint fd)
 {
     g_tun_fd = fd;
+    TunStack::getInstance().setOutputFd(fd);
+    SocketForwarder::getInstance().setSocketProtector(protectSocket);
     LOGD("VPN capture initialized with FD: %d", fd);
     return JNI_TRUE;
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_processPacket(JNIEnv *env, jobject thiz, jbyteArray packet_array, jint length)
+Java_com_example_packet_1analyzer_NativeInterface_nativeProcessPacket(JNIEnv *env, jobject thiz, jbyteArray packet_array, jint length)
 {
     if (!g_capture_running)
     {
+        if (g_tun_fd == -1)
+        {
+            LOGE("VPN capture not initialized");
+            return JNI_FALSE;
+        }
+
+        if (g_wake_fd == -1)
+        {
+            g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (g_wake_fd == -1)
+            {
+                LOGE("Failed to create wake eventfd: %d", errno);
+                return JNI_FALSE;
+            }
+        }
+
+        g_pipeline.start(flushPacketBatch, forwardVpnPacket, true);
         g_capture_running = true;
         g_capture_thread = std::thread(processVpnPackets);
         LOGD("Started VPN packet processing");
@@ -279,7 +489,7 @@ Java_com_example_packet_1analyzer_NativeInterface_processPacket(JNIEnv *env, job
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_startRootedCapture(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeStartRootedCapture(JNIEnv *env, jobject thiz)
 {
     if (g_capture_running)
     {
@@ -288,84 +498,230 @@ Java_com_example_packet_1analyzer_NativeInterface_startRootedCapture(JNIEnv *env
     }
 
     LOGD("Starting rooted capture");
+    g_pipeline.start(flushPacketBatch, CapturePipeline::ForwardFn(), false);
     g_capture_running = true;
-    g_capture_thread = std::thread(processRootedCapture);
+    g_capture_thread = std::thread(processRootedCapture, g_capture_tunables);
 
     return JNI_TRUE;
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_stopRootedCapture(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeStopRootedCapture(JNIEnv *env, jobject thiz)
 {
     LOGD("Stopping rooted capture");
     g_capture_running = false;
+    g_pcap_capture.breakLoop();
 
-    if (g_pcap_handle)
-    {
-        pcap_breakloop(g_pcap_handle);
-        pcap_close(g_pcap_handle);
-        g_pcap_handle = nullptr;
-    }
-
+    // The capture thread owns the handle until it has left pcap_dispatch()
     if (g_capture_thread.joinable())
     {
         g_capture_thread.join();
     }
 
+    g_pipeline.stop();
+    g_pcap_capture.close();
+
     return JNI_TRUE;
 }
 
 extern "C" JNIEXPORT void JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_cleanup(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeSetCaptureTunables(JNIEnv *env, jobject thiz, jint buffer_size_bytes,
+                                                                           jint timeout_ms, jint snaplen, jboolean immediate_mode)
+{
+    CaptureTunables tunables;
+    tunables.buffer_size_bytes = buffer_size_bytes;
+    tunables.timeout_ms = timeout_ms;
+    tunables.snaplen = snaplen;
+    tunables.immediate_mode = immediate_mode == JNI_TRUE;
+    tunables.sanitize();
+
+    g_capture_tunables = tunables;
+    LOGD("Capture tunables: ring %d bytes, block timeout %d ms, snaplen %d, immediate %d",
+         tunables.buffer_size_bytes, tunables.timeout_ms, tunables.snaplen, tunables.immediate_mode);
+}
+
+// Flow table bounds: max_flows and memory_bytes apply to the analysis flow
+// tables from the next capture start, max_sessions and memory_bytes to the
+// VPN session table at once. Past a bound, new flows evict old ones.
+// max_flows or max_sessions <= 0 keeps that table's default count, and
+// memory_bytes <= 0 leaves the tables bounded by count alone; it never means
+// a zero budget, which would shrink every table to a handful of entries.
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeSetFlowLimits(JNIEnv *env, jobject thiz, jint max_flows,
+                                                                      jint max_sessions, jlong memory_bytes)
+{
+    size_t flows = max_flows > 0 ? static_cast<size_t>(max_flows) : 0;
+    size_t sessions = max_sessions > 0 ? static_cast<size_t>(max_sessions) : 0;
+    size_t memory = memory_bytes > 0 ? static_cast<size_t>(memory_bytes) : 0;
+
+    g_pipeline.setFlowLimits(flows, memory);
+    SessionManager::getInstance().setLimits(sessions, memory);
+    LOGD("Flow limits: %zu flows, %zu sessions, %zu bytes per table (0 for the default)", flows, sessions,
+         memory);
+}
+
+// Idle timeouts of the VPN session table, applied at once. A value <= 0
+// leaves that timeout at its default.
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeSetSessionTimeouts(JNIEnv *env, jobject thiz, jlong udp_ms,
+                                                                           jlong tcp_ms, jlong tcp_half_closed_ms,
+                                                                           jlong other_ms)
+{
+    SessionTimeouts timeouts;
+    if (udp_ms > 0)
+        timeouts.udp_ms = static_cast<uint64_t>(udp_ms);
+    if (tcp_ms > 0)
+        timeouts.tcp_established_ms = static_cast<uint64_t>(tcp_ms);
+    if (tcp_half_closed_ms > 0)
+        timeouts.tcp_half_closed_ms = static_cast<uint64_t>(tcp_half_closed_ms);
+    if (other_ms > 0)
+        timeouts.other_ms = static_cast<uint64_t>(other_ms);
+
+    SessionManager::getInstance().setTimeouts(timeouts);
+    LOGD("Session timeouts: udp %llu ms, tcp %llu ms, tcp half-closed %llu ms, other %llu ms",
+         static_cast<unsigned long long>(timeouts.udp_ms),
+         static_cast<unsigned long long>(timeouts.tcp_established_ms),
+         static_cast<unsigned long long>(timeouts.tcp_half_closed_ms),
+         static_cast<unsigned long long>(timeouts.other_ms));
+}
+
+// Returns null on success, otherwise the compiler's error message
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeSetCaptureFilter(JNIEnv *env, jobject thiz, jstring expression)
+{
+    const char *expression_str = env->GetStringUTFChars(expression, nullptr);
+    std::string filter_expression(expression_str);
+    env->ReleaseStringUTFChars(expression, expression_str);
+
+    std::string error;
+    std::shared_ptr<CaptureFilter> tun_filter;
+    if (!filter_expression.empty())
+    {
+        tun_filter = std::make_shared<CaptureFilter>();
+        if (!tun_filter->compile(filter_expression, DLT_RAW, 65535, error))
+        {
+            LOGE("Invalid capture filter '%s': %s", filter_expression.c_str(), error.c_str());
+            return env->NewStringUTF(error.c_str());
+        }
+    }
+
+    if (!g_pcap_capture.setFilter(filter_expression, error))
+    {
+        LOGE("Invalid capture filter '%s': %s", filter_expression.c_str(), error.c_str());
+        return env->NewStringUTF(error.c_str());
+    }
+
+    g_pipeline.setFilter(tun_filter);
+    return nullptr;
+}
+
+static void stopRecording()
+{
+    if (g_recorder)
+    {
+        g_pipeline.setRecorder(nullptr);
+        g_recorder->close();
+        g_recorder.reset();
+    }
+}
+
+// Records every captured packet to <path_prefix>_00001.pcapng and onwards,
+// rotating by size and/or time (0 = unlimited) and keeping only the newest
+// ring_files files when non-zero. Returns null on success, otherwise the error.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeStartRecording(JNIEnv *env, jobject thiz, jstring path_prefix,
+                                                                       jlong max_file_bytes, jint max_file_seconds,
+                                                                       jint ring_files)
+{
+    const char *path_str = env->GetStringUTFChars(path_prefix, nullptr);
+    PcapngOptions options;
+    options.path_prefix = path_str;
+    env->ReleaseStringUTFChars(path_prefix, path_str);
+    options.max_file_bytes = max_file_bytes > 0 ? static_cast<uint64_t>(max_file_bytes) : 0;
+    options.max_file_seconds = max_file_seconds > 0 ? static_cast<uint32_t>(max_file_seconds) : 0;
+    options.ring_files = ring_files > 0 ? static_cast<uint32_t>(ring_files) : 0;
+
+    stopRecording();
+
+    std::string error;
+    std::shared_ptr<PcapngWriter> recorder = std::make_shared<PcapngWriter>();
+    if (!recorder->open(options, error))
+    {
+        LOGE("Failed to start recording: %s", error.c_str());
+        return env->NewStringUTF(error.c_str());
+    }
+
+    g_recorder = recorder;
+    g_pipeline.setRecorder(recorder);
+    LOGD("Recording to %s_*.pcapng", options.path_prefix.c_str());
+    return nullptr;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeStopRecording(JNIEnv *env, jobject thiz)
+{
+    LOGD("Stopping recording");
+    stopRecording();
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeCleanup(JNIEnv *env, jobject thiz)
 {
     LOGD("Cleaning up native resources");
     g_capture_running = false;
+    wakeCaptureThread();
 
     if (g_capture_thread.joinable())
     {
         g_capture_thread.join();
     }
+    g_pipeline.stop();
+    stopRecording();
 
-    if (g_pcap_handle)
+    if (g_wake_fd != -1)
     {
-        pcap_close(g_pcap_handle);
-        g_pcap_handle = nullptr;
+        close(g_wake_fd);
+        g_wake_fd = -1;
     }
 
+    g_pcap_capture.close();
+
     SocketForwarder::getInstance().cleanup();
-    SessionManager::getInstance().resetStats();
+    TunStack::getInstance().reset();
+    SessionManager::getInstance().reset();
+    g_pipeline.resetStats();
 
     g_tun_fd = -1;
 }
 
 extern "C" JNIEXPORT void JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_clearPackets(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeClearPackets(JNIEnv *env, jobject thiz)
 {
     LOGD("Clearing packet statistics");
-    SessionManager::getInstance().resetStats();
+    g_pipeline.resetStats();
 }
 
 extern "C" JNIEXPORT void JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_pauseCapture(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativePauseCapture(JNIEnv *env, jobject thiz)
 {
     LOGD("Pause capture requested");
     // Implementation can be added here if needed
 }
 
 extern "C" JNIEXPORT void JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_resumeCapture(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeResumeCapture(JNIEnv *env, jobject thiz)
 {
     LOGD("Resume capture requested");
     // Implementation can be added here if needed
 }
 
 extern "C" JNIEXPORT jstring JNICALL
-Java_com_example_packet_1analyzer_NativeInterface_exportPackets(JNIEnv *env, jobject thiz)
+Java_com_example_packet_1analyzer_NativeInterface_nativeExportPackets(JNIEnv *env, jobject thiz)
 {
     LOGD("Export packets requested");
 
     // Simple export implementation - can be enhanced
-    auto stats = SessionManager::getInstance().getProtocolStats();
+    auto stats = g_pipeline.protocolStats();
     std::string export_data = "Packet Export\n=============\n";
 
     for (const auto &stat : stats)
@@ -388,7 +744,7 @@ Java_com_example_packet_1analyzer_NativeInterface_isCapturing(JNIEnv *env, jobje
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_example_packet_1analyzer_NativeInterface_getStats(JNIEnv *env, jobject thiz)
 {
-    auto stats = SessionManager::getInstance().getProtocolStats();
+    auto stats = g_pipeline.protocolStats();
     std::string stats_json = "[";
 
     for (size_t i = 0; i < stats.size(); i++)
@@ -406,6 +762,100 @@ Java_com_example_packet_1analyzer_NativeInterface_getStats(JNIEnv *env, jobject
     return env->NewStringUTF(stats_json.c_str());
 }
 
+// Heaviest sources, destinations and conversations by bytes, and under
+// "byPackets" by packets, at most `count` of each, as JSON. The ranked
+// count is an upper bound accurate to within the entry's "error";
+// "errorBound" is the most any host not listed can have sent.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeGetTopTalkers(JNIEnv *env, jobject thiz, jint count)
+{
+    size_t limit = count > 0 ? static_cast<size_t>(count) : 0;
+    return env->NewStringUTF(g_pipeline.topTalkersJson(limit).c_str());
+}
+
+// RTT, retransmission, reordering, zero-window and throughput figures of
+// the `count` busiest TCP flows, optionally narrowed to a host address and
+// port ("" / 0 for any), plus the same per destination, as JSON. Throws
+// IllegalArgumentException for an invalid host or port.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeGetFlowMetrics(JNIEnv *env, jobject thiz, jint count,
+                                                                       jstring host, jint port)
+{
+    const char *host_str = env->GetStringUTFChars(host, nullptr);
+    std::string host_address(host_str);
+    env->ReleaseStringUTFChars(host, host_str);
+
+    HistoryFilter filter;
+    std::string error;
+    if (!filter.parse("", host_address, port, error))
+    {
+        jclass exception = env->FindClass("java/lang/IllegalArgumentException");
+        env->ThrowNew(exception, error.c_str());
+        return nullptr;
+    }
+
+    size_t limit = count > 0 ? static_cast<size_t>(count) : 0;
+    return env->NewStringUTF(g_pipeline.flowMetricsJson(limit, filter).c_str());
+}
+
+// Page of the native packet history, newest first, after skipping `offset`
+// matching packets. The filter's parts are optional: protocol name, host
+// address and port ("" / 0 for any). Returns a 16-byte header (uint32
+// matching packets, returned records, stored packets, reserved; host
+// order) followed by the packed PacketRecords, or throws
+// IllegalArgumentException for an invalid filter.
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeGetPackets(JNIEnv *env, jobject thiz, jint offset, jint count,
+                                                                   jstring protocol, jstring host, jint port)
+{
+    const char *protocol_str = env->GetStringUTFChars(protocol, nullptr);
+    std::string protocol_name(protocol_str);
+    env->ReleaseStringUTFChars(protocol, protocol_str);
+    const char *host_str = env->GetStringUTFChars(host, nullptr);
+    std::string host_address(host_str);
+    env->ReleaseStringUTFChars(host, host_str);
+
+    HistoryFilter filter;
+    std::string error;
+    if (!filter.parse(protocol_name, host_address, port, error))
+    {
+        jclass exception = env->FindClass("java/lang/IllegalArgumentException");
+        env->ThrowNew(exception, error.c_str());
+        return nullptr;
+    }
+
+    size_t limit = std::min<size_t>(std::max(count, 0), MAX_HISTORY_PAGE);
+    std::vector<PacketRecord> records;
+    records.reserve(limit);
+    const PacketHistory &history = g_pipeline.history();
+    uint32_t header[4];
+    header[0] = static_cast<uint32_t>(history.query(std::max(offset, 0), limit, filter, records));
+    header[1] = static_cast<uint32_t>(records.size());
+    header[2] = static_cast<uint32_t>(history.stats().stored);
+    header[3] = 0;
+
+    jsize records_bytes = static_cast<jsize>(records.size() * sizeof(PacketRecord));
+    jbyteArray page = env->NewByteArray(sizeof(header) + records_bytes);
+    if (!page)
+    {
+        return nullptr;
+    }
+    env->SetByteArrayRegion(page, 0, sizeof(header), reinterpret_cast<const jbyte *>(header));
+    env->SetByteArrayRegion(page, sizeof(header), records_bytes, reinterpret_cast<const jbyte *>(records.data()));
+    return page;
+}
+
+// Occupancy, high-water mark and drop count of every pipeline ring plus
+// buffer pool usage, and the recorder's counters while recording, as JSON
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_packet_1analyzer_NativeInterface_nativeGetPipelineStats(JNIEnv *env, jobject thiz)
+{
+    // The VPN session table lives outside the pipeline; splice it in
+    std::string json = g_pipeline.statsJson();
+    json.insert(json.size() - 1, ",\"sessions\":" + SessionManager::getInstance().statsJson());
+    return env->NewStringUTF(json.c_str());
+}
+
 // Error handling helper
 extern "C" JNIEXPORT void JNICALL
 Java_com_example_packet_1analyzer_NativeInterface_sendError(JNIEnv *env, jobject thiz, jstring error)
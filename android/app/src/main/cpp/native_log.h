@@ -0,0 +1,36 @@
+#ifndef NATIVE_LOG_H
+#define NATIVE_LOG_H
+
+// LOGD/LOGE for the engine sources; each .cpp defines TAG before including
+// this. Android builds log to logcat, host builds (offline replay,
+// benchmarks) to stderr, so the core does not depend on android/log.h.
+
+#ifdef __ANDROID__
+
+#include <android/log.h>
+
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#else
+
+#include <cstdarg>
+#include <cstdio>
+
+__attribute__((format(printf, 3, 4))) inline void nativeLogPrint(char level, const char *tag, const char *format, ...)
+{
+    // Formatted first so lines from different threads do not interleave
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    std::fprintf(stderr, "%c/%s: %s\n", level, tag, message);
+}
+
+#define LOGD(...) nativeLogPrint('D', TAG, __VA_ARGS__)
+#define LOGE(...) nativeLogPrint('E', TAG, __VA_ARGS__)
+
+#endif
+
+#endif // NATIVE_LOG_H
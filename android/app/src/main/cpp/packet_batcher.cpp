@@ -0,0 +1,66 @@
+#include "packet_batcher.h"
+#include <algorithm>
+#include <cstring>
+
+PacketBatcher::PacketBatcher(size_t max_records, uint64_t max_delay_ms)
+    : records_(max_records), count_(0), max_delay_ms_(max_delay_ms), first_append_ms_(0)
+{
+}
+
+void PacketBatcher::toRecord(const PacketView &view, PacketRecord &record)
+{
+    record.timestamp_ns = view.timestamp_ns;
+    std::memcpy(record.source_addr, view.source_addr, sizeof(record.source_addr));
+    std::memcpy(record.dest_addr, view.dest_addr, sizeof(record.dest_addr));
+    record.source_port = view.source_port;
+    record.dest_port = view.dest_port;
+    record.size = view.size;
+    record.payload_length = view.payload_length;
+    record.ip_version = view.ip_version;
+    record.ip_protocol = view.ip_protocol;
+    record.protocol = static_cast<uint8_t>(view.protocol);
+    record.tcp_flags = view.tcp_flags;
+
+    size_t captured = std::min<size_t>(view.payload_length, sizeof(record.payload));
+    record.captured_payload = static_cast<uint8_t>(captured);
+    std::memset(record.reserved, 0, sizeof(record.reserved));
+    std::memcpy(record.payload, view.payload(), captured);
+}
+
+bool PacketBatcher::append(const PacketRecord &record, uint64_t now_ms)
+{
+    if (count_ == records_.size())
+    {
+        return true;
+    }
+
+    if (count_ == 0)
+    {
+        first_append_ms_ = now_ms;
+    }
+
+    records_[count_++] = record;
+    return count_ == records_.size();
+}
+
+bool PacketBatcher::due(uint64_t now_ms) const
+{
+    return count_ == records_.size() ||
+           (count_ > 0 && now_ms - first_append_ms_ >= max_delay_ms_);
+}
+
+int PacketBatcher::msUntilDue(uint64_t now_ms) const
+{
+    if (count_ == 0)
+    {
+        return -1;
+    }
+
+    uint64_t elapsed = now_ms - first_append_ms_;
+    return elapsed >= max_delay_ms_ ? 0 : static_cast<int>(max_delay_ms_ - elapsed);
+}
+
+void PacketBatcher::clear()
+{
+    count_ = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef PACKET_BATCHER_H
+#define PACKET_BATCHER_H
+
+#include "packet_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed 128-byte record handed to Kotlin/Dart in one packed buffer per
+// batch. Fields are in host (little-endian) order except the addresses,
+// which stay in network order. Any change here must be mirrored in
+// NativeInterface.kt and lib/main.dart.
+struct PacketRecord
+{
+    uint64_t timestamp_ns;    // 0   capture time, ns since epoch
+    uint8_t source_addr[16];  // 8
+    uint8_t dest_addr[16];    // 24
+    uint16_t source_port;     // 40
+    uint16_t dest_port;       // 42
+    uint32_t size;            // 44
+    uint32_t payload_length;  // 48  payload bytes on the wire
+    uint8_t ip_version;       // 52
+    uint8_t ip_protocol;      // 53
+    uint8_t protocol;         // 54  Protocol enum value
+    uint8_t tcp_flags;        // 55
+    uint8_t captured_payload; // 56  bytes of payload copied below
+    uint8_t reserved[7];      // 57
+    uint8_t payload[64];      // 64
+};
+
+static_assert(sizeof(PacketRecord) == 128, "PacketRecord layout is shared with Kotlin/Dart");
+
+// Accumulates PacketRecords in preallocated storage so that the UI is fed
+// with one JNI call per batch instead of one per packet. A batch is due
+// when it is full or when its oldest record has waited max_delay_ms.
+class PacketBatcher
+{
+public:
+    PacketBatcher(size_t max_records, uint64_t max_delay_ms);
+
+    // Fills a record from a parsed packet; done on the parsing thread so
+    // only the fixed-size record crosses to the UI sink
+    static void toRecord(const PacketView &view, PacketRecord &record);
+
+    // Returns true once the batch is full and must be flushed
+    bool append(const PacketRecord &record, uint64_t now_ms);
+    bool due(uint64_t now_ms) const;
+    // Milliseconds until the batch becomes due, or -1 while it is empty
+    int msUntilDue(uint64_t now_ms) const;
+    void clear();
+
+    bool empty() const { return count_ == 0; }
+    size_t count() const { return count_; }
+    size_t capacity() const { return records_.size(); }
+    void *data() { return records_.data(); }
+    const PacketRecord *records() const { return records_.data(); }
+    size_t capacityBytes() const { return records_.size() * sizeof(PacketRecord); }
+
+private:
+    std::vector<PacketRecord> records_;
+    size_t count_;
+    uint64_t max_delay_ms_;
+    uint64_t first_append_ms_;
+};
+
+#endif // PACKET_BATCHER_H
@@ -0,0 +1,128 @@
+#include "packet_builder.h"
+#include "packet_parser.h"
+#include <cstring>
+#include <arpa/inet.h>
+
+static const size_t IPV4_HEADER_LENGTH = sizeof(IPHeader);
+
+uint32_t PacketBuilder::checksumAdd(uint32_t initial, const uint8_t *data, size_t length)
+{
+    uint32_t sum = initial;
+    while (length > 1)
+    {
+        sum += (static_cast<uint32_t>(data[0]) << 8) | data[1];
+        data += 2;
+        length -= 2;
+    }
+    if (length)
+    {
+        sum += static_cast<uint32_t>(data[0]) << 8;
+    }
+    return sum;
+}
+
+uint16_t PacketBuilder::checksumFinish(uint32_t sum)
+{
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+void PacketBuilder::writeIPv4Header(uint8_t *out, size_t total_length, uint8_t protocol,
+                                    const uint8_t *source_addr, const uint8_t *dest_addr)
+{
+    IPHeader *ip = reinterpret_cast<IPHeader *>(out);
+    ip->version_ihl = 0x45;
+    ip->tos = 0;
+    ip->total_length = htons(static_cast<uint16_t>(total_length));
+    ip->identification = 0;
+    ip->flags_fragment = htons(0x4000); // don't fragment
+    ip->ttl = 64;
+    ip->protocol = protocol;
+    ip->checksum = 0;
+    std::memcpy(&ip->source_ip, source_addr, 4);
+    std::memcpy(&ip->dest_ip, dest_addr, 4);
+    ip->checksum = htons(checksumFinish(checksumAdd(0, out, IPV4_HEADER_LENGTH)));
+}
+
+uint32_t PacketBuilder::pseudoHeaderSum(const uint8_t *source_addr, const uint8_t *dest_addr,
+                                        uint8_t protocol, size_t l4_length)
+{
+    uint32_t sum = checksumAdd(0, source_addr, 4);
+    sum = checksumAdd(sum, dest_addr, 4);
+    return sum + protocol + static_cast<uint32_t>(l4_length);
+}
+
+size_t PacketBuilder::buildTcp(uint8_t *out, size_t capacity,
+                               const uint8_t *source_addr, uint16_t source_port,
+                               const uint8_t *dest_addr, uint16_t dest_port,
+                               uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window,
+                               uint16_t mss_option, const uint8_t *payload, size_t payload_length)
+{
+    size_t options_length = mss_option ? 4 : 0;
+    size_t tcp_length = sizeof(TCPHeader) + options_length + payload_length;
+    size_t total_length = IPV4_HEADER_LENGTH + tcp_length;
+    if (total_length > capacity || total_length > 0xFFFF)
+    {
+        return 0;
+    }
+
+    uint8_t *l4 = out + IPV4_HEADER_LENGTH;
+    TCPHeader *tcp = reinterpret_cast<TCPHeader *>(l4);
+    tcp->source_port = htons(source_port);
+    tcp->dest_port = htons(dest_port);
+    tcp->sequence = htonl(seq);
+    tcp->acknowledgment = htonl(ack);
+    tcp->data_offset_reserved = static_cast<uint8_t>(((sizeof(TCPHeader) + options_length) / 4) << 4);
+    tcp->flags = flags;
+    tcp->window = htons(window);
+    tcp->checksum = 0;
+    tcp->urgent_pointer = 0;
+
+    uint8_t *options = l4 + sizeof(TCPHeader);
+    if (mss_option)
+    {
+        options[0] = 2; // kind: maximum segment size
+        options[1] = 4;
+        options[2] = static_cast<uint8_t>(mss_option >> 8);
+        options[3] = static_cast<uint8_t>(mss_option);
+    }
+    if (payload_length)
+    {
+        std::memcpy(options + options_length, payload, payload_length);
+    }
+
+    writeIPv4Header(out, total_length, IPPROTO_TCP, source_addr, dest_addr);
+    uint32_t sum = pseudoHeaderSum(source_addr, dest_addr, IPPROTO_TCP, tcp_length);
+    tcp->checksum = htons(checksumFinish(checksumAdd(sum, l4, tcp_length)));
+    return total_length;
+}
+
+size_t PacketBuilder::buildUdp(uint8_t *out, size_t capacity,
+                               const uint8_t *source_addr, uint16_t source_port,
+                               const uint8_t *dest_addr, uint16_t dest_port,
+                               const uint8_t *payload, size_t payload_length)
+{
+    size_t udp_length = sizeof(UDPHeader) + payload_length;
+    size_t total_length = IPV4_HEADER_LENGTH + udp_length;
+    if (total_length > capacity || total_length > 0xFFFF)
+    {
+        return 0;
+    }
+
+    uint8_t *l4 = out + IPV4_HEADER_LENGTH;
+    UDPHeader *udp = reinterpret_cast<UDPHeader *>(l4);
+    udp->source_port = htons(source_port);
+    udp->dest_port = htons(dest_port);
+    udp->length = htons(static_cast<uint16_t>(udp_length));
+    udp->checksum = 0;
+    std::memcpy(l4 + sizeof(UDPHeader), payload, payload_length);
+
+    writeIPv4Header(out, total_length, IPPROTO_UDP, source_addr, dest_addr);
+    uint32_t sum = pseudoHeaderSum(source_addr, dest_addr, IPPROTO_UDP, udp_length);
+    uint16_t checksum = checksumFinish(checksumAdd(sum, l4, udp_length));
+    udp->checksum = htons(checksum == 0 ? 0xFFFF : checksum);
+    return total_length;
+}
@@ -0,0 +1,36 @@
+#ifndef PACKET_BUILDER_H
+#define PACKET_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Crafts IPv4 packets for injection into the TUN interface. Addresses are
+// 4 bytes in network byte order, everything else is in host order. Each
+// builder writes into the caller's buffer and returns the packet length,
+// or 0 if it does not fit in `capacity`.
+class PacketBuilder
+{
+public:
+    static size_t buildTcp(uint8_t *out, size_t capacity,
+                           const uint8_t *source_addr, uint16_t source_port,
+                           const uint8_t *dest_addr, uint16_t dest_port,
+                           uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window,
+                           uint16_t mss_option, const uint8_t *payload, size_t payload_length);
+
+    static size_t buildUdp(uint8_t *out, size_t capacity,
+                           const uint8_t *source_addr, uint16_t source_port,
+                           const uint8_t *dest_addr, uint16_t dest_port,
+                           const uint8_t *payload, size_t payload_length);
+
+    // One's-complement sum of `data`, folded into `initial`
+    static uint32_t checksumAdd(uint32_t initial, const uint8_t *data, size_t length);
+    static uint16_t checksumFinish(uint32_t sum);
+
+private:
+    static void writeIPv4Header(uint8_t *out, size_t total_length, uint8_t protocol,
+                                const uint8_t *source_addr, const uint8_t *dest_addr);
+    static uint32_t pseudoHeaderSum(const uint8_t *source_addr, const uint8_t *dest_addr,
+                                    uint8_t protocol, size_t l4_length);
+};
+
+#endif // PACKET_BUILDER_H
@@ -0,0 +1,225 @@
+#include "packet_history.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+#include <strings.h>
+
+static const size_t ADDRESS_BYTES = 16;
+
+static size_t roundUpPow2(size_t value)
+{
+    size_t size = 1;
+    while (size < value)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+HistoryFilter::HistoryFilter() : protocol(-1), port(0), ip_version(0)
+{
+    std::memset(address, 0, sizeof(address));
+}
+
+bool HistoryFilter::parse(const std::string &protocol_name, const std::string &host, int port_number,
+                          std::string &error)
+{
+    *this = HistoryFilter();
+
+    if (!protocol_name.empty())
+    {
+        for (int value = static_cast<int>(Protocol::TCP); value < static_cast<int>(PROTOCOL_COUNT); ++value)
+        {
+            if (strcasecmp(protocol_name.c_str(), PacketParser::protocolName(static_cast<Protocol>(value))) == 0)
+            {
+                protocol = value;
+                break;
+            }
+        }
+        if (protocol < 0)
+        {
+            error = "unknown protocol '" + protocol_name + "'";
+            return false;
+        }
+    }
+
+    if (!host.empty())
+    {
+        if (inet_pton(AF_INET, host.c_str(), address) == 1)
+        {
+            ip_version = 4;
+        }
+        else if (inet_pton(AF_INET6, host.c_str(), address) == 1)
+        {
+            ip_version = 6;
+        }
+        else
+        {
+            error = "invalid address '" + host + "'";
+            return false;
+        }
+    }
+
+    if (port_number < 0 || port_number > 65535)
+    {
+        error = "invalid port " + std::to_string(port_number);
+        return false;
+    }
+    port = static_cast<uint16_t>(port_number);
+    return true;
+}
+
+PacketHistory::PacketHistory(size_t capacity, size_t payload_bytes)
+    : capacity_(roundUpPow2(capacity)), mask_(capacity_ - 1), payload_size_(roundUpPow2(payload_bytes)),
+      timestamp_ns_(new uint64_t[capacity_]), source_addr_(new uint8_t[capacity_ * ADDRESS_BYTES]),
+      dest_addr_(new uint8_t[capacity_ * ADDRESS_BYTES]), source_port_(new uint16_t[capacity_]),
+      dest_port_(new uint16_t[capacity_]), size_(new uint32_t[capacity_]), payload_length_(new uint32_t[capacity_]),
+      ip_version_(new uint8_t[capacity_]), ip_protocol_(new uint8_t[capacity_]), protocol_(new uint8_t[capacity_]),
+      tcp_flags_(new uint8_t[capacity_]), captured_(new uint8_t[capacity_]), payload_offset_(new uint32_t[capacity_]),
+      payload_(new uint8_t[payload_size_]), payload_head_(0), appended_(0)
+{
+}
+
+void PacketHistory::append(const PacketRecord *records, size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const PacketRecord &record = records[i];
+        size_t slot = appended_ & mask_;
+
+        timestamp_ns_[slot] = record.timestamp_ns;
+        std::memcpy(&source_addr_[slot * ADDRESS_BYTES], record.source_addr, ADDRESS_BYTES);
+        std::memcpy(&dest_addr_[slot * ADDRESS_BYTES], record.dest_addr, ADDRESS_BYTES);
+        source_port_[slot] = record.source_port;
+        dest_port_[slot] = record.dest_port;
+        size_[slot] = record.size;
+        payload_length_[slot] = record.payload_length;
+        ip_version_[slot] = record.ip_version;
+        ip_protocol_[slot] = record.ip_protocol;
+        protocol_[slot] = record.protocol;
+        tcp_flags_[slot] = record.tcp_flags;
+
+        // Slices are kept contiguous; one that would straddle the end of the
+        // payload ring starts over at the beginning instead
+        size_t captured = record.captured_payload;
+        size_t position = payload_head_ & (payload_size_ - 1);
+        if (position + captured > payload_size_)
+        {
+            payload_head_ += payload_size_ - position;
+            position = 0;
+        }
+        std::memcpy(&payload_[position], record.payload, captured);
+        captured_[slot] = static_cast<uint8_t>(captured);
+        payload_offset_[slot] = static_cast<uint32_t>(payload_head_);
+        payload_head_ += captured;
+
+        appended_++;
+    }
+}
+
+bool PacketHistory::matches(size_t slot, const HistoryFilter &filter) const
+{
+    if (filter.protocol >= 0 && protocol_[slot] != filter.protocol)
+    {
+        return false;
+    }
+    if (filter.port != 0 && source_port_[slot] != filter.port && dest_port_[slot] != filter.port)
+    {
+        return false;
+    }
+    if (filter.ip_version != 0)
+    {
+        size_t length = filter.ip_version == 6 ? ADDRESS_BYTES : 4;
+        if (ip_version_[slot] != filter.ip_version ||
+            (std::memcmp(&source_addr_[slot * ADDRESS_BYTES], filter.address, length) != 0 &&
+             std::memcmp(&dest_addr_[slot * ADDRESS_BYTES], filter.address, length) != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PacketHistory::load(size_t slot, PacketRecord &record) const
+{
+    record.timestamp_ns = timestamp_ns_[slot];
+    std::memcpy(record.source_addr, &source_addr_[slot * ADDRESS_BYTES], ADDRESS_BYTES);
+    std::memcpy(record.dest_addr, &dest_addr_[slot * ADDRESS_BYTES], ADDRESS_BYTES);
+    record.source_port = source_port_[slot];
+    record.dest_port = dest_port_[slot];
+    record.size = size_[slot];
+    record.payload_length = payload_length_[slot];
+    record.ip_version = ip_version_[slot];
+    record.ip_protocol = ip_protocol_[slot];
+    record.protocol = protocol_[slot];
+    record.tcp_flags = tcp_flags_[slot];
+    std::memset(record.reserved, 0, sizeof(record.reserved));
+
+    // A slice older than one payload ring's worth has been overwritten
+    uint32_t offset = payload_offset_[slot];
+    size_t captured = captured_[slot];
+    if (static_cast<uint32_t>(payload_head_) - offset > payload_size_)
+    {
+        captured = 0;
+    }
+    record.captured_payload = static_cast<uint8_t>(captured);
+    std::memcpy(record.payload, &payload_[offset & (payload_size_ - 1)], captured);
+}
+
+size_t PacketHistory::query(size_t offset, size_t count, const HistoryFilter &filter,
+                            std::vector<PacketRecord> &out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t stored = static_cast<size_t>(std::min<uint64_t>(appended_, capacity_));
+
+    bool match_all = filter.protocol < 0 && filter.port == 0 && filter.ip_version == 0;
+    if (match_all)
+    {
+        for (size_t i = offset; i < stored && out.size() < count; ++i)
+        {
+            out.emplace_back();
+            load((appended_ - 1 - i) & mask_, out.back());
+        }
+        return stored;
+    }
+
+    // The total needs every stored packet tested, but only against the
+    // columns the filter uses
+    size_t matched = 0;
+    for (size_t i = 0; i < stored; ++i)
+    {
+        size_t slot = (appended_ - 1 - i) & mask_;
+        if (!matches(slot, filter))
+        {
+            continue;
+        }
+        if (matched >= offset && out.size() < count)
+        {
+            out.emplace_back();
+            load(slot, out.back());
+        }
+        matched++;
+    }
+    return matched;
+}
+
+void PacketHistory::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    appended_ = 0;
+    payload_head_ = 0;
+}
+
+HistoryStats PacketHistory::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    HistoryStats stats;
+    stats.capacity = capacity_;
+    stats.stored = static_cast<size_t>(std::min<uint64_t>(appended_, capacity_));
+    stats.appended = appended_;
+    // Per slot: timestamp, two addresses, two ports, size, payload length,
+    // payload offset and five one-byte columns
+    stats.memory_bytes = capacity_ * (8 + 2 * ADDRESS_BYTES + 2 * 2 + 4 + 4 + 4 + 5) + payload_size_;
+    return stats;
+}
@@ -0,0 +1,97 @@
+#ifndef PACKET_HISTORY_H
+#define PACKET_HISTORY_H
+
+#include "packet_batcher.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Predicate for PacketHistory::query(); default-constructed it matches
+// every packet. Port and address match either endpoint.
+struct HistoryFilter
+{
+    int protocol; // Protocol enum value, or -1 for any
+    uint16_t port;
+    uint8_t ip_version; // 0 when no address is set
+    uint8_t address[16];
+
+    HistoryFilter();
+
+    // protocol is a name from PacketParser::protocolName() (any case), host
+    // an IPv4 or IPv6 literal; empty strings and port 0 leave that part open
+    bool parse(const std::string &protocol, const std::string &host, int port, std::string &error);
+};
+
+struct HistoryStats
+{
+    size_t capacity;
+    size_t stored;
+    uint64_t appended; // since the last clear(), including overwritten packets
+    size_t memory_bytes;
+};
+
+// Fixed-capacity ring of the most recent packets, stored column by column
+// (timestamps, tuple, protocol, lengths) with captured payload slices in a
+// separate byte ring. Scanning a filter touches only the columns it tests,
+// and memory is bounded up front: the newest `capacity` packets are kept,
+// and a payload survives while the payload ring still holds it.
+//
+// The pipeline's UI sink appends each batch it delivers; any thread may
+// query, so the UI fetches only the rows on screen instead of holding every
+// packet itself.
+class PacketHistory
+{
+public:
+    // Both sizes are rounded up to powers of two. Columns are allocated
+    // without being touched, so pages are only committed as history fills.
+    PacketHistory(size_t capacity, size_t payload_bytes);
+
+    PacketHistory(const PacketHistory &) = delete;
+    PacketHistory &operator=(const PacketHistory &) = delete;
+
+    void append(const PacketRecord *records, size_t count);
+
+    // Newest first: skips `offset` matching packets and copies up to `count`
+    // of the following ones into `out`. Returns how many stored packets
+    // match in total.
+    size_t query(size_t offset, size_t count, const HistoryFilter &filter, std::vector<PacketRecord> &out) const;
+
+    void clear();
+    HistoryStats stats() const;
+
+private:
+    bool matches(size_t slot, const HistoryFilter &filter) const;
+    void load(size_t slot, PacketRecord &record) const;
+
+    size_t capacity_;
+    size_t mask_;
+    size_t payload_size_;
+
+    // One entry per slot; a packet's slot is its sequence number & mask_
+    std::unique_ptr<uint64_t[]> timestamp_ns_;
+    std::unique_ptr<uint8_t[]> source_addr_; // 16 bytes per slot
+    std::unique_ptr<uint8_t[]> dest_addr_;
+    std::unique_ptr<uint16_t[]> source_port_;
+    std::unique_ptr<uint16_t[]> dest_port_;
+    std::unique_ptr<uint32_t[]> size_;
+    std::unique_ptr<uint32_t[]> payload_length_;
+    std::unique_ptr<uint8_t[]> ip_version_;
+    std::unique_ptr<uint8_t[]> ip_protocol_;
+    std::unique_ptr<uint8_t[]> protocol_;
+    std::unique_ptr<uint8_t[]> tcp_flags_;
+    std::unique_ptr<uint8_t[]> captured_;
+    // Payload ring position of the slice; wraps at 2^32, which the slot
+    // ring recycles long before the payload ring could
+    std::unique_ptr<uint32_t[]> payload_offset_;
+
+    std::unique_ptr<uint8_t[]> payload_;
+    uint64_t payload_head_;
+
+    uint64_t appended_;
+    mutable std::mutex mutex_;
+};
+
+#endif // PACKET_HISTORY_H
@@ -1,112 +1,230 @@
 #include "packet_parser.h"
-#include <sstream>
-#include <iomanip>
-#include <chrono>
+#include "hex_dump.h"
+#include <cstring>
 #include <arpa/inet.h>
 
-PacketInfo PacketParser::parsePacket(const uint8_t *packet, int length)
+PacketInfo::PacketInfo()
 {
-    PacketInfo info;
-
-    if (length < sizeof(IPHeader))
-    {
-        return info;
-    }
+    std::memset(&view_, 0, sizeof(view_));
+}
 
-    const IPHeader *ip_header = reinterpret_cast<const IPHeader *>(packet);
+PacketInfo::PacketInfo(const PacketView &view) : view_(view)
+{
+}
 
-    // Check if it's IPv4
-    if ((ip_header->version_ihl >> 4) != 4)
-    {
-        return info;
-    }
+std::string PacketInfo::sourceIp() const
+{
+    return PacketParser::addressToString(view_.source_addr, view_.ip_version);
+}
 
-    info.source_ip = ipToString(ip_header->source_ip);
-    info.dest_ip = ipToString(ip_header->dest_ip);
-    info.size = ntohs_custom(ip_header->total_length);
-    info.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch())
-                         .count();
+std::string PacketInfo::destIp() const
+{
+    return PacketParser::addressToString(view_.dest_addr, view_.ip_version);
+}
 
-    uint8_t ip_header_length = (ip_header->version_ihl & 0x0F) * 4;
-    const uint8_t *payload = packet + ip_header_length;
-    int payload_length = length - ip_header_length;
+const char *PacketInfo::protocolName() const
+{
+    return PacketParser::protocolName(view_.protocol);
+}
 
-    switch (ip_header->protocol)
+std::string PacketInfo::payloadHex(int max_bytes) const
+{
+    if (view_.payload_length == 0)
     {
-    case 6: // TCP
-        return parseTCP(ip_header, payload, payload_length);
-    case 17: // UDP
-        return parseUDP(ip_header, payload, payload_length);
-    default:
-        info.protocol = "OTHER";
-        info.source_port = 0;
-        info.dest_port = 0;
-        break;
+        return std::string();
     }
+    return PacketParser::bytesToHex(view_.payload(), view_.payload_length, max_bytes);
+}
 
-    return info;
+std::string PacketInfo::payloadDump() const
+{
+    std::string dump(HexDump::dumpLength(view_.payload_length), '\0');
+    dump.resize(HexDump::formatDump(view_.payload(), view_.payload_length, &dump[0], dump.size()));
+    return dump;
 }
 
-PacketInfo PacketParser::parseTCP(const IPHeader *ip_header, const uint8_t *packet, int length)
+bool PacketParser::parseInto(const uint8_t *packet, size_t length, PacketView &view)
 {
-    PacketInfo info;
-    info.source_ip = ipToString(ip_header->source_ip);
-    info.dest_ip = ipToString(ip_header->dest_ip);
-    info.size = ntohs_custom(ip_header->total_length);
-    info.protocol = "TCP";
-    info.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch())
-                         .count();
+    view.data = packet;
+    view.length = static_cast<uint32_t>(length);
+    view.protocol = Protocol::Unknown;
+    view.ip_version = 0;
+    view.ip_protocol = 0;
+    view.tcp_flags = 0;
+    view.source_port = 0;
+    view.dest_port = 0;
+    view.tcp_seq = 0;
+    view.tcp_ack = 0;
+    view.tcp_window = 0;
+    view.size = 0;
+    view.l4_offset = 0;
+    view.payload_offset = 0;
+    view.payload_length = 0;
+    view.timestamp_ns = 0;
+
+    if (length < sizeof(IPHeader))
+    {
+        return false;
+    }
 
-    if (length < sizeof(TCPHeader))
+    uint8_t version = packet[0] >> 4;
+    if (version == 4)
     {
-        return info;
+        const IPHeader *ip_header = reinterpret_cast<const IPHeader *>(packet);
+        size_t ip_header_length = (ip_header->version_ihl & 0x0F) * 4;
+        if (ip_header_length < sizeof(IPHeader) || ip_header_length > length)
+        {
+            return false;
+        }
+
+        std::memcpy(view.source_addr, &ip_header->source_ip, 4);
+        std::memcpy(view.dest_addr, &ip_header->dest_ip, 4);
+        std::memset(view.source_addr + 4, 0, 12);
+        std::memset(view.dest_addr + 4, 0, 12);
+        view.ip_protocol = ip_header->protocol;
+        view.size = ntohs_custom(ip_header->total_length);
+        view.l4_offset = static_cast<uint16_t>(ip_header_length);
     }
+    else if (version == 6)
+    {
+        if (length < sizeof(IPv6Header))
+        {
+            return false;
+        }
 
-    const TCPHeader *tcp_header = reinterpret_cast<const TCPHeader *>(packet);
-    info.source_port = ntohs_custom(tcp_header->source_port);
-    info.dest_port = ntohs_custom(tcp_header->dest_port);
+        const IPv6Header *ip_header = reinterpret_cast<const IPv6Header *>(packet);
+        std::memcpy(view.source_addr, ip_header->source_ip, 16);
+        std::memcpy(view.dest_addr, ip_header->dest_ip, 16);
+        view.size = sizeof(IPv6Header) + ntohs_custom(ip_header->payload_length);
 
-    uint8_t tcp_header_length = (tcp_header->data_offset_reserved >> 4) * 4;
-    if (length > tcp_header_length)
+        // Walk the extension headers that carry their own length
+        uint8_t next_header = ip_header->next_header;
+        size_t offset = sizeof(IPv6Header);
+        while ((next_header == 0 || next_header == 43 || next_header == 60) &&
+               offset + 8 <= length)
+        {
+            next_header = packet[offset];
+            offset += (packet[offset + 1] + 1) * 8;
+        }
+        if (offset > length)
+        {
+            return false;
+        }
+
+        view.ip_protocol = next_header;
+        view.l4_offset = static_cast<uint16_t>(offset);
+    }
+    else
     {
-        const uint8_t *payload = packet + tcp_header_length;
-        int payload_length = length - tcp_header_length;
-        info.payload = bytesToHex(payload, payload_length);
+        return false;
     }
 
-    return info;
+    view.ip_version = version;
+    view.payload_offset = view.l4_offset;
+
+    // Link-layer padding (short Ethernet frames) is not part of the datagram
+    size_t l4_length = length - view.l4_offset;
+    if (view.size > view.l4_offset && view.size - view.l4_offset < l4_length)
+    {
+        l4_length = view.size - view.l4_offset;
+    }
+    return parseTransport(packet + view.l4_offset, l4_length, view);
 }
 
-PacketInfo PacketParser::parseUDP(const IPHeader *ip_header, const uint8_t *packet, int length)
+bool PacketParser::parseTransport(const uint8_t *packet, size_t length, PacketView &view)
 {
-    PacketInfo info;
-    info.source_ip = ipToString(ip_header->source_ip);
-    info.dest_ip = ipToString(ip_header->dest_ip);
-    info.size = ntohs_custom(ip_header->total_length);
-    info.protocol = "UDP";
-    info.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         std::chrono::system_clock::now().time_since_epoch())
-                         .count();
+    switch (view.ip_protocol)
+    {
+    case 6: // TCP
+    {
+        view.protocol = Protocol::TCP;
+        if (length < sizeof(TCPHeader))
+        {
+            return true;
+        }
 
-    if (length < sizeof(UDPHeader))
+        const TCPHeader *tcp_header = reinterpret_cast<const TCPHeader *>(packet);
+        view.source_port = ntohs_custom(tcp_header->source_port);
+        view.dest_port = ntohs_custom(tcp_header->dest_port);
+        view.tcp_flags = tcp_header->flags;
+        view.tcp_seq = ntohl_custom(tcp_header->sequence);
+        view.tcp_ack = ntohl_custom(tcp_header->acknowledgment);
+        view.tcp_window = ntohs_custom(tcp_header->window);
+
+        size_t tcp_header_length = (tcp_header->data_offset_reserved >> 4) * 4;
+        if (tcp_header_length >= sizeof(TCPHeader) && length >= tcp_header_length)
+        {
+            view.payload_offset = static_cast<uint16_t>(view.l4_offset + tcp_header_length);
+            view.payload_length = static_cast<uint32_t>(length - tcp_header_length);
+        }
+        return true;
+    }
+    case 17: // UDP
     {
-        return info;
+        view.protocol = Protocol::UDP;
+        if (length < sizeof(UDPHeader))
+        {
+            return true;
+        }
+
+        const UDPHeader *udp_header = reinterpret_cast<const UDPHeader *>(packet);
+        view.source_port = ntohs_custom(udp_header->source_port);
+        view.dest_port = ntohs_custom(udp_header->dest_port);
+
+        view.payload_offset = static_cast<uint16_t>(view.l4_offset + sizeof(UDPHeader));
+        view.payload_length = static_cast<uint32_t>(length - sizeof(UDPHeader));
+        return true;
+    }
+    case 1: // ICMP
+        view.protocol = Protocol::ICMP;
+        return true;
+    case 58: // ICMPv6
+        view.protocol = Protocol::ICMPv6;
+        return true;
+    default:
+        view.protocol = Protocol::Other;
+        return true;
     }
+}
 
-    const UDPHeader *udp_header = reinterpret_cast<const UDPHeader *>(packet);
-    info.source_port = ntohs_custom(udp_header->source_port);
-    info.dest_port = ntohs_custom(udp_header->dest_port);
+PacketInfo PacketParser::parsePacket(const uint8_t *packet, int length)
+{
+    PacketView view;
+    if (length <= 0 || !parseInto(packet, static_cast<size_t>(length), view))
+    {
+        return PacketInfo();
+    }
+    return PacketInfo(view);
+}
 
-    if (length > sizeof(UDPHeader))
+const char *PacketParser::protocolName(Protocol protocol)
+{
+    switch (protocol)
     {
-        const uint8_t *payload = packet + sizeof(UDPHeader);
-        int payload_length = length - sizeof(UDPHeader);
-        info.payload = bytesToHex(payload, payload_length);
+    case Protocol::TCP:
+        return "TCP";
+    case Protocol::UDP:
+        return "UDP";
+    case Protocol::ICMP:
+        return "ICMP";
+    case Protocol::ICMPv6:
+        return "ICMPv6";
+    case Protocol::Other:
+        return "OTHER";
+    default:
+        return "";
     }
+}
 
-    return info;
+std::string PacketParser::addressToString(const uint8_t *addr, uint8_t ip_version)
+{
+    char buffer[INET6_ADDRSTRLEN];
+    int family = ip_version == 6 ? AF_INET6 : AF_INET;
+    if (ip_version == 0 || !inet_ntop(family, addr, buffer, sizeof(buffer)))
+    {
+        return std::string();
+    }
+    return std::string(buffer);
 }
 
 std::string PacketParser::ipToString(uint32_t ip)
@@ -126,36 +244,14 @@ uint32_t PacketParser::ntohl_custom(uint32_t value)
     return ntohl(value);
 }
 
-std::string PacketParser::getCurrentTimestamp()
-{
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                  now.time_since_epoch()) %
-              1000;
-
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t), "%H:%M:%S");
-    ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    return ss.str();
-}
-
 std::string PacketParser::bytesToHex(const uint8_t *data, int length, int max_bytes)
 {
-    std::stringstream ss;
-    int bytes_to_show = std::min(length, max_bytes);
-
-    for (int i = 0; i < bytes_to_show; ++i)
-    {
-        ss << std::hex << std::setfill('0') << std::setw(2) << (int)data[i];
-        if (i < bytes_to_show - 1)
-            ss << " ";
-    }
-
-    if (length > max_bytes)
+    if (length <= 0 || max_bytes < 0)
     {
-        ss << "...";
+        return std::string();
     }
 
-    return ss.str();
+    std::string hex(HexDump::spacedLength(length, max_bytes), '\0');
+    HexDump::formatSpaced(data, length, max_bytes, &hex[0], hex.size());
+    return hex;
 }
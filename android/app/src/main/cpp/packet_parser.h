@@ -2,6 +2,7 @@
 #define PACKET_PARSER_H
 
 #include <string>
+#include <cstddef>
 #include <cstdint>
 
 struct IPHeader
@@ -18,6 +19,16 @@ struct IPHeader
     uint32_t dest_ip;
 };
 
+struct IPv6Header
+{
+    uint32_t version_class_flow;
+    uint16_t payload_length;
+    uint8_t next_header;
+    uint8_t hop_limit;
+    uint8_t source_ip[16];
+    uint8_t dest_ip[16];
+};
+
 struct TCPHeader
 {
     uint16_t source_port;
@@ -31,6 +42,16 @@ struct TCPHeader
     uint16_t urgent_pointer;
 };
 
+// TCPHeader::flags bits
+enum TcpFlag : uint8_t
+{
+    TCP_FIN = 0x01,
+    TCP_SYN = 0x02,
+    TCP_RST = 0x04,
+    TCP_PSH = 0x08,
+    TCP_ACK = 0x10
+};
+
 struct UDPHeader
 {
     uint16_t source_port;
@@ -39,31 +60,89 @@ struct UDPHeader
     uint16_t checksum;
 };
 
-struct PacketInfo
+// Values are shared with the UI through PacketRecord; new ones go at the end
+enum class Protocol : uint8_t
+{
+    Unknown = 0,
+    TCP,
+    UDP,
+    Other,
+    ICMP,
+    ICMPv6
+};
+
+// Number of Protocol values, for tables indexed by the enum
+static const size_t PROTOCOL_COUNT = 6;
+
+// Allocation-free result of parsing one packet. Addresses are kept in
+// network byte order (IPv4 uses the first 4 bytes) and every offset is
+// relative to `data`, which points into the caller's buffer and is only
+// valid for as long as that buffer is.
+struct PacketView
 {
-    std::string source_ip;
-    std::string dest_ip;
+    const uint8_t *data;
+    uint32_t length;
+    uint64_t timestamp_ns; // capture time, ns since the Unix epoch; set by the caller
+    uint8_t source_addr[16];
+    uint8_t dest_addr[16];
+    uint8_t ip_version;
+    uint8_t ip_protocol;
+    Protocol protocol;
+    uint8_t tcp_flags;
     uint16_t source_port;
     uint16_t dest_port;
-    std::string protocol;
-    uint16_t size;
-    std::string payload;
-    uint64_t timestamp;
+    uint32_t tcp_seq;    // host byte order, TCP only
+    uint32_t tcp_ack;
+    uint16_t tcp_window;
+    uint32_t size;
+    uint16_t l4_offset;
+    uint16_t payload_offset;
+    uint32_t payload_length;
+
+    const uint8_t *payload() const { return data + payload_offset; }
+};
+
+// Formatting layer over a PacketView. Nothing is converted to text until
+// one of the string accessors is called.
+class PacketInfo
+{
+public:
+    PacketInfo();
+    explicit PacketInfo(const PacketView &view);
+
+    bool valid() const { return view_.protocol != Protocol::Unknown; }
+    const PacketView &view() const { return view_; }
+
+    std::string sourceIp() const;
+    std::string destIp() const;
+    uint16_t sourcePort() const { return view_.source_port; }
+    uint16_t destPort() const { return view_.dest_port; }
+    const char *protocolName() const;
+    uint32_t size() const { return view_.size; }
+    uint64_t timestampNs() const { return view_.timestamp_ns; }
+    std::string payloadHex(int max_bytes = 64) const;
+    // Offset/hex/ASCII dump of the captured payload, for packet details
+    std::string payloadDump() const;
+
+private:
+    PacketView view_;
 };
 
 class PacketParser
 {
 public:
+    static bool parseInto(const uint8_t *packet, size_t length, PacketView &view);
     static PacketInfo parsePacket(const uint8_t *packet, int length);
+
+    static const char *protocolName(Protocol protocol);
+    static std::string addressToString(const uint8_t *addr, uint8_t ip_version);
     static std::string ipToString(uint32_t ip);
     static uint16_t ntohs_custom(uint16_t value);
     static uint32_t ntohl_custom(uint32_t value);
-    static std::string getCurrentTimestamp();
     static std::string bytesToHex(const uint8_t *data, int length, int max_bytes = 64);
 
 private:
-    static PacketInfo parseTCP(const IPHeader *ip_header, const uint8_t *packet, int length);
-    static PacketInfo parseUDP(const IPHeader *ip_header, const uint8_t *packet, int length);
+    static bool parseTransport(const uint8_t *packet, size_t length, PacketView &view);
 };
 
 #endif // PACKET_PARSER_H
@@ -0,0 +1,114 @@
+#include "packet_pool.h"
+
+// Buffers start on a cache line so neighbouring packets never share one
+static const size_t BUFFER_ALIGNMENT = 64;
+
+PacketPool::PacketPool(size_t buffers, size_t jumbo_buffers)
+{
+    initClass(classes_[0], 0, BUFFER_SIZE, buffers);
+    initClass(classes_[1], 1, JUMBO_BUFFER_SIZE, jumbo_buffers);
+}
+
+void PacketPool::initClass(SizeClass &size_class, uint8_t id, uint32_t buffer_size, size_t count)
+{
+    size_class.buffer_size = buffer_size;
+    size_class.count = count;
+    size_class.descriptors.reset(new PacketBuffer[count]);
+    size_class.slab.resize(count * buffer_size + BUFFER_ALIGNMENT);
+    size_class.free_head.store(0, std::memory_order_relaxed);
+    size_class.in_use.store(0, std::memory_order_relaxed);
+    size_class.exhausted.store(0, std::memory_order_relaxed);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(size_class.slab.data());
+    uint8_t *aligned = size_class.slab.data() + ((BUFFER_ALIGNMENT - base % BUFFER_ALIGNMENT) % BUFFER_ALIGNMENT);
+
+    // Pushed in reverse so the first acquisitions walk the slab in order
+    for (size_t i = count; i-- > 0;)
+    {
+        PacketBuffer &buffer = size_class.descriptors[i];
+        buffer.data = aligned + i * buffer_size;
+        buffer.capacity = buffer_size;
+        buffer.length = 0;
+        buffer.wire_length = 0;
+        buffer.timestamp_ns = 0;
+        buffer.refs.store(0, std::memory_order_relaxed);
+        buffer.index = static_cast<uint32_t>(i);
+        buffer.size_class = id;
+        push(size_class, &buffer);
+    }
+}
+
+PacketBuffer *PacketPool::pop(SizeClass &size_class)
+{
+    uint64_t head = size_class.free_head.load(std::memory_order_acquire);
+    while (static_cast<uint32_t>(head) != 0)
+    {
+        PacketBuffer *buffer = &size_class.descriptors[static_cast<uint32_t>(head) - 1];
+        // May read a link another thread is rewriting; the tag makes that CAS fail
+        uint64_t next = buffer->next_free.load(std::memory_order_relaxed);
+        uint64_t replacement = ((head >> 32) + 1) << 32 | next;
+        if (size_class.free_head.compare_exchange_weak(head, replacement, std::memory_order_acquire,
+                                                       std::memory_order_acquire))
+        {
+            return buffer;
+        }
+    }
+    return nullptr;
+}
+
+void PacketPool::push(SizeClass &size_class, PacketBuffer *buffer)
+{
+    uint64_t head = size_class.free_head.load(std::memory_order_relaxed);
+    uint64_t replacement;
+    do
+    {
+        buffer->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        replacement = ((head >> 32) + 1) << 32 | (buffer->index + 1);
+    } while (!size_class.free_head.compare_exchange_weak(head, replacement, std::memory_order_release,
+                                                         std::memory_order_relaxed));
+}
+
+PacketBuffer *PacketPool::acquire(size_t size)
+{
+    SizeClass &size_class = classes_[size <= BUFFER_SIZE ? 0 : 1];
+    if (size > size_class.buffer_size)
+    {
+        return nullptr;
+    }
+
+    PacketBuffer *buffer = pop(size_class);
+    if (!buffer)
+    {
+        size_class.exhausted.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    size_class.in_use.fetch_add(1, std::memory_order_relaxed);
+    buffer->refs.store(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+void PacketPool::release(PacketBuffer *buffer)
+{
+    // acq_rel so every holder's reads of the data finish before it is reused
+    if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    SizeClass &size_class = classes_[buffer->size_class];
+    size_class.in_use.fetch_sub(1, std::memory_order_relaxed);
+    push(size_class, buffer);
+}
+
+PacketPoolStats PacketPool::stats() const
+{
+    PacketPoolStats stats;
+    stats.buffers = classes_[0].count;
+    stats.in_use = classes_[0].in_use.load(std::memory_order_relaxed);
+    stats.exhausted = classes_[0].exhausted.load(std::memory_order_relaxed);
+    stats.jumbo_buffers = classes_[1].count;
+    stats.jumbo_in_use = classes_[1].in_use.load(std::memory_order_relaxed);
+    stats.jumbo_exhausted = classes_[1].exhausted.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,89 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Descriptor of one pooled packet buffer. A captured packet travels
+// between stages as a PacketBuffer pointer; every stage holding it owns
+// one reference and drops it with PacketPool::release().
+struct PacketBuffer
+{
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t length;      // bytes held in data
+    uint32_t wire_length; // bytes on the wire
+    uint64_t timestamp_ns;
+    std::atomic<uint32_t> refs;
+    std::atomic<uint32_t> next_free; // freelist link, only meaningful while free
+    uint32_t index;                  // position within its size class
+    uint8_t size_class;
+};
+
+struct PacketPoolStats
+{
+    size_t buffers;
+    size_t in_use;
+    uint64_t exhausted;
+    size_t jumbo_buffers;
+    size_t jumbo_in_use;
+    uint64_t jumbo_exhausted;
+};
+
+// Fixed slabs of MTU-sized and jumbo buffers, allocated once. Free
+// buffers sit on a lock-free (tagged Treiber stack) freelist per size
+// class, so the capture thread allocates and any stage frees without a
+// lock. An empty class fails the request and counts it; there is no
+// malloc fallback.
+class PacketPool
+{
+public:
+    // Holds any datagram read from the TUN interface
+    static const uint32_t BUFFER_SIZE = 2048;
+    // Covers GRO/TSO super-frames seen by rooted capture
+    static const uint32_t JUMBO_BUFFER_SIZE = 65536;
+
+    PacketPool(size_t buffers, size_t jumbo_buffers);
+
+    PacketPool(const PacketPool &) = delete;
+    PacketPool &operator=(const PacketPool &) = delete;
+
+    // A buffer of at least `size` bytes with one reference, or nullptr when
+    // its size class is exhausted
+    PacketBuffer *acquire(size_t size);
+
+    static void retain(PacketBuffer *buffer, uint32_t count = 1)
+    {
+        buffer->refs.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Drops one reference; the last one returns the buffer to its freelist
+    void release(PacketBuffer *buffer);
+
+    PacketPoolStats stats() const;
+
+private:
+    struct SizeClass
+    {
+        uint32_t buffer_size;
+        size_t count;
+        std::unique_ptr<PacketBuffer[]> descriptors;
+        std::vector<uint8_t> slab;
+        // Low 32 bits: index + 1 of the top free buffer (0 = empty); high
+        // 32 bits: a tag bumped on every update so a stale pop cannot succeed
+        std::atomic<uint64_t> free_head;
+        std::atomic<size_t> in_use;
+        std::atomic<uint64_t> exhausted;
+    };
+
+    static void initClass(SizeClass &size_class, uint8_t id, uint32_t buffer_size, size_t count);
+    static PacketBuffer *pop(SizeClass &size_class);
+    static void push(SizeClass &size_class, PacketBuffer *buffer);
+
+    SizeClass classes_[2];
+};
+
+#endif // PACKET_POOL_H
@@ -0,0 +1,207 @@
+#include "pcap_capture.h"
+#include "capture_filter.h"
+
+#define TAG "PcapCapture"
+#include "native_log.h"
+
+void CaptureTunables::sanitize()
+{
+    if (buffer_size_bytes < 256 * 1024)
+        buffer_size_bytes = 256 * 1024;
+    if (buffer_size_bytes > 256 * 1024 * 1024)
+        buffer_size_bytes = 256 * 1024 * 1024;
+    if (timeout_ms < 1)
+        timeout_ms = 1;
+    if (timeout_ms > 1000)
+        timeout_ms = 1000;
+    if (snaplen < 96)
+        snaplen = 96;
+    if (snaplen > 262144)
+        snaplen = 262144;
+}
+
+PcapCapture::PcapCapture() : handle_(nullptr), snaplen_(65535), fraction_scale_(1000), filter_pending_(false)
+{
+}
+
+PcapCapture::~PcapCapture()
+{
+    close();
+}
+
+bool PcapCapture::open(const char *const *devices, int device_count, const CaptureTunables &tunables)
+{
+    close();
+
+    for (int i = 0; i < device_count; i++)
+    {
+        pcap_t *handle = activate(devices[i], tunables);
+        if (handle)
+        {
+            device_ = devices[i];
+            snaplen_ = tunables.snaplen;
+            fraction_scale_ = pcap_get_tstamp_precision(handle) == PCAP_TSTAMP_PRECISION_NANO ? 1 : 1000;
+            handle_ = handle;
+            // Install any filter set while capture was stopped
+            applyPendingFilter(handle);
+            LOGD("Opened %s: ring %d bytes, block timeout %d ms, snaplen %d%s", devices[i],
+                 tunables.buffer_size_bytes, tunables.timeout_ms, tunables.snaplen,
+                 tunables.immediate_mode ? ", immediate" : "");
+            return true;
+        }
+    }
+
+    return false;
+}
+
+pcap_t *PcapCapture::activate(const char *device, const CaptureTunables &tunables)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_create(device, errbuf);
+    if (!handle)
+    {
+        LOGD("Failed to create handle for %s: %s", device, errbuf);
+        return nullptr;
+    }
+
+    // These only fail on an already activated handle
+    if (pcap_set_snaplen(handle, tunables.snaplen) != 0 ||
+        pcap_set_promisc(handle, 1) != 0 ||
+        pcap_set_timeout(handle, tunables.timeout_ms) != 0 ||
+        pcap_set_buffer_size(handle, tunables.buffer_size_bytes) != 0 ||
+        pcap_set_immediate_mode(handle, tunables.immediate_mode ? 1 : 0) != 0)
+    {
+        LOGE("Failed to configure %s", device);
+        pcap_close(handle);
+        return nullptr;
+    }
+
+    // Best effort: without it timestamps stay in microseconds
+    if (pcap_set_tstamp_precision(handle, PCAP_TSTAMP_PRECISION_NANO) != 0)
+    {
+        LOGD("Nanosecond timestamps not supported on %s", device);
+    }
+
+    int status = pcap_activate(handle);
+    if (status < 0)
+    {
+        LOGD("Failed to activate %s: %s", device,
+             status == PCAP_ERROR ? pcap_geterr(handle) : pcap_statustostr(status));
+        pcap_close(handle);
+        return nullptr;
+    }
+    if (status > 0)
+    {
+        LOGD("Activated %s with warning: %s", device,
+             status == PCAP_WARNING ? pcap_geterr(handle) : pcap_statustostr(status));
+    }
+
+    return handle;
+}
+
+void PcapCapture::close()
+{
+    std::lock_guard<std::mutex> lock(close_mutex_);
+    pcap_t *handle = handle_.exchange(nullptr);
+    if (handle)
+    {
+        pcap_close(handle);
+    }
+    device_.clear();
+}
+
+bool PcapCapture::setFilter(const std::string &expression, std::string &error)
+{
+    // Compile once up front so syntax errors reach the caller synchronously
+    CaptureFilter validated;
+    if (!validated.compile(expression, datalink(), snaplen_, error))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(filter_mutex_);
+    filter_expression_ = expression;
+    filter_pending_ = true;
+    return true;
+}
+
+void PcapCapture::applyPendingFilter(pcap_t *handle)
+{
+    std::string expression;
+    {
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        expression = filter_expression_;
+        filter_pending_ = false;
+    }
+
+    // An empty expression compiles to accept-all, replacing any installed filter
+    struct bpf_program program;
+    if (pcap_compile(handle, &program, expression.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0)
+    {
+        LOGE("Failed to compile filter '%s': %s", expression.c_str(), pcap_geterr(handle));
+        return;
+    }
+
+    if (pcap_setfilter(handle, &program) != 0)
+    {
+        LOGE("Failed to install filter '%s': %s", expression.c_str(), pcap_geterr(handle));
+    }
+    else
+    {
+        LOGD("Capture filter set: '%s'", expression.c_str());
+    }
+    pcap_freecode(&program);
+}
+
+int PcapCapture::dispatch(pcap_handler handler, u_char *user)
+{
+    pcap_t *handle = handle_;
+    if (!handle)
+    {
+        return PCAP_ERROR_NOT_ACTIVATED;
+    }
+
+    if (filter_pending_)
+    {
+        applyPendingFilter(handle);
+    }
+
+    // cnt = -1 processes everything in the ready blocks in one call
+    return pcap_dispatch(handle, -1, handler, user);
+}
+
+void PcapCapture::breakLoop()
+{
+    std::lock_guard<std::mutex> lock(close_mutex_);
+    pcap_t *handle = handle_;
+    if (handle)
+    {
+        pcap_breakloop(handle);
+    }
+}
+
+bool PcapCapture::stats(uint64_t &received, uint64_t &dropped) const
+{
+    pcap_t *handle = handle_;
+    struct pcap_stat stat;
+    if (!handle || pcap_stats(handle, &stat) != 0)
+    {
+        return false;
+    }
+
+    received = stat.ps_recv;
+    dropped = static_cast<uint64_t>(stat.ps_drop) + stat.ps_ifdrop;
+    return true;
+}
+
+int PcapCapture::datalink() const
+{
+    pcap_t *handle = handle_;
+    return handle ? pcap_datalink(handle) : DLT_EN10MB;
+}
+
+const char *PcapCapture::lastError() const
+{
+    pcap_t *handle = handle_;
+    return handle ? pcap_geterr(handle) : "capture not open";
+}
@@ -0,0 +1,85 @@
+#ifndef PCAP_CAPTURE_H
+#define PCAP_CAPTURE_H
+
+#include <pcap/pcap.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Settings applied when a rooted capture handle is activated. On Linux
+// libpcap backs the handle with a TPACKET_V3 memory-mapped ring split into
+// blocks: buffer_size_bytes sizes the ring and timeout_ms is how long the
+// kernel holds a partly filled block before handing it over. Each
+// pcap_dispatch() then walks every frame in the blocks that are ready.
+struct CaptureTunables
+{
+    int buffer_size_bytes;
+    int timeout_ms;
+    int snaplen;
+    // Deliver each packet as it arrives. libpcap uses TPACKET_V2 for this,
+    // trading the block batching for latency.
+    bool immediate_mode;
+
+    CaptureTunables() : buffer_size_bytes(8 * 1024 * 1024), timeout_ms(100),
+                        snaplen(65535), immediate_mode(false) {}
+
+    // Clamp user-supplied values into ranges libpcap accepts
+    void sanitize();
+};
+
+// Owns the pcap handle used by rooted capture. open() and dispatch() run on
+// the capture thread; breakLoop() may be called from any thread.
+class PcapCapture
+{
+public:
+    PcapCapture();
+    ~PcapCapture();
+
+    // Activates the first of `devices` that can be opened
+    bool open(const char *const *devices, int device_count, const CaptureTunables &tunables);
+    void close();
+    bool isOpen() const { return handle_ != nullptr; }
+
+    // Validates `expression` against the capture's link type and queues it.
+    // The capture thread installs it in the kernel before its next
+    // dispatch, so a running capture switches filters without reopening.
+    // The filter also carries over to later opens; "" removes it.
+    bool setFilter(const std::string &expression, std::string &error);
+
+    // Returns the number of packets handled, 0 on timeout, PCAP_ERROR_BREAK
+    // after breakLoop(), or another negative pcap error
+    int dispatch(pcap_handler handler, u_char *user);
+    void breakLoop();
+
+    // Kernel counters since open(); dropped includes interface drops
+    bool stats(uint64_t &received, uint64_t &dropped) const;
+    const char *lastError() const;
+    const std::string &device() const { return device_; }
+    int datalink() const;
+
+    // Capture time of a packet from this handle, in ns since the epoch.
+    // Handles are opened with nanosecond precision where the kernel allows.
+    uint64_t timestampNs(const struct pcap_pkthdr *header) const
+    {
+        return static_cast<uint64_t>(header->ts.tv_sec) * 1000000000ULL +
+               static_cast<uint64_t>(header->ts.tv_usec) * fraction_scale_;
+    }
+
+private:
+    static pcap_t *activate(const char *device, const CaptureTunables &tunables);
+    void applyPendingFilter(pcap_t *handle);
+
+    std::atomic<pcap_t *> handle_;
+    // The capture thread may close the handle while another thread breaks its loop
+    std::mutex close_mutex_;
+    std::string device_;
+    int snaplen_;
+    uint32_t fraction_scale_; // ns per unit of pkthdr.ts.tv_usec
+
+    std::mutex filter_mutex_;
+    std::string filter_expression_;
+    std::atomic<bool> filter_pending_;
+};
+
+#endif // PCAP_CAPTURE_H
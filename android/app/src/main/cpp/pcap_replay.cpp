@@ -0,0 +1,164 @@
+#include "pcap_replay.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#define TAG "PcapReplay"
+#include "native_log.h"
+
+PcapReplay::PcapReplay() : handle_(nullptr), stop_requested_(false)
+{
+}
+
+PcapReplay::~PcapReplay()
+{
+    close();
+}
+
+bool PcapReplay::open(const std::string &path, std::string &error)
+{
+    close();
+    path_ = path;
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    errbuf[0] = '\0';
+    // Handles pcapng as well; nanosecond precision keeps recorded timestamps exact
+    handle_ = pcap_open_offline_with_tstamp_precision(path.c_str(), PCAP_TSTAMP_PRECISION_NANO, errbuf);
+    if (!handle_)
+    {
+        error = errbuf;
+        return false;
+    }
+
+    decoder_.reset(new LinkDecoder(pcap_datalink(handle_)));
+    if (!decoder_->supported())
+    {
+        error = std::string("unsupported link type ") + decoder_->name();
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PcapReplay::close()
+{
+    if (handle_)
+    {
+        pcap_close(handle_);
+        handle_ = nullptr;
+    }
+    decoder_.reset();
+}
+
+int PcapReplay::datalink() const
+{
+    return decoder_ ? decoder_->linktype() : -1;
+}
+
+// pcap has no rewind, so each extra loop reopens the file
+bool PcapReplay::rewind(std::string &error)
+{
+    std::string path = path_;
+    return open(path, error);
+}
+
+bool PcapReplay::run(CapturePipeline &pipeline, const ReplayOptions &options, ReplayResult &result,
+                     std::string &error)
+{
+    if (!handle_)
+    {
+        error = "no capture file open";
+        return false;
+    }
+
+    stop_requested_ = false;
+    PacketPool &pool = pipeline.pool();
+    double speed = options.speed > 0.0 ? options.speed : 1.0;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t loop_offset_ns = 0;
+    bool ok = true;
+
+    for (int loop = 0; loop < std::max(options.loops, 1) && !stop_requested_; ++loop)
+    {
+        if (loop > 0 && !rewind(error))
+        {
+            ok = false;
+            break;
+        }
+
+        auto loop_start = std::chrono::steady_clock::now();
+        uint64_t first_ns = 0;
+        uint64_t last_ns = 0;
+        struct pcap_pkthdr *header;
+        const u_char *frame;
+        int status = 0;
+
+        while (!stop_requested_ && (status = pcap_next_ex(handle_, &header, &frame)) == 1)
+        {
+            // Opened with nanosecond precision, so tv_usec holds nanoseconds
+            uint64_t timestamp_ns = static_cast<uint64_t>(header->ts.tv_sec) * 1000000000ULL +
+                                    static_cast<uint64_t>(header->ts.tv_usec);
+            if (first_ns == 0)
+            {
+                first_ns = timestamp_ns;
+            }
+            last_ns = std::max(last_ns, timestamp_ns);
+
+            if (!options.fast && timestamp_ns > first_ns)
+            {
+                auto due = loop_start + std::chrono::nanoseconds(
+                                            static_cast<uint64_t>((timestamp_ns - first_ns) / speed));
+                std::this_thread::sleep_until(due);
+            }
+
+            int offset = decoder_->networkOffset(frame, header->caplen);
+            if (offset < 0)
+            {
+                result.skipped++;
+                continue;
+            }
+
+            size_t length = std::min<size_t>(header->caplen - offset, PacketPool::JUMBO_BUFFER_SIZE);
+            PacketBuffer *buffer = pool.acquire(length);
+            // Fast mode measures the pipeline, not the pool size, so it waits for a buffer
+            while (!buffer && options.fast && !stop_requested_)
+            {
+                std::this_thread::yield();
+                buffer = pool.acquire(length);
+            }
+            if (!buffer)
+            {
+                result.skipped++;
+                continue;
+            }
+
+            buffer->timestamp_ns = timestamp_ns + loop_offset_ns;
+            buffer->length = static_cast<uint32_t>(length);
+            buffer->wire_length = header->len - offset;
+            std::memcpy(buffer->data, frame + offset, length);
+            pipeline.submit(buffer, options.fast);
+
+            result.packets++;
+            result.bytes += header->len;
+        }
+
+        if (!stop_requested_ && status == PCAP_ERROR)
+        {
+            error = pcap_geterr(handle_);
+            ok = false;
+            break;
+        }
+
+        // Later loops continue the capture clock so flow ageing stays monotonic
+        loop_offset_ns += last_ns - first_ns + 1;
+    }
+
+    result.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    LOGD("Replayed %llu packets in %.3f s (%.0f packets/sec)", static_cast<unsigned long long>(result.packets),
+         result.elapsed_ns / 1e9, result.packetsPerSecond());
+    return ok;
+}
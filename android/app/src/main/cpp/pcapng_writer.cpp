@@ -0,0 +1,410 @@
+#include "pcapng_writer.h"
+#include "capture_clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TAG "PcapngWriter"
+#include "native_log.h"
+
+// Block types and options from the pcapng spec (draft-ietf-opsawg-pcapng)
+static const uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+static const uint32_t INTERFACE_DESCRIPTION_BLOCK = 0x00000001;
+static const uint32_t ENHANCED_PACKET_BLOCK = 0x00000006;
+static const uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static const uint16_t OPT_ENDOFOPT = 0;
+static const uint16_t OPT_SHB_USERAPPL = 4;
+static const uint16_t OPT_IF_TSRESOL = 9;
+static const uint16_t LINKTYPE_RAW = 101;
+static const char USER_APPLICATION[] = "packet_analyzer";
+
+// Enhanced packet block: type, length, interface, timestamp (2), captured
+// and original length ahead of the data, the length repeated after it
+static const size_t EPB_HEADER_BYTES = 28;
+static const size_t BLOCK_TRAILER_BYTES = 4;
+
+// Blocks start on a page so the kernel copies whole pages per write()
+static const size_t BLOCK_ALIGNMENT = 4096;
+
+// A partly filled block goes to disk after this long, so the file trails
+// the capture by about a second when traffic is light
+static const uint64_t FLUSH_INTERVAL_MS = 1000;
+static const uint64_t DROP_REPORT_INTERVAL_MS = 5000;
+static const int WRITER_IDLE_WAIT_MS = 100;
+
+const size_t PcapngWriter::BLOCK_SIZE;
+const size_t PcapngWriter::BLOCK_COUNT;
+
+static size_t pad4(size_t length)
+{
+    return (length + 3) & ~static_cast<size_t>(3);
+}
+
+static uint8_t *put16(uint8_t *out, uint16_t value)
+{
+    std::memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+static uint8_t *put32(uint8_t *out, uint32_t value)
+{
+    std::memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+static uint8_t *putOption(uint8_t *out, uint16_t code, const void *value, uint16_t length)
+{
+    out = put16(out, code);
+    out = put16(out, length);
+    std::memcpy(out, value, length);
+    std::memset(out + length, 0, pad4(length) - length);
+    return out + pad4(length);
+}
+
+PcapngWriter::PcapngWriter()
+    : max_file_ns_(0), free_(BLOCK_COUNT), full_(BLOCK_COUNT), current_(nullptr), file_bytes_(0),
+      file_packets_(0), file_start_ns_(0), reported_dropped_(0), last_report_ms_(0), packets_(0), dropped_(0),
+      fd_(-1), file_index_(0), bytes_written_(0), failed_(false), running_(false)
+{
+    slab_.resize(BLOCK_COUNT * BLOCK_SIZE + BLOCK_ALIGNMENT);
+    uintptr_t base = reinterpret_cast<uintptr_t>(slab_.data());
+    uint8_t *aligned = slab_.data() + ((BLOCK_ALIGNMENT - base % BLOCK_ALIGNMENT) % BLOCK_ALIGNMENT);
+
+    for (size_t i = 0; i < BLOCK_COUNT; ++i)
+    {
+        blocks_[i].data = aligned + i * BLOCK_SIZE;
+        blocks_[i].used = 0;
+        blocks_[i].new_file = false;
+        blocks_[i].started_ms = 0;
+        free_.push(&blocks_[i]);
+    }
+}
+
+PcapngWriter::~PcapngWriter()
+{
+    close();
+}
+
+bool PcapngWriter::open(const PcapngOptions &options, std::string &error)
+{
+    close();
+
+    options_ = options;
+    if (options_.snaplen == 0 || options_.snaplen > PacketPool::JUMBO_BUFFER_SIZE)
+    {
+        options_.snaplen = PacketPool::JUMBO_BUFFER_SIZE;
+    }
+    max_file_ns_ = static_cast<uint64_t>(options_.max_file_seconds) * 1000000000ULL;
+    packets_ = 0;
+    dropped_ = 0;
+    bytes_written_ = 0;
+    failed_ = false;
+    reported_dropped_ = 0;
+    last_report_ms_ = 0;
+    file_index_ = 0;
+    files_.clear();
+
+    // Opened here rather than by the writer thread so a bad path fails the call
+    if (!openFile(error))
+    {
+        return false;
+    }
+
+    // The first file is already open, so its headers need no rotation
+    nextBlock(false);
+    writeHeaders(*current_);
+    file_bytes_ = current_->used;
+    file_packets_ = 0;
+
+    running_ = true;
+    thread_ = std::thread(&PcapngWriter::runWriter, this);
+    return true;
+}
+
+void PcapngWriter::close()
+{
+    if (!running_)
+    {
+        return;
+    }
+
+    submitBlock();
+    running_ = false;
+    full_.wake();
+    thread_.join();
+
+    if (fd_ != -1)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    PcapngStats summary = stats();
+    LOGD("Recorded %llu packets (%llu dropped, %llu bytes) into %u file(s)",
+         static_cast<unsigned long long>(summary.packets), static_cast<unsigned long long>(summary.dropped),
+         static_cast<unsigned long long>(summary.bytes_written), summary.files);
+}
+
+void PcapngWriter::writeHeaders(Block &block)
+{
+    uint8_t *start = block.data + block.used;
+
+    uint8_t *out = start;
+    uint8_t *length = out + 4;
+    out = put32(out, SECTION_HEADER_BLOCK);
+    out = put32(out, 0);
+    out = put32(out, BYTE_ORDER_MAGIC);
+    out = put16(out, 1); // version 1.0
+    out = put16(out, 0);
+    out = put32(out, 0xFFFFFFFF); // section length unknown (-1)
+    out = put32(out, 0xFFFFFFFF);
+    out = putOption(out, OPT_SHB_USERAPPL, USER_APPLICATION, sizeof(USER_APPLICATION) - 1);
+    out = put32(out, OPT_ENDOFOPT);
+    uint32_t total = static_cast<uint32_t>(out - start + BLOCK_TRAILER_BYTES);
+    put32(length, total);
+    out = put32(out, total);
+
+    // Buffers hold the IP datagram (TUN reads, or rooted capture with the
+    // link header stripped), so one raw-IP interface covers both modes
+    uint8_t *interface = out;
+    length = out + 4;
+    out = put32(out, INTERFACE_DESCRIPTION_BLOCK);
+    out = put32(out, 0);
+    out = put16(out, LINKTYPE_RAW);
+    out = put16(out, 0);
+    out = put32(out, options_.snaplen);
+    uint8_t resolution = 9; // 10^-9 s
+    out = putOption(out, OPT_IF_TSRESOL, &resolution, sizeof(resolution));
+    out = put32(out, OPT_ENDOFOPT);
+    total = static_cast<uint32_t>(out - interface + BLOCK_TRAILER_BYTES);
+    put32(length, total);
+    out = put32(out, total);
+
+    block.used += out - start;
+}
+
+// Producer: swap in an empty block, queueing the current one. Fails (and
+// keeps the current block) when every other block is still waiting on disk.
+bool PcapngWriter::nextBlock(bool new_file)
+{
+    Block **slot = free_.peek();
+    if (!slot)
+    {
+        return false;
+    }
+    Block *block = *slot;
+    free_.release();
+
+    submitBlock();
+    block->used = 0;
+    block->new_file = new_file;
+    block->started_ms = CaptureClock::monotonicMs();
+    current_ = block;
+
+    if (new_file)
+    {
+        writeHeaders(*block);
+        file_bytes_ = block->used;
+        file_packets_ = 0;
+    }
+    return true;
+}
+
+void PcapngWriter::submitBlock()
+{
+    if (current_)
+    {
+        // Never full: only BLOCK_COUNT blocks exist
+        full_.push(current_);
+        current_ = nullptr;
+    }
+}
+
+void PcapngWriter::write(const PacketBuffer &packet)
+{
+    uint32_t captured = std::min(packet.length, options_.snaplen);
+    size_t size = EPB_HEADER_BYTES + pad4(captured) + BLOCK_TRAILER_BYTES;
+
+    // Every file gets at least one packet, however small the limits
+    bool rotate = file_packets_ > 0 &&
+                  ((options_.max_file_bytes && file_bytes_ + size > options_.max_file_bytes) ||
+                   (max_file_ns_ && packet.timestamp_ns >= file_start_ns_ + max_file_ns_));
+
+    if (rotate || !current_ || current_->used + size > BLOCK_SIZE)
+    {
+        if (!nextBlock(rotate))
+        {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    if (file_packets_ == 0)
+    {
+        file_start_ns_ = packet.timestamp_ns;
+    }
+
+    uint8_t *out = current_->data + current_->used;
+    out = put32(out, ENHANCED_PACKET_BLOCK);
+    out = put32(out, static_cast<uint32_t>(size));
+    out = put32(out, 0); // interface id
+    out = put32(out, static_cast<uint32_t>(packet.timestamp_ns >> 32));
+    out = put32(out, static_cast<uint32_t>(packet.timestamp_ns));
+    out = put32(out, captured);
+    out = put32(out, std::max(packet.wire_length, captured));
+    std::memcpy(out, packet.data, captured);
+    std::memset(out + captured, 0, pad4(captured) - captured);
+    put32(out + pad4(captured), static_cast<uint32_t>(size));
+
+    current_->used += size;
+    file_bytes_ += size;
+    file_packets_++;
+    packets_.store(packets_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void PcapngWriter::poll(uint64_t now_ms)
+{
+    if (current_ && current_->used > 0 && now_ms - current_->started_ms >= FLUSH_INTERVAL_MS)
+    {
+        submitBlock();
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_ && now_ms - last_report_ms_ >= DROP_REPORT_INTERVAL_MS)
+    {
+        LOGE("Recorder falling behind: %llu packets dropped, %zu/%zu blocks waiting on disk",
+             static_cast<unsigned long long>(dropped - reported_dropped_), full_.stats().occupancy, BLOCK_COUNT);
+        reported_dropped_ = dropped;
+        last_report_ms_ = now_ms;
+    }
+}
+
+void PcapngWriter::runWriter()
+{
+    while (true)
+    {
+        if (!full_.waitForData(WRITER_IDLE_WAIT_MS))
+        {
+            if (!running_)
+            {
+                break;
+            }
+            continue;
+        }
+
+        while (Block **slot = full_.peek())
+        {
+            Block *block = *slot;
+            full_.release();
+            writeBlock(*block);
+            free_.push(block);
+        }
+    }
+}
+
+// Writer thread (or open() before it starts): opens the next file in the
+// sequence, retiring the oldest one in ring mode
+bool PcapngWriter::openFile(std::string &error)
+{
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%05u.pcapng", file_index_ + 1);
+    std::string path = options_.path_prefix + suffix;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    if (fd_ != -1)
+    {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    files_.push_back(path);
+    if (options_.ring_files > 0 && files_.size() > options_.ring_files)
+    {
+        ::unlink(files_.front().c_str());
+        files_.pop_front();
+    }
+
+    std::lock_guard<std::mutex> lock(file_mutex_);
+    file_index_++;
+    current_file_ = path;
+    return true;
+}
+
+void PcapngWriter::writeBlock(const Block &block)
+{
+    if (failed_)
+    {
+        return;
+    }
+
+    std::string error;
+    if (block.new_file && !openFile(error))
+    {
+        LOGE("Recording stopped: %s", error.c_str());
+        failed_ = true;
+        return;
+    }
+
+    const uint8_t *data = block.data;
+    size_t remaining = block.used;
+    while (remaining > 0)
+    {
+        ssize_t written = ::write(fd_, data, remaining);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOGE("Recording stopped, write failed: %s", std::strerror(errno));
+            failed_ = true;
+            return;
+        }
+        data += written;
+        remaining -= written;
+        bytes_written_.fetch_add(written, std::memory_order_relaxed);
+    }
+}
+
+PcapngStats PcapngWriter::stats() const
+{
+    PcapngStats stats;
+    {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        stats.file = current_file_;
+        stats.files = file_index_;
+    }
+    RingStats queue = full_.stats();
+    stats.packets = packets_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+    stats.pending_blocks = queue.occupancy;
+    stats.max_pending_blocks = queue.high_water;
+    stats.failed = failed_;
+    return stats;
+}
+
+std::string PcapngWriter::statsJson() const
+{
+    PcapngStats stats = this->stats();
+    std::string json = "{";
+    json += "\"file\":\"" + stats.file + "\",";
+    json += "\"files\":" + std::to_string(stats.files) + ",";
+    json += "\"packets\":" + std::to_string(stats.packets) + ",";
+    json += "\"dropped\":" + std::to_string(stats.dropped) + ",";
+    json += "\"bytesWritten\":" + std::to_string(stats.bytes_written) + ",";
+    json += "\"pendingBlocks\":" + std::to_string(stats.pending_blocks) + ",";
+    json += "\"maxPendingBlocks\":" + std::to_string(stats.max_pending_blocks) + ",";
+    json += "\"blocks\":" + std::to_string(BLOCK_COUNT) + ",";
+    json += std::string("\"failed\":") + (stats.failed ? "true" : "false");
+    json += "}";
+    return json;
+}
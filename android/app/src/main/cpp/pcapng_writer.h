@@ -0,0 +1,126 @@
+#ifndef PCAPNG_WRITER_H
+#define PCAPNG_WRITER_H
+
+#include "packet_pool.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PcapngOptions
+{
+    // Files are named <path_prefix>_00001.pcapng, _00002.pcapng, ...
+    std::string path_prefix;
+    uint64_t max_file_bytes;   // rotate before a file grows past this; 0 = no limit
+    uint32_t max_file_seconds; // rotate once a file spans this much capture time; 0 = no limit
+    uint32_t ring_files;       // keep only the newest N files; 0 keeps every file
+    uint32_t snaplen;
+
+    PcapngOptions() : max_file_bytes(0), max_file_seconds(0), ring_files(0), snaplen(65535) {}
+};
+
+struct PcapngStats
+{
+    std::string file; // file currently being written
+    uint32_t files;   // opened so far
+    uint64_t packets;
+    uint64_t dropped; // shed because every block was still waiting on the disk
+    uint64_t bytes_written;
+    size_t pending_blocks;
+    size_t max_pending_blocks;
+    bool failed;
+};
+
+// Streams captured datagrams to pcapng files (section, interface and
+// enhanced packet blocks; raw IP link type, nanosecond timestamps).
+//
+// Packets are encoded into a small set of large page-aligned blocks on the
+// caller's thread; full blocks are handed over an SPSC ring to a writer
+// thread that does the write() calls and file rotation. Encoding is a copy
+// and never waits on the disk: when every block is still queued the packet
+// is dropped and counted, and poll() logs that the recorder is falling
+// behind.
+//
+// write() and poll() must come from one thread (the pipeline's record
+// sink); close() from that thread too, or once it no longer uses the
+// writer. stats() is safe from any thread.
+class PcapngWriter
+{
+public:
+    static const size_t BLOCK_SIZE = 512 * 1024;
+    static const size_t BLOCK_COUNT = 8;
+
+    PcapngWriter();
+    ~PcapngWriter();
+
+    PcapngWriter(const PcapngWriter &) = delete;
+    PcapngWriter &operator=(const PcapngWriter &) = delete;
+
+    // Creates the first file and starts the writer thread
+    bool open(const PcapngOptions &options, std::string &error);
+    // Queues the partly filled block, waits for the disk and closes the file
+    void close();
+
+    void write(const PacketBuffer &packet);
+    // Hands a partly filled block to the disk once it has waited long
+    // enough and reports drops; call at least every few hundred ms
+    void poll(uint64_t now_ms);
+
+    PcapngStats stats() const;
+    std::string statsJson() const;
+
+private:
+    struct Block
+    {
+        uint8_t *data;
+        size_t used;
+        bool new_file; // rotate before writing this block
+        uint64_t started_ms;
+    };
+
+    bool nextBlock(bool new_file);
+    void submitBlock();
+    void writeHeaders(Block &block);
+
+    void runWriter();
+    bool openFile(std::string &error);
+    void writeBlock(const Block &block);
+
+    PcapngOptions options_;
+    uint64_t max_file_ns_;
+
+    std::vector<uint8_t> slab_;
+    Block blocks_[BLOCK_COUNT];
+    SpscRing<Block *> free_; // writer thread -> producer
+    SpscRing<Block *> full_; // producer -> writer thread
+
+    // Producer state
+    Block *current_;
+    uint64_t file_bytes_;
+    uint64_t file_packets_;
+    uint64_t file_start_ns_;
+    uint64_t reported_dropped_;
+    uint64_t last_report_ms_;
+    std::atomic<uint64_t> packets_;
+    std::atomic<uint64_t> dropped_;
+
+    // Writer thread state
+    int fd_;
+    uint32_t file_index_;
+    std::deque<std::string> files_;
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<bool> failed_;
+
+    mutable std::mutex file_mutex_; // guards current_file_
+    std::string current_file_;
+
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+#endif // PCAPNG_WRITER_H
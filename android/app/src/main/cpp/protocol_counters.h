@@ -0,0 +1,83 @@
+#ifndef PROTOCOL_COUNTERS_H
+#define PROTOCOL_COUNTERS_H
+
+#include "packet_parser.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Plain per-protocol totals, indexed by Protocol
+struct ProtocolTotals
+{
+    uint64_t packets[PROTOCOL_COUNT];
+    uint64_t bytes[PROTOCOL_COUNT];
+
+    ProtocolTotals()
+    {
+        for (size_t i = 0; i < PROTOCOL_COUNT; ++i)
+        {
+            packets[i] = 0;
+            bytes[i] = 0;
+        }
+    }
+};
+
+// Packet and byte counters per protocol for one writer thread. Every
+// counting thread owns a block; blocks are padded to whole cache lines so
+// no two writers share a line, and readers sum them with relaxed loads
+// while the writers keep going. With one writer an update is a relaxed
+// load/store on a line only that core writes: no lock, no atomic
+// read-modify-write and no lookup beyond indexing by the enum.
+class ProtocolCounterBlock
+{
+public:
+    ProtocolCounterBlock() { reset(); }
+
+    ProtocolCounterBlock(const ProtocolCounterBlock &) = delete;
+    ProtocolCounterBlock &operator=(const ProtocolCounterBlock &) = delete;
+
+    // Writer thread only
+    void add(Protocol protocol, uint32_t bytes)
+    {
+        Slot &slot = slots_[static_cast<size_t>(protocol)];
+        slot.packets.store(slot.packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot.bytes.store(slot.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+    }
+
+    // Writer thread only
+    void reset()
+    {
+        for (Slot &slot : slots_)
+        {
+            slot.packets.store(0, std::memory_order_relaxed);
+            slot.bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread; each counter is read atomically, the block as a whole is not
+    void addTo(ProtocolTotals &totals) const
+    {
+        for (size_t i = 0; i < PROTOCOL_COUNT; ++i)
+        {
+            totals.packets[i] += slots_[i].packets.load(std::memory_order_relaxed);
+            totals.bytes[i] += slots_[i].bytes.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    // A protocol's two counters sit together so one packet touches one line
+    struct Slot
+    {
+        std::atomic<uint64_t> packets;
+        std::atomic<uint64_t> bytes;
+    };
+
+    // Padding rather than alignas: heap blocks are not over-aligned before C++17
+    char head_pad_[CACHE_LINE];
+    Slot slots_[PROTOCOL_COUNT];
+    char tail_pad_[CACHE_LINE];
+};
+
+#endif // PROTOCOL_COUNTERS_H
@@ -0,0 +1,73 @@
+#include "session_key.h"
+
+SessionKey SessionKey::fromPacket(const PacketView &view)
+{
+    SessionKey key;
+    size_t addr_length = view.ip_version == 6 ? 16 : 4;
+
+    std::memcpy(key.bytes, view.source_addr, addr_length);
+    std::memcpy(key.bytes + addr_length, view.dest_addr, addr_length);
+
+    uint8_t *ports = key.bytes + 2 * addr_length;
+    ports[0] = static_cast<uint8_t>(view.source_port >> 8);
+    ports[1] = static_cast<uint8_t>(view.source_port);
+    ports[2] = static_cast<uint8_t>(view.dest_port >> 8);
+    ports[3] = static_cast<uint8_t>(view.dest_port);
+    ports[4] = view.ip_protocol;
+
+    key.length = static_cast<uint8_t>(2 * addr_length + 5);
+    return key;
+}
+
+SessionKey SessionKey::canonicalFromPacket(const PacketView &view, uint8_t &direction)
+{
+    SessionKey key;
+    size_t addr_length = view.ip_version == 6 ? 16 : 4;
+
+    // IPv4 addresses fill the first word and leave the second zero, so one
+    // comparison serves both families. Any consistent order will do; it
+    // need not be numeric.
+    uint64_t source[2] = {0, 0};
+    uint64_t dest[2] = {0, 0};
+    std::memcpy(source, view.source_addr, addr_length);
+    std::memcpy(dest, view.dest_addr, addr_length);
+    uint16_t source_port = view.source_port;
+    uint16_t dest_port = view.dest_port;
+
+    uint64_t reversed = (source[0] > dest[0]) |
+                        ((source[0] == dest[0]) &
+                         ((source[1] > dest[1]) | ((source[1] == dest[1]) & (source_port > dest_port))));
+    uint64_t mask = 0 - reversed;
+
+    uint64_t swap = (source[0] ^ dest[0]) & mask;
+    source[0] ^= swap;
+    dest[0] ^= swap;
+    swap = (source[1] ^ dest[1]) & mask;
+    source[1] ^= swap;
+    dest[1] ^= swap;
+    uint16_t port_swap = static_cast<uint16_t>((source_port ^ dest_port) & mask);
+    source_port ^= port_swap;
+    dest_port ^= port_swap;
+
+    std::memcpy(key.bytes, source, addr_length);
+    std::memcpy(key.bytes + addr_length, dest, addr_length);
+
+    uint8_t *ports = key.bytes + 2 * addr_length;
+    ports[0] = static_cast<uint8_t>(source_port >> 8);
+    ports[1] = static_cast<uint8_t>(source_port);
+    ports[2] = static_cast<uint8_t>(dest_port >> 8);
+    ports[3] = static_cast<uint8_t>(dest_port);
+    ports[4] = view.ip_protocol;
+
+    key.length = static_cast<uint8_t>(2 * addr_length + 5);
+    direction = static_cast<uint8_t>(reversed);
+    return key;
+}
+
+std::string SessionKey::toString() const
+{
+    return PacketParser::addressToString(sourceAddr(), ipVersion()) + ":" +
+           std::to_string(sourcePort()) + " -> " +
+           PacketParser::addressToString(destAddr(), ipVersion()) + ":" +
+           std::to_string(destPort()) + "/" + std::to_string(protocol());
+}
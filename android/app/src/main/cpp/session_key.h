@@ -0,0 +1,80 @@
+#ifndef SESSION_KEY_H
+#define SESSION_KEY_H
+
+#include "packet_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Packed binary 5-tuple: source address, destination address, source port,
+// destination port (all network byte order) and the IP protocol number.
+// IPv4 keys occupy 13 bytes, IPv6 keys 37. Bytes past `length` are always
+// zero so the key can be hashed and compared a word at a time.
+struct SessionKey
+{
+    static const size_t IPV4_LENGTH = 13;
+    static const size_t IPV6_LENGTH = 37;
+
+    uint8_t bytes[40];
+    uint8_t length;
+
+    SessionKey() : length(0)
+    {
+        std::memset(bytes, 0, sizeof(bytes));
+    }
+
+    static SessionKey fromPacket(const PacketView &view);
+    // The same key for both directions of a flow: whichever endpoint
+    // (address, port) orders lower is stored as the source. `direction` is
+    // 0 when the packet travels from that endpoint and 1 when it travels
+    // towards it. The endpoints are compared and swapped with masks, so
+    // the reply direction costs no branch mispredictions.
+    static SessionKey canonicalFromPacket(const PacketView &view, uint8_t &direction);
+
+    bool operator==(const SessionKey &other) const
+    {
+        return length == other.length && std::memcmp(bytes, other.bytes, length) == 0;
+    }
+
+    uint8_t ipVersion() const { return length == IPV6_LENGTH ? 6 : 4; }
+    size_t addressLength() const { return length == IPV6_LENGTH ? 16 : 4; }
+    const uint8_t *sourceAddr() const { return bytes; }
+    const uint8_t *destAddr() const { return bytes + addressLength(); }
+    uint16_t sourcePort() const { return readPort(2 * addressLength()); }
+    uint16_t destPort() const { return readPort(2 * addressLength() + 2); }
+    uint8_t protocol() const { return bytes[length - 1]; }
+
+    // "src:port -> dst:port/proto", for logging only
+    std::string toString() const;
+
+private:
+    uint16_t readPort(size_t offset) const
+    {
+        return static_cast<uint16_t>((bytes[offset] << 8) | bytes[offset + 1]);
+    }
+};
+
+struct SessionKeyHash
+{
+    std::size_t operator()(const SessionKey &key) const
+    {
+        uint64_t hash = key.length * 0x9E3779B97F4A7C15ULL;
+        size_t words = (key.length + 7) / 8;
+        for (size_t i = 0; i < words; ++i)
+        {
+            uint64_t word;
+            std::memcpy(&word, key.bytes + i * 8, sizeof(word));
+            hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+            hash ^= hash >> 32;
+        }
+
+        // murmur3 finalizer
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 33;
+        return static_cast<std::size_t>(hash);
+    }
+};
+
+#endif // SESSION_KEY_H
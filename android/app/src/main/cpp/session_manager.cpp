@@ -1,7 +1,30 @@
 #include "session_manager.h"
-#include <chrono>
+#include "capture_clock.h"
 #include <algorithm>
 #include <unistd.h>
+#include <netinet/in.h>
+
+// Each session may hold a socket, so the default stays well inside the
+// process's descriptor limit
+static const size_t DEFAULT_MAX_SESSIONS = 4096;
+static const size_t DEFAULT_SESSION_MEMORY_BYTES = 2 * 1024 * 1024;
+
+const size_t SessionManager::MAX_SESSIONS;
+const size_t SessionManager::CHUNK_SLOTS;
+const size_t SessionManager::MAX_CHUNKS;
+const uint32_t SessionManager::NO_SLOT;
+
+SessionManager::SessionManager()
+    : slot_count_(0), free_head_(NO_SLOT), max_sessions_(0), now_ms_(CaptureClock::monotonicMs()), evicted_(0),
+      expired_(0)
+{
+    for (auto &chunk : chunks_)
+    {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    setLimits(DEFAULT_MAX_SESSIONS, DEFAULT_SESSION_MEMORY_BYTES);
+    expiry_wheel_.advance(now_ms_, [](const TimerWheel::Entry &) {});
+}
 
 SessionManager &SessionManager::getInstance()
 {
@@ -9,50 +32,107 @@ SessionManager &SessionManager::getInstance()
     return instance;
 }
 
-SessionInfo *SessionManager::getSession(const SessionKey &key)
+SessionHandle SessionManager::openSession(const SessionKey &key)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = sessions_.find(key);
-    if (it != sessions_.end())
+    bool inserted = false;
+    uint32_t *index = sessions_.findOrInsert(key, inserted,
+                                             [this](const SessionKey &, uint32_t &evicted)
+                                             {
+                                                 // Its timer-wheel entry finds no session and lapses
+                                                 closeSocketLocked(slotAt(evicted));
+                                                 releaseLocked(evicted);
+                                                 evicted_++;
+                                             });
+    if (!inserted)
     {
-        return &it->second;
+        return SessionHandle(*index, slotAt(*index).generation.load(std::memory_order_relaxed));
     }
 
+    SessionHandle handle = allocateLocked(key);
+    if (!handle.valid())
+    {
+        sessions_.erase(key);
+        return handle;
+    }
+    *index = handle.index;
+
     // Create new session
-    SessionInfo new_session;
-    new_session.last_activity = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                    std::chrono::system_clock::now().time_since_epoch())
-                                    .count();
-    new_session.is_active = true;
+    SessionInfo &session = slotAt(handle.index);
+    session.last_activity = now_ms_;
+    session.expiry_deadline = now_ms_ + timeoutFor(session);
+    expiry_wheel_.schedule(key, session.expiry_deadline);
+    return handle;
+}
+
+int SessionManager::getSocketFd(const SessionKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint32_t *index = sessions_.find(key);
+    return index ? slotAt(*index).socket_fd : -1;
+}
+
+bool SessionManager::attachSocket(SessionHandle handle, int socket_fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    SessionInfo *session = liveSlot(handle);
+    if (!session || session->socket_fd != -1)
+    {
+        return false;
+    }
+    session->socket_fd = socket_fd;
+    return true;
+}
+
+bool SessionManager::readCounters(SessionHandle handle, SessionCounters &counters) const
+{
+    SessionInfo *session = liveSlot(handle);
+    if (!session)
+    {
+        return false;
+    }
+
+    counters.bytes_sent = session->bytes_sent.load(std::memory_order_relaxed);
+    counters.bytes_received = session->bytes_received.load(std::memory_order_relaxed);
+    counters.packets_sent = session->packets_sent.load(std::memory_order_relaxed);
+    counters.packets_received = session->packets_received.load(std::memory_order_relaxed);
 
-    sessions_[key] = new_session;
-    return &sessions_[key];
+    // Pairs with the fence in releaseLocked(): if the slot was recycled
+    // while the counters were read, the generation shows it
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return session->generation.load(std::memory_order_relaxed) == handle.generation;
 }
 
 void SessionManager::updateSession(const SessionKey &key, int bytes, bool is_outgoing)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = sessions_.find(key);
-    if (it != sessions_.end())
+    uint32_t *index = sessions_.find(key);
+    if (index)
     {
-        SessionInfo &session = it->second;
+        SessionInfo &session = slotAt(*index);
 
+        // The lock makes this the only writer; the stores are atomic for
+        // readCounters()
         if (is_outgoing)
         {
-            session.bytes_sent += bytes;
-            session.packets_sent++;
+            session.bytes_sent.store(session.bytes_sent.load(std::memory_order_relaxed) + bytes,
+                                     std::memory_order_relaxed);
+            session.packets_sent.store(session.packets_sent.load(std::memory_order_relaxed) + 1,
+                                       std::memory_order_relaxed);
         }
         else
         {
-            session.bytes_received += bytes;
-            session.packets_received++;
+            session.bytes_received.store(session.bytes_received.load(std::memory_order_relaxed) + bytes,
+                                         std::memory_order_relaxed);
+            session.packets_received.store(session.packets_received.load(std::memory_order_relaxed) + 1,
+                                           std::memory_order_relaxed);
         }
 
-        session.last_activity = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                    std::chrono::system_clock::now().time_since_epoch())
-                                    .count();
+        session.last_activity = now_ms_;
     }
 }
 
@@ -60,79 +140,256 @@ void SessionManager::closeSession(const SessionKey &key)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = sessions_.find(key);
-    if (it != sessions_.end())
+    uint32_t *index = sessions_.find(key);
+    if (index)
+    {
+        closeSocketLocked(slotAt(*index));
+        releaseLocked(*index);
+        sessions_.erase(key);
+    }
+}
+
+void SessionManager::markHalfClosed(const SessionKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint32_t *index = sessions_.find(key);
+    if (index && !slotAt(*index).half_closed)
+    {
+        SessionInfo &session = slotAt(*index);
+        session.half_closed = true;
+        rescheduleLocked(session);
+    }
+}
+
+void SessionManager::expireSessions(uint64_t now_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    expireLocked(now_ms);
+}
+
+void SessionManager::setLimits(size_t max_sessions, size_t memory_bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    max_sessions_ = std::min(max_sessions > 0 ? max_sessions : DEFAULT_MAX_SESSIONS, MAX_SESSIONS);
+    if (memory_bytes > 0)
+    {
+        // The budget is shared between the slab and the key index
+        size_t budget = memory_bytes / 2;
+        max_sessions_ = std::min(max_sessions_, std::min(FlowTable<uint32_t>::maxEntriesWithin(budget),
+                                                         budget / sizeof(SessionInfo)));
+    }
+    max_sessions_ = std::max<size_t>(max_sessions_, 1);
+    sessions_.setMaxSize(max_sessions_);
+}
+
+void SessionManager::setTimeouts(const SessionTimeouts &timeouts)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    timeouts_ = timeouts;
+    // A longer timeout is picked up when the current entry fires
+    for (size_t i = 0; i < slot_count_; ++i)
     {
-        if (it->second.socket_fd != -1)
+        SessionInfo &session = slotAt(static_cast<uint32_t>(i));
+        if (session.generation.load(std::memory_order_relaxed) & 1)
         {
-            close(it->second.socket_fd);
+            rescheduleLocked(session);
         }
-        sessions_.erase(it);
     }
 }
 
-void SessionManager::cleanupOldSessions()
+SessionTableStats SessionManager::stats() const
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    SessionTableStats stats;
+    stats.sessions = sessions_.size();
+    stats.max_sessions = max_sessions_;
+    stats.slab_slots = slot_count_;
+    stats.evicted = evicted_;
+    stats.expired = expired_;
+    return stats;
+}
+
+std::string SessionManager::statsJson() const
+{
+    SessionTableStats table = stats();
+    std::string json = "{";
+    json += "\"active\":" + std::to_string(table.sessions) + ",";
+    json += "\"limit\":" + std::to_string(table.max_sessions) + ",";
+    json += "\"slabSlots\":" + std::to_string(table.slab_slots) + ",";
+    json += "\"evicted\":" + std::to_string(table.evicted) + ",";
+    json += "\"expired\":" + std::to_string(table.expired);
+    json += "}";
+    return json;
+}
+
+void SessionManager::setSocketCloseHandler(std::function<void(int)> handler)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    socket_close_handler_ = std::move(handler);
+}
+
+void SessionManager::closeSocketLocked(SessionInfo &session)
+{
+    if (session.socket_fd == -1)
+    {
+        return;
+    }
 
-    uint64_t current_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                std::chrono::system_clock::now().time_since_epoch())
-                                .count();
+    if (socket_close_handler_)
+    {
+        socket_close_handler_(session.socket_fd);
+    }
+    close(session.socket_fd);
+    session.socket_fd = -1;
+}
+
+SessionInfo &SessionManager::slotAt(uint32_t index) const
+{
+    return chunks_[index / CHUNK_SLOTS].load(std::memory_order_acquire)[index % CHUNK_SLOTS];
+}
+
+SessionInfo *SessionManager::liveSlot(SessionHandle handle) const
+{
+    if (!handle.valid() || handle.index >= MAX_SESSIONS)
+    {
+        return nullptr;
+    }
+
+    SessionInfo *chunk = chunks_[handle.index / CHUNK_SLOTS].load(std::memory_order_acquire);
+    if (!chunk)
+    {
+        return nullptr;
+    }
+    SessionInfo &session = chunk[handle.index % CHUNK_SLOTS];
+    return session.generation.load(std::memory_order_acquire) == handle.generation ? &session : nullptr;
+}
 
-    auto it = sessions_.begin();
-    while (it != sessions_.end())
+SessionHandle SessionManager::allocateLocked(const SessionKey &key)
+{
+    uint32_t index;
+    if (free_head_ != NO_SLOT)
     {
-        if (current_time - it->second.last_activity > SESSION_TIMEOUT_MS)
+        index = free_head_;
+        free_head_ = slotAt(index).next_free;
+    }
+    else
+    {
+        if (slot_count_ == MAX_SESSIONS)
         {
-            if (it->second.socket_fd != -1)
-            {
-                close(it->second.socket_fd);
-            }
-            it = sessions_.erase(it);
+            return SessionHandle();
         }
-        else
+        size_t chunk = slot_count_ / CHUNK_SLOTS;
+        if (!chunk_storage_[chunk])
         {
-            ++it;
+            chunk_storage_[chunk].reset(new SessionInfo[CHUNK_SLOTS]);
+            chunks_[chunk].store(chunk_storage_[chunk].get(), std::memory_order_release);
         }
+        index = static_cast<uint32_t>(slot_count_++);
     }
+
+    SessionInfo &session = slotAt(index);
+    session.key = key;
+    session.socket_fd = -1;
+    session.half_closed = false;
+    session.bytes_sent.store(0, std::memory_order_relaxed);
+    session.bytes_received.store(0, std::memory_order_relaxed);
+    session.packets_sent.store(0, std::memory_order_relaxed);
+    session.packets_received.store(0, std::memory_order_relaxed);
+
+    // Free slots hold even generations, so a live one is odd and never 0
+    uint32_t generation = session.generation.load(std::memory_order_relaxed) + 1;
+    session.generation.store(generation, std::memory_order_release);
+    return SessionHandle(index, generation);
 }
 
-void SessionManager::updateProtocolStats(const std::string &protocol, int bytes)
+void SessionManager::releaseLocked(uint32_t index)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    SessionInfo &session = slotAt(index);
+    session.generation.store(session.generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // Readers that see anything written to the slot from here on also see
+    // the new generation
+    std::atomic_thread_fence(std::memory_order_release);
+
+    session.next_free = free_head_;
+    free_head_ = index;
+}
 
-    if (protocol_stats_.find(protocol) == protocol_stats_.end())
+uint64_t SessionManager::timeoutFor(const SessionInfo &session) const
+{
+    switch (session.key.protocol())
     {
-        protocol_stats_[protocol] = ProtocolStats(protocol);
+    case IPPROTO_TCP:
+        return session.half_closed ? timeouts_.tcp_half_closed_ms : timeouts_.tcp_established_ms;
+    case IPPROTO_UDP:
+        return timeouts_.udp_ms;
+    default:
+        return timeouts_.other_ms;
     }
-
-    protocol_stats_[protocol].packet_count++;
-    protocol_stats_[protocol].total_bytes += bytes;
 }
 
-std::vector<ProtocolStats> SessionManager::getProtocolStats()
+void SessionManager::rescheduleLocked(SessionInfo &session)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // The old entry no longer matches expiry_deadline when it fires, so it
+    // lapses
+    uint64_t deadline = session.last_activity + timeoutFor(session);
+    if (deadline < session.expiry_deadline)
+    {
+        session.expiry_deadline = deadline;
+        expiry_wheel_.schedule(session.key, deadline);
+    }
+}
 
-    std::vector<ProtocolStats> stats;
-    for (const auto &pair : protocol_stats_)
+void SessionManager::expireLocked(uint64_t now_ms)
+{
+    if (now_ms > now_ms_)
     {
-        stats.push_back(pair.second);
+        now_ms_ = now_ms;
     }
 
-    // Sort by packet count (descending)
-    std::sort(stats.begin(), stats.end(),
-              [](const ProtocolStats &a, const ProtocolStats &b)
-              {
-                  return a.packet_count > b.packet_count;
-              });
+    expiry_wheel_.advance(now_ms_, [this](const TimerWheel::Entry &entry)
+                          {
+                              uint32_t *index = sessions_.find(entry.key);
 
-    return stats;
+                              // Closed, or closed and recreated with a newer timer
+                              if (!index || slotAt(*index).expiry_deadline != entry.deadline_ms)
+                              {
+                                  return;
+                              }
+
+                              SessionInfo &session = slotAt(*index);
+                              uint64_t deadline = session.last_activity + timeoutFor(session);
+                              if (deadline > now_ms_)
+                              {
+                                  session.expiry_deadline = deadline;
+                                  expiry_wheel_.schedule(entry.key, deadline);
+                                  return;
+                              }
+
+                              closeSocketLocked(session);
+                              releaseLocked(*index);
+                              sessions_.erase(entry.key);
+                              expired_++;
+                          });
 }
 
-void SessionManager::resetStats()
+void SessionManager::reset()
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    protocol_stats_.clear();
+
+    // Live sessions sit in a few contiguous chunks, so this walks the slab
+    // rather than the sparser key index
+    for (size_t i = 0; i < slot_count_; ++i)
+    {
+        SessionInfo &session = slotAt(static_cast<uint32_t>(i));
+        if (session.generation.load(std::memory_order_relaxed) & 1)
+        {
+            closeSocketLocked(session);
+            releaseLocked(static_cast<uint32_t>(i));
+        }
+    }
     sessions_.clear();
+    expiry_wheel_.clear();
 }
@@ -1,62 +1,86 @@
 #ifndef SESSION_MANAGER_H
 #define SESSION_MANAGER_H
 
-#include <unordered_map>
+#include "flow_table.h"
+#include "session_key.h"
+#include "timer_wheel.h"
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 #include <mutex>
 #include <cstdint>
 
-struct SessionKey
+// Names a session for as long as it lives. Every slot carries a generation
+// that changes when its session is closed, evicted or expired, so a handle
+// kept past that point is recognised as stale instead of reaching the
+// slot's next occupant. A default-constructed handle names no session.
+struct SessionHandle
 {
-    std::string source_ip;
-    uint16_t source_port;
-    std::string dest_ip;
-    uint16_t dest_port;
-    std::string protocol;
+    uint32_t index;
+    uint32_t generation; // odd; 0 for no session
 
-    bool operator==(const SessionKey &other) const
-    {
-        return source_ip == other.source_ip &&
-               source_port == other.source_port &&
-               dest_ip == other.dest_ip &&
-               dest_port == other.dest_port &&
-               protocol == other.protocol;
-    }
-};
+    SessionHandle() : index(0), generation(0) {}
+    SessionHandle(uint32_t slot_index, uint32_t slot_generation) : index(slot_index), generation(slot_generation) {}
 
-struct SessionKeyHash
-{
-    std::size_t operator()(const SessionKey &key) const
-    {
-        return std::hash<std::string>()(key.source_ip + ":" +
-                                        std::to_string(key.source_port) + "->" +
-                                        key.dest_ip + ":" +
-                                        std::to_string(key.dest_port) + ":" +
-                                        key.protocol);
-    }
+    bool valid() const { return generation != 0; }
 };
 
-struct SessionInfo
+struct SessionCounters
 {
-    int socket_fd;
     uint64_t bytes_sent;
     uint64_t bytes_received;
     uint64_t packets_sent;
     uint64_t packets_received;
+};
+
+// One slab slot. Slots never move, so handles and lock-free readers can
+// index them directly.
+struct SessionInfo
+{
+    // Odd while the slot holds a session, even while it is free
+    std::atomic<uint32_t> generation;
+
+    // Hot counters: written under the manager's lock, read without it
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> bytes_received;
+    std::atomic<uint64_t> packets_sent;
+    std::atomic<uint64_t> packets_received;
+
+    // Manager's lock only
+    SessionKey key;
+    int socket_fd;
     uint64_t last_activity;
-    bool is_active;
+    uint64_t expiry_deadline; // deadline of this flow's live timer-wheel entry
+    bool half_closed;         // TCP flow that one side has finished sending on
+    uint32_t next_free;
 
-    SessionInfo() : socket_fd(-1), bytes_sent(0), bytes_received(0),
-                    packets_sent(0), packets_received(0), last_activity(0), is_active(false) {}
+    SessionInfo()
+        : generation(0), bytes_sent(0), bytes_received(0), packets_sent(0), packets_received(0), socket_fd(-1),
+          last_activity(0), expiry_deadline(0), half_closed(false), next_free(0)
+    {
+    }
 };
 
-struct ProtocolStats
+// Idle time after which a flow is expired, by protocol
+struct SessionTimeouts
 {
-    std::string protocol;
-    uint64_t packet_count;
-    uint64_t total_bytes;
+    uint64_t udp_ms;
+    uint64_t tcp_established_ms;
+    uint64_t tcp_half_closed_ms; // once either side has sent its FIN
+    uint64_t other_ms;
+
+    SessionTimeouts() : udp_ms(30000), tcp_established_ms(300000), tcp_half_closed_ms(30000), other_ms(60000) {}
+};
 
-    ProtocolStats(const std::string &proto = "") : protocol(proto), packet_count(0), total_bytes(0) {}
+struct SessionTableStats
+{
+    size_t sessions;
+    size_t max_sessions;
+    size_t slab_slots; // allocated, live or free
+    uint64_t evicted;  // to make room at the size limit
+    uint64_t expired;  // idle past their timeout
 };
 
 class SessionManager
@@ -64,22 +88,82 @@ class SessionManager
 public:
     static SessionManager &getInstance();
 
-    SessionInfo *getSession(const SessionKey &key);
+    // Most sessions the slab can hold, whatever the limits say
+    static const size_t MAX_SESSIONS = 65536;
+
+    // The key's session, created if needed; invalid only if the slab is
+    // exhausted
+    SessionHandle openSession(const SessionKey &key);
+    // Socket of an existing session, or -1; never creates a session
+    int getSocketFd(const SessionKey &key);
+    // Gives the session its socket. Fails, leaving the socket with the
+    // caller, if the handle is stale or the session already has one.
+    bool attachSocket(SessionHandle handle, int socket_fd);
+    // Any thread, without the lock. False once the handle is stale; the
+    // counters are each read atomically, not as a snapshot.
+    bool readCounters(SessionHandle handle, SessionCounters &counters) const;
     void updateSession(const SessionKey &key, int bytes, bool is_outgoing);
     void closeSession(const SessionKey &key);
-    void cleanupOldSessions();
+    // The app or the upstream end has finished sending on a TCP flow; from
+    // now on it idles out after tcp_half_closed_ms
+    void markHalfClosed(const SessionKey &key);
+
+    // Advance the session clock (monotonic ms, supplied by the capture loop)
+    // and expire flows that have been idle past their timeout
+    void expireSessions(uint64_t now_ms);
+    // Caps the table at max_sessions (0 for the default) and at
+    // memory_bytes of slots (0 for no memory bound). Past either, opening a
+    // session evicts the least recently used one (CLOCK), closing its
+    // socket like an expiry would.
+    void setLimits(size_t max_sessions, size_t memory_bytes);
+    // Idle timeouts; live sessions whose deadline moves earlier are
+    // rescheduled at once
+    void setTimeouts(const SessionTimeouts &timeouts);
+    SessionTableStats stats() const;
+    std::string statsJson() const;
 
-    void updateProtocolStats(const std::string &protocol, int bytes);
-    std::vector<ProtocolStats> getProtocolStats();
-    void resetStats();
+    // Called with the mutex held just before a session's socket is closed
+    void setSocketCloseHandler(std::function<void(int)> handler);
+
+    // Closes every session's socket and forgets all flows
+    void reset();
 
 private:
-    SessionManager() = default;
-    std::unordered_map<SessionKey, SessionInfo, SessionKeyHash> sessions_;
-    std::unordered_map<std::string, ProtocolStats> protocol_stats_;
-    std::mutex mutex_;
+    SessionManager();
+    uint64_t timeoutFor(const SessionInfo &session) const;
+    // Moves the session's wheel entry forward if its deadline came earlier
+    void rescheduleLocked(SessionInfo &session);
+    void expireLocked(uint64_t now_ms);
+    void closeSocketLocked(SessionInfo &session);
+    // Slot by index; lock-free for indices a handle has named
+    SessionInfo &slotAt(uint32_t index) const;
+    // The handle's slot, or null when the handle is stale
+    SessionInfo *liveSlot(SessionHandle handle) const;
+    SessionHandle allocateLocked(const SessionKey &key);
+    void releaseLocked(uint32_t index);
+
+    // Slots come in fixed chunks allocated as the slab grows; chunk
+    // pointers are published once and never change, so readers holding a
+    // handle need no lock to find its slot
+    static const size_t CHUNK_SLOTS = 256;
+    static const size_t MAX_CHUNKS = MAX_SESSIONS / CHUNK_SLOTS;
+    static const uint32_t NO_SLOT = 0xFFFFFFFF;
+
+    std::unique_ptr<SessionInfo[]> chunk_storage_[MAX_CHUNKS];
+    std::atomic<SessionInfo *> chunks_[MAX_CHUNKS];
+    size_t slot_count_;
+    uint32_t free_head_;
+    size_t max_sessions_;
 
-    static const uint64_t SESSION_TIMEOUT_MS = 300000; // 5 minutes
+    // Key -> slot index, bounded and evicting like the table it replaced
+    FlowTable<uint32_t> sessions_;
+    TimerWheel expiry_wheel_;
+    SessionTimeouts timeouts_;
+    uint64_t now_ms_;
+    std::function<void(int)> socket_close_handler_;
+    uint64_t evicted_;
+    uint64_t expired_;
+    mutable std::mutex mutex_;
 };
 
 #endif // SESSION_MANAGER_H
@@ -1,12 +1,18 @@
 #include "socket_forwarder.h"
+#include "tun_stack.h"
+#include "capture_clock.h"
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
-#include <android/log.h>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #define TAG "SocketForwarder"
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+#include "native_log.h"
+
+// Readiness events handled per epoll_wait() call
+static const int REACTOR_MAX_EVENTS = 64;
 
 SocketForwarder &SocketForwarder::getInstance()
 {
@@ -15,69 +21,146 @@ SocketForwarder &SocketForwarder::getInstance()
 }
 
 bool SocketForwarder::forwardPacket(const SessionKey &key, const uint8_t *packet, int length)
+{
+    if (SessionManager::getInstance().getSocketFd(key) == -1 && !openSession(key))
+    {
+        return false;
+    }
+
+    return sendToSession(key, packet, length) >= 0;
+}
+
+bool SocketForwarder::openSession(const SessionKey &key)
 {
     SessionManager &session_mgr = SessionManager::getInstance();
-    SessionInfo *session = session_mgr.getSession(key);
 
-    if (!session)
+    if (!is_running_ && !startReactor())
+    {
+        return false;
+    }
+
+    SessionHandle session = session_mgr.openSession(key);
+
+    if (!session.valid())
     {
         LOGE("Failed to get session for forwarding");
         return false;
     }
 
     // Create socket if not exists
-    if (session->socket_fd == -1)
+    if (session_mgr.getSocketFd(key) != -1)
     {
-        session->socket_fd = createSocket(key.protocol);
-        if (session->socket_fd == -1)
-        {
-            LOGE("Failed to create socket");
-            return false;
-        }
+        return true;
+    }
 
-        if (!connectToDestination(session->socket_fd, key.dest_ip, key.dest_port))
-        {
-            LOGE("Failed to connect to destination");
-            close(session->socket_fd);
-            session->socket_fd = -1;
-            return false;
-        }
+    int socket_fd = createSocket(key);
+    if (socket_fd == -1)
+    {
+        LOGE("Failed to create socket");
+        return false;
+    }
 
-        // Start thread to handle incoming data
-        std::thread data_thread(&SocketForwarder::handleSocketData, this,
-                                session->socket_fd, key);
-        data_thread.detach();
+    std::function<bool(int)> protector;
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+        protector = socket_protector_;
+    }
+    if (protector && !protector(socket_fd))
+    {
+        LOGE("Failed to protect socket %d", socket_fd);
+        close(socket_fd);
+        return false;
     }
 
-    // Forward the packet
-    ssize_t sent = send(session->socket_fd, packet, length, 0);
-    if (sent > 0)
+    if (!connectToDestination(socket_fd, key))
     {
-        session_mgr.updateSession(key, sent, true);
-        return true;
+        LOGE("Failed to connect to destination");
+        close(socket_fd);
+        return false;
     }
-    else
+
+    // Hand the socket to the reactor; TCP waits for the connect to complete first
+    if (!watchSocket(socket_fd, key, session, key.protocol() == IPPROTO_TCP))
+    {
+        close(socket_fd);
+        return false;
+    }
+
+    // The reactor may have closed the session, or an insertion evicted it,
+    // while the socket was being set up; the handle tells
+    if (!session_mgr.attachSocket(session, socket_fd))
     {
-        LOGE("Failed to send data: %d", errno);
+        LOGD("Session closed before its socket was attached");
+        unwatchSocket(socket_fd);
+        close(socket_fd);
         return false;
     }
+    return true;
 }
 
-int SocketForwarder::createSocket(const std::string &protocol)
+ssize_t SocketForwarder::sendToSession(const SessionKey &key, const uint8_t *data, size_t length)
+{
+    int socket_fd = SessionManager::getInstance().getSocketFd(key);
+    if (socket_fd == -1)
+    {
+        return -1;
+    }
+
+    ssize_t sent = send(socket_fd, data, length, MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+        SessionManager::getInstance().updateSession(key, sent, true);
+        return sent;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN))
+    {
+        return 0;
+    }
+
+    LOGE("Failed to send data: %d", errno);
+    return -1;
+}
+
+void SocketForwarder::shutdownSession(const SessionKey &key)
+{
+    int socket_fd = SessionManager::getInstance().getSocketFd(key);
+    if (socket_fd != -1)
+    {
+        shutdown(socket_fd, SHUT_WR);
+    }
+}
+
+void SocketForwarder::resumeReading(const SessionKey &key)
+{
+    int socket_fd = SessionManager::getInstance().getSocketFd(key);
+    if (socket_fd != -1)
+    {
+        updateInterest(socket_fd, EPOLLIN);
+    }
+}
+
+void SocketForwarder::setSocketProtector(std::function<bool(int)> protector)
+{
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+    socket_protector_ = std::move(protector);
+}
+
+int SocketForwarder::createSocket(const SessionKey &key)
 {
     int socket_fd;
+    int family = key.ipVersion() == 6 ? AF_INET6 : AF_INET;
 
-    if (protocol == "TCP")
+    if (key.protocol() == IPPROTO_TCP)
     {
-        socket_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        socket_fd = socket(family, SOCK_STREAM, IPPROTO_TCP);
     }
-    else if (protocol == "UDP")
+    else if (key.protocol() == IPPROTO_UDP)
     {
-        socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        socket_fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
     }
     else
     {
-        LOGE("Unsupported protocol: %s", protocol.c_str());
+        LOGE("Unsupported protocol: %d", key.protocol());
         return -1;
     }
 
@@ -97,65 +180,349 @@ int SocketForwarder::createSocket(const std::string &protocol)
     return socket_fd;
 }
 
-bool SocketForwarder::connectToDestination(int socket_fd, const std::string &dest_ip, uint16_t dest_port)
+bool SocketForwarder::connectToDestination(int socket_fd, const SessionKey &key)
 {
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(dest_port);
+    struct sockaddr_storage dest_addr;
+    socklen_t dest_len;
+    std::memset(&dest_addr, 0, sizeof(dest_addr));
 
-    if (inet_pton(AF_INET, dest_ip.c_str(), &dest_addr.sin_addr) <= 0)
+    if (key.ipVersion() == 6)
     {
-        LOGE("Invalid destination IP: %s", dest_ip.c_str());
-        return false;
+        struct sockaddr_in6 *addr6 = reinterpret_cast<struct sockaddr_in6 *>(&dest_addr);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(key.destPort());
+        std::memcpy(&addr6->sin6_addr, key.destAddr(), 16);
+        dest_len = sizeof(*addr6);
+    }
+    else
+    {
+        struct sockaddr_in *addr4 = reinterpret_cast<struct sockaddr_in *>(&dest_addr);
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(key.destPort());
+        std::memcpy(&addr4->sin_addr, key.destAddr(), 4);
+        dest_len = sizeof(*addr4);
     }
 
-    int result = connect(socket_fd, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    int result = connect(socket_fd, (struct sockaddr *)&dest_addr, dest_len);
     if (result == -1 && errno != EINPROGRESS)
     {
-        LOGE("Failed to connect to %s:%d - %d", dest_ip.c_str(), dest_port, errno);
+        LOGE("Failed to connect to %s - %d", key.toString().c_str(), errno);
         return false;
     }
 
     return true;
 }
 
-void SocketForwarder::handleSocketData(int socket_fd, const SessionKey &key)
+bool SocketForwarder::startReactor()
 {
-    uint8_t buffer[4096];
-    SessionManager &session_mgr = SessionManager::getInstance();
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ == -1 || wake_fd_ == -1)
+    {
+        LOGE("Failed to create reactor fds: %d", errno);
+        if (epoll_fd_ != -1)
+            close(epoll_fd_);
+        if (wake_fd_ != -1)
+            close(wake_fd_);
+        epoll_fd_ = -1;
+        wake_fd_ = -1;
+        return false;
+    }
+
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<uint64_t>(wake_fd_);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+    // Sessions can be closed from any thread (expiry, reset); drop them from epoll first
+    SessionManager::getInstance().setSocketCloseHandler([this](int socket_fd)
+                                                        { unwatchSocket(socket_fd); });
+
+    is_running_ = true;
+    reactor_thread_ = std::thread(&SocketForwarder::runReactor, this);
+    LOGD("Forwarding reactor started");
+    return true;
+}
+
+void SocketForwarder::wakeReactor()
+{
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd_, &one, sizeof(one));
+    (void)written;
+}
+
+bool SocketForwarder::watchSocket(int socket_fd, const SessionKey &key, SessionHandle session, bool connecting)
+{
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+    uint32_t generation = ++next_generation_;
+
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = connecting ? EPOLLOUT : EPOLLIN;
+    event.data.u64 = (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(socket_fd);
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket_fd, &event) == -1)
+    {
+        LOGE("Failed to watch socket %d: %d", socket_fd, errno);
+        return false;
+    }
+
+    sockets_[socket_fd] = WatchedSocket{key, session, generation, connecting, true};
+    return true;
+}
+
+// events == 0 takes the socket out of the epoll set entirely, since
+// EPOLLHUP/EPOLLERR would otherwise keep firing for a parked socket
+bool SocketForwarder::updateInterest(int socket_fd, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+    auto it = sockets_.find(socket_fd);
+    if (it == sockets_.end())
+    {
+        return false;
+    }
+
+    WatchedSocket &watched = it->second;
+    if (events == 0)
+    {
+        if (watched.registered)
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket_fd, nullptr);
+            watched.registered = false;
+        }
+        return true;
+    }
+
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = (static_cast<uint64_t>(watched.generation) << 32) | static_cast<uint32_t>(socket_fd);
+
+    int op = watched.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd_, op, socket_fd, &event) == -1)
+    {
+        return false;
+    }
+    watched.registered = true;
+    return true;
+}
+
+void SocketForwarder::unwatchSocket(int socket_fd)
+{
+    std::lock_guard<std::mutex> lock(sockets_mutex_);
+
+    auto it = sockets_.find(socket_fd);
+    if (it == sockets_.end())
+    {
+        return;
+    }
+
+    if (epoll_fd_ != -1 && it->second.registered)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket_fd, nullptr);
+    }
+
+    // TunStack hears about it from the reactor thread, outside SessionManager's lock
+    closed_sessions_.push_back(it->second.key);
+    sockets_.erase(it);
+    if (wake_fd_ != -1)
+    {
+        wakeReactor();
+    }
+}
+
+void SocketForwarder::runReactor()
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    TunStack &stack = TunStack::getInstance();
+    std::vector<SessionKey> closed;
 
     while (is_running_)
+    {
+        // Wake up in time for the next TCP retransmission
+        int count = epoll_wait(epoll_fd_, events, REACTOR_MAX_EVENTS, stack.onTimer(CaptureClock::monotonicMs()));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOGE("epoll_wait failed: %d", errno);
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int socket_fd = static_cast<int>(events[i].data.u64 & 0xFFFFFFFF);
+            if (socket_fd == wake_fd_)
+            {
+                uint64_t value;
+                ssize_t drained = read(wake_fd_, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+
+            handleSocketEvent(socket_fd, static_cast<uint32_t>(events[i].data.u64 >> 32),
+                              events[i].events);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sockets_mutex_);
+            closed.swap(closed_sessions_);
+        }
+        if (!closed.empty())
+        {
+            stack.onSessionsClosed(closed);
+            closed.clear();
+        }
+    }
+
+    LOGD("Forwarding reactor stopped");
+}
+
+void SocketForwarder::handleConnectResult(int socket_fd, const SessionKey &key)
+{
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1)
+    {
+        error = errno;
+    }
+
+    if (error == 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sockets_mutex_);
+            auto it = sockets_.find(socket_fd);
+            if (it != sockets_.end())
+            {
+                it->second.connecting = false;
+            }
+        }
+        updateInterest(socket_fd, EPOLLIN);
+    }
+    else
+    {
+        LOGD("Connect to %s failed: %d", key.toString().c_str(), error);
+        updateInterest(socket_fd, 0);
+    }
+
+    TunStack::getInstance().onSocketConnected(key, error == 0);
+}
+
+void SocketForwarder::handleSocketEvent(int socket_fd, uint32_t generation, uint32_t events)
+{
+    SessionKey key;
+    SessionHandle session;
+    bool connecting;
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+        auto it = sockets_.find(socket_fd);
+        if (it == sockets_.end() || it->second.generation != generation)
+        {
+            return; // closed (and possibly reused) since the event was queued
+        }
+        key = it->second.key;
+        session = it->second.session;
+        connecting = it->second.connecting;
+    }
+
+    if (connecting)
+    {
+        handleConnectResult(socket_fd, key);
+        return;
+    }
+
+    TunStack &stack = TunStack::getInstance();
+    uint8_t buffer[16384];
+
+    if (events & EPOLLERR)
+    {
+        updateInterest(socket_fd, 0);
+        stack.onSocketError(key);
+        return;
+    }
+
+    // Drain everything readable so level-triggered epoll does not wake us again for it
+    while (true)
     {
         ssize_t received = recv(socket_fd, buffer, sizeof(buffer), 0);
 
         if (received > 0)
         {
-            session_mgr.updateSession(key, received, false);
+            SessionManager::getInstance().updateSession(key, received, false);
 
-            // Here you would inject the response back into the TUN interface
-            // This requires additional implementation for packet crafting
+            if (!stack.onSocketData(key, buffer, received))
+            {
+                // The TUN side is backed up; resumeReading() re-arms the socket
+                updateInterest(socket_fd, 0);
+                break;
+            }
+        }
+        else if (received == 0 && key.protocol() == IPPROTO_UDP)
+        {
+            // A zero-length datagram, not EOF; relay it like any other
+            SessionManager::getInstance().updateSession(key, 0, false);
+            stack.onSocketData(key, buffer, 0);
         }
         else if (received == 0)
         {
             // Connection closed
-            LOGD("Connection closed for %s:%d", key.dest_ip.c_str(), key.dest_port);
+            SessionCounters counters;
+            if (SessionManager::getInstance().readCounters(session, counters))
+            {
+                LOGD("Connection closed for %s after %llu bytes out, %llu in", key.toString().c_str(),
+                     static_cast<unsigned long long>(counters.bytes_sent),
+                     static_cast<unsigned long long>(counters.bytes_received));
+            }
+            updateInterest(socket_fd, 0);
+            stack.onSocketEof(key);
             break;
         }
-        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else
         {
-            // Error occurred
-            LOGE("Error receiving data: %d", errno);
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                // Error occurred
+                LOGE("Error receiving data: %d", errno);
+                updateInterest(socket_fd, 0);
+                stack.onSocketError(key);
+            }
             break;
         }
-
-        // Small delay to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-
-    session_mgr.closeSession(key);
 }
 
 void SocketForwarder::cleanup()
 {
+    if (!is_running_)
+    {
+        return;
+    }
+
     is_running_ = false;
+    wakeReactor();
+
+    if (reactor_thread_.joinable())
+    {
+        reactor_thread_.join();
+    }
+
+    SessionManager::getInstance().setSocketCloseHandler(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(sockets_mutex_);
+        sockets_.clear();
+        closed_sessions_.clear();
+    }
+
+    close(epoll_fd_);
+    close(wake_fd_);
+    epoll_fd_ = -1;
+    wake_fd_ = -1;
 }
@@ -4,25 +4,72 @@
 #include "session_manager.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/types.h>
 #include <thread>
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
+// Socket side of VPN forwarding. Every session's upstream socket is owned
+// by a single epoll reactor thread, which reports connect completion,
+// incoming data and EOF to TunStack.
 class SocketForwarder
 {
 public:
     static SocketForwarder &getInstance();
 
+    // Relay a UDP payload, opening the session's socket on first use
     bool forwardPacket(const SessionKey &key, const uint8_t *packet, int length);
+
+    // Create, protect and start connecting the session's socket. TCP
+    // sockets report completion through TunStack::onSocketConnected.
+    bool openSession(const SessionKey &key);
+    ssize_t sendToSession(const SessionKey &key, const uint8_t *data, size_t length);
+    void shutdownSession(const SessionKey &key);
+    void resumeReading(const SessionKey &key);
+
+    // Used in VPN mode to keep forwarded sockets out of the tunnel
+    void setSocketProtector(std::function<bool(int)> protector);
     void cleanup();
 
 private:
     SocketForwarder() = default;
 
-    int createSocket(const std::string &protocol);
-    bool connectToDestination(int socket_fd, const std::string &dest_ip, uint16_t dest_port);
-    void handleSocketData(int socket_fd, const SessionKey &key);
+    // Socket registered with the reactor; the generation tells a stale
+    // epoll event apart from one for a new socket that reused the fd
+    struct WatchedSocket
+    {
+        SessionKey key;
+        SessionHandle session; // for reading its counters without SessionManager's lock
+        uint32_t generation;
+        bool connecting;
+        bool registered; // currently in the epoll set
+    };
+
+    int createSocket(const SessionKey &key);
+    bool connectToDestination(int socket_fd, const SessionKey &key);
+
+    bool startReactor();
+    void runReactor();
+    void wakeReactor();
+    bool watchSocket(int socket_fd, const SessionKey &key, SessionHandle session, bool connecting);
+    bool updateInterest(int socket_fd, uint32_t events);
+    void unwatchSocket(int socket_fd);
+    void handleSocketEvent(int socket_fd, uint32_t generation, uint32_t events);
+    void handleConnectResult(int socket_fd, const SessionKey &key);
+
+    std::atomic<bool> is_running_{false};
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    std::thread reactor_thread_;
+    std::function<bool(int)> socket_protector_;
 
-    std::atomic<bool> is_running_{true};
+    std::mutex sockets_mutex_;
+    std::unordered_map<int, WatchedSocket> sockets_;
+    std::vector<SessionKey> closed_sessions_;
+    uint32_t next_generation_ = 0;
 };
 
 #endif // SOCKET_FORWARDER_H
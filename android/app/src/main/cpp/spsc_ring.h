@@ -0,0 +1,233 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Counters for one ring, read from any thread
+struct RingStats
+{
+    size_t capacity;
+    size_t occupancy;
+    size_t high_water;
+    uint64_t pushed;
+    uint64_t dropped;
+};
+
+// Lets a consumer sleep until one of its rings is published to. Several
+// rings drained by the same thread share one signal; producers only take
+// the mutex while the consumer is actually asleep.
+class RingSignal
+{
+public:
+    RingSignal() : waiting_(false), wake_requested_(false) {}
+
+    RingSignal(const RingSignal &) = delete;
+    RingSignal &operator=(const RingSignal &) = delete;
+
+    // Consumer: sleep until ready() holds, wake() is called or the timeout passes
+    template <typename Ready>
+    void wait(int timeout_ms, Ready ready)
+    {
+        // seq_cst pairs with the producer's index store so a wakeup is never lost
+        waiting_.store(true, std::memory_order_seq_cst);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                       [this, &ready]
+                       { return wake_requested_ || ready(); });
+        waiting_.store(false, std::memory_order_relaxed);
+        wake_requested_ = false;
+    }
+
+    // Producer: called after publishing
+    void notify()
+    {
+        if (waiting_.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_one();
+        }
+    }
+
+    // Any thread: interrupt a consumer blocked in wait()
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_requested_ = true;
+        cond_.notify_one();
+    }
+
+private:
+    std::atomic<bool> waiting_;
+    bool wake_requested_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+// Bounded single-producer/single-consumer ring of preallocated slots.
+// The producer fills a slot in place (claim/publish) and the consumer reads
+// it in place (peek/release), so no element is copied or allocated per
+// packet. Producers never block on a full ring: they shed the packet and
+// record it with markDropped(), so backpressure shows up in stats() rather
+// than stalling the stage in front.
+template <typename T>
+class SpscRing
+{
+public:
+    // Capacity is rounded up to a power of two. A consumer draining several
+    // rings passes one shared signal; otherwise the ring uses its own.
+    explicit SpscRing(size_t capacity, RingSignal *signal = nullptr)
+        : head_(0), cached_tail_(0), tail_(0), cached_head_(0), pushed_(0), dropped_(0),
+          high_water_(0), signal_(signal ? signal : &own_signal_)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer: next free slot, or nullptr when full
+    T *claim()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_)
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    // Producer: make the slot returned by claim() visible to the consumer
+    void publish()
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed) + 1;
+        // seq_cst pairs with the signal's waiting flag so a wakeup is never lost
+        tail_.store(tail, std::memory_order_seq_cst);
+        pushed_.store(pushed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        size_t occupancy = tail - head_.load(std::memory_order_relaxed);
+        if (occupancy > high_water_.load(std::memory_order_relaxed))
+        {
+            high_water_.store(occupancy, std::memory_order_relaxed);
+        }
+
+        signal_->notify();
+    }
+
+    // Producer: count a packet shed because claim() failed
+    void markDropped()
+    {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    bool push(const T &value)
+    {
+        T *slot = claim();
+        if (!slot)
+        {
+            markDropped();
+            return false;
+        }
+        *slot = value;
+        publish();
+        return true;
+    }
+
+    // Consumer: oldest published slot, or nullptr when empty
+    T *peek()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    // Consumer: hand the slot returned by peek() back to the producer
+    void release()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: whether a published slot is waiting; safe inside RingSignal::wait()
+    bool readable() const
+    {
+        return tail_.load(std::memory_order_seq_cst) != head_.load(std::memory_order_relaxed);
+    }
+
+    // Consumer: block until a slot is published, wake() is called or the
+    // timeout passes. Returns true when data is available.
+    bool waitForData(int timeout_ms)
+    {
+        if (peek())
+        {
+            return true;
+        }
+
+        signal_->wait(timeout_ms, [this]
+                      { return readable(); });
+        return peek() != nullptr;
+    }
+
+    // Any thread: interrupt a consumer blocked in waitForData()
+    void wake() { signal_->wake(); }
+
+    RingStats stats() const
+    {
+        RingStats stats;
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        stats.capacity = slots_.size();
+        stats.occupancy = tail >= head ? tail - head : 0;
+        stats.high_water = high_water_.load(std::memory_order_relaxed);
+        stats.pushed = pushed_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    // Consumer-owned line: the read index plus its view of the write index
+    std::atomic<size_t> head_;
+    size_t cached_tail_;
+    char head_pad_[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    // Producer-owned line: the write index, its view of the read index and the counters
+    std::atomic<size_t> tail_;
+    size_t cached_head_;
+    std::atomic<uint64_t> pushed_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<size_t> high_water_;
+    char tail_pad_[CACHE_LINE];
+
+    RingSignal own_signal_;
+    RingSignal *signal_;
+
+    std::vector<T> slots_;
+    size_t mask_;
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,131 @@
+#include "tcp_metrics.h"
+#include <algorithm>
+
+// A segment that arrives behind the highest sequence number this soon
+// after it, with no RTT estimate yet, is taken as reordered rather than resent
+static const uint64_t DEFAULT_REORDER_WINDOW_NS = 3000000ULL;
+
+// Sequence-space comparison, correct across wraparound
+static bool seqAfter(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) > 0;
+}
+
+static uint32_t toMicros(uint64_t ns)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(ns / 1000, UINT32_MAX));
+}
+
+TcpMetrics::TcpMetrics()
+    : syn_ns(0), handshake_rtt_us(0), srtt_us(), min_rtt_us(), rtt_samples(), retransmits(), out_of_order(),
+      zero_windows(), next_seq(), probe_end(), probe_ns(), last_advance_ns(), seq_known(0), window_closed(0)
+{
+}
+
+void TcpMetrics::update(const PacketView &view, uint8_t direction, uint8_t initiator)
+{
+    uint8_t flags = view.tcp_flags;
+    // Truncated before the TCP header, or a reset: nothing to measure
+    if (view.payload_offset == view.l4_offset || (flags & TCP_RST))
+    {
+        return;
+    }
+
+    uint64_t now_ns = view.timestamp_ns;
+    uint8_t bit = static_cast<uint8_t>(1 << direction);
+    uint8_t peer = direction ^ 1;
+
+    if ((flags & TCP_SYN) && !(flags & TCP_ACK))
+    {
+        // A SYN (re)starts the connection; earlier sequence state is void
+        syn_ns = now_ns;
+        handshake_rtt_us = 0;
+        seq_known = 0;
+        window_closed = 0;
+        probe_ns[0] = 0;
+        probe_ns[1] = 0;
+    }
+    else if (syn_ns != 0 && handshake_rtt_us == 0 && direction == initiator && !(flags & TCP_SYN) &&
+             (flags & TCP_ACK) && now_ns >= syn_ns)
+    {
+        handshake_rtt_us = std::max<uint32_t>(toMicros(now_ns - syn_ns), 1);
+    }
+
+    // The window field advertises the sender's own receive window
+    if (!(flags & TCP_SYN))
+    {
+        if (view.tcp_window == 0)
+        {
+            if (!(window_closed & bit))
+            {
+                zero_windows[direction]++;
+                window_closed |= bit;
+            }
+        }
+        else
+        {
+            window_closed &= static_cast<uint8_t>(~bit);
+        }
+    }
+
+    // An acknowledgement covering the peer's open probe closes it; one
+    // stamped before the probe gives no sample rather than a wrapped one
+    if ((flags & TCP_ACK) && probe_ns[peer] != 0 && !seqAfter(probe_end[peer], view.tcp_ack))
+    {
+        if (now_ns >= probe_ns[peer])
+        {
+            uint32_t sample = std::max<uint32_t>(toMicros(now_ns - probe_ns[peer]), 1);
+            if (rtt_samples[peer] == 0)
+            {
+                srtt_us[peer] = sample;
+                min_rtt_us[peer] = sample;
+            }
+            else
+            {
+                srtt_us[peer] = static_cast<uint32_t>((7ULL * srtt_us[peer] + sample) / 8);
+                min_rtt_us[peer] = std::min(min_rtt_us[peer], sample);
+            }
+            rtt_samples[peer]++;
+        }
+        probe_ns[peer] = 0;
+    }
+
+    // Sequence space used: the segment's full data (not just what was
+    // captured) plus one each for SYN and FIN
+    uint32_t length = view.size > view.payload_offset ? view.size - view.payload_offset : 0;
+    length += (flags & TCP_SYN ? 1 : 0) + (flags & TCP_FIN ? 1 : 0);
+    if (length == 0)
+    {
+        return;
+    }
+
+    uint32_t end = view.tcp_seq + length;
+    if (!(seq_known & bit) || seqAfter(end, next_seq[direction]))
+    {
+        next_seq[direction] = end;
+        // Capture timestamps can step backwards (clock adjustments, merged
+        // sources); the reorder window runs from the latest one
+        last_advance_ns[direction] = std::max(last_advance_ns[direction], now_ns);
+        seq_known |= bit;
+        if (probe_ns[direction] == 0)
+        {
+            probe_end[direction] = end;
+            probe_ns[direction] = now_ns;
+        }
+        return;
+    }
+
+    // Nothing new: overtaken by later segments if it trails them closely,
+    // otherwise sent again. A resend makes the open probe ambiguous. One
+    // stamped before the advance it trails cannot be a resend of it.
+    uint64_t reorder_window_ns = srtt_us[direction] != 0 ? srtt_us[direction] * 1000ULL : DEFAULT_REORDER_WINDOW_NS;
+    if (now_ns < last_advance_ns[direction] || now_ns - last_advance_ns[direction] < reorder_window_ns)
+    {
+        out_of_order[direction]++;
+    }
+    else
+    {
+        retransmits[direction]++;
+        probe_ns[direction] = 0;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef TCP_METRICS_H
+#define TCP_METRICS_H
+
+#include "packet_parser.h"
+#include <cstdint>
+
+// Passive TCP performance counters for one flow, updated from each
+// segment's sequence, acknowledgement and window fields. Every update is
+// O(1) and the struct is fixed-size: per direction it remembers only the
+// highest sequence number seen and one outstanding RTT probe.
+//
+// Arrays are indexed by the flow key's direction bit. RTT samples are
+// taken as seen from the capture point: data sent in one direction timed
+// until the other direction acknowledges it, skipping any probe a
+// retransmission made ambiguous (Karn's rule).
+struct TcpMetrics
+{
+    uint64_t syn_ns;           // initiator's SYN, 0 if the handshake was not seen
+    uint32_t handshake_rtt_us; // SYN to the initiator's first ACK
+    uint32_t srtt_us[2];       // smoothed RTT (RFC 6298 weights) of data sent each way
+    uint32_t min_rtt_us[2];
+    uint32_t rtt_samples[2];
+    uint32_t retransmits[2];
+    uint32_t out_of_order[2];
+    uint32_t zero_windows[2]; // times that side advertised a zero window
+
+    uint32_t next_seq[2];        // one past the highest sequence number sent
+    uint32_t probe_end[2];       // sequence number the open RTT probe waits on
+    uint64_t probe_ns[2];        // 0 while no probe is open
+    uint64_t last_advance_ns[2]; // when next_seq last moved forward
+    uint8_t seq_known;           // bit per direction: next_seq is valid
+    uint8_t window_closed;       // bit per direction: last window was zero
+
+    TcpMetrics();
+
+    // `initiator` is the flow's current opening direction
+    void update(const PacketView &view, uint8_t direction, uint8_t initiator);
+};
+
+#endif // TCP_METRICS_H
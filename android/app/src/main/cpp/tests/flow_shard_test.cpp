@@ -0,0 +1,172 @@
+#include "flow_shard.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const uint64_t NS_PER_SECOND = 1000000000ULL;
+const uint32_t CLIENT = 0x0A000002;
+const uint32_t SERVER = 0xC0000201;
+
+struct ShardFeeder
+{
+    FlowShard shard;
+
+    ShardFeeder() { shard.setMaxFlows(1024); }
+
+    void feed(const std::vector<uint8_t> &packet, uint64_t timestamp_ns)
+    {
+        PacketView view;
+        CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+        view.timestamp_ns = timestamp_ns;
+        shard.process(view);
+    }
+
+    void tcp(bool from_client, uint16_t client_port, uint8_t flags, uint64_t timestamp_ns)
+    {
+        if (from_client)
+            feed(tcpPacket(CLIENT, client_port, SERVER, 443, 1, 1, flags), timestamp_ns);
+        else
+            feed(tcpPacket(SERVER, 443, CLIENT, client_port, 1, 1, flags), timestamp_ns);
+    }
+
+    FlowCounts counts()
+    {
+        shard.maintain();
+        FlowCounts counts;
+        shard.addFlowCounts(counts);
+        return counts;
+    }
+
+    // The flow between CLIENT:<client_port> and SERVER:443, or a default one
+    FlowStats flow(uint16_t client_port)
+    {
+        FlowStats found;
+        FlowShard::FlowVisitor visitor = [&found, client_port](const SessionKey &key, const FlowStats &flow)
+        {
+            if (key.sourcePort() == client_port || key.destPort() == client_port)
+                found = flow;
+        };
+        shard.requestVisit(visitor);
+        shard.maintain();
+        CHECK(shard.awaitVisit(0));
+        return found;
+    }
+};
+
+size_t state(const FlowCounts &counts, TcpConnState tcp_state)
+{
+    return counts.tcp_states[static_cast<size_t>(tcp_state)];
+}
+
+void testIdleAndClosedExpiry()
+{
+    ShardFeeder feeder;
+    uint64_t t0 = 1000 * NS_PER_SECOND;
+
+    feeder.feed(udpPacket(CLIENT, 5000, SERVER, 53), t0);
+    // A connection closed from both sides
+    feeder.tcp(true, 6000, TCP_SYN, t0);
+    feeder.tcp(false, 6000, TCP_SYN | TCP_ACK, t0);
+    feeder.tcp(true, 6000, TCP_ACK, t0);
+    feeder.tcp(true, 6000, TCP_FIN | TCP_ACK, t0);
+    feeder.tcp(false, 6000, TCP_FIN | TCP_ACK, t0);
+    // One still open
+    feeder.tcp(true, 6001, TCP_ACK, t0);
+
+    FlowCounts counts = feeder.counts();
+    CHECK_EQ(counts.flows, 3u);
+    CHECK_EQ(state(counts, TcpConnState::None), 1u);
+    CHECK_EQ(state(counts, TcpConnState::TimeWait), 1u);
+    CHECK_EQ(state(counts, TcpConnState::Established), 1u);
+
+    // Six seconds on, only the closed connection has gone
+    feeder.feed(udpPacket(CLIENT, 5001, SERVER, 53), t0 + 6 * NS_PER_SECOND);
+    counts = feeder.counts();
+    CHECK_EQ(counts.flows, 3u);
+    CHECK_EQ(counts.closed_retired, 1u);
+    CHECK_EQ(counts.idle_expired, 0u);
+    CHECK_EQ(state(counts, TcpConnState::TimeWait), 0u);
+    CHECK_EQ(state(counts, TcpConnState::None), 2u);
+
+    // Traffic keeps a flow alive past its original deadline
+    feeder.feed(udpPacket(CLIENT, 5001, SERVER, 53), t0 + 100 * NS_PER_SECOND);
+    feeder.feed(udpPacket(CLIENT, 5001, SERVER, 53), t0 + 125 * NS_PER_SECOND);
+    counts = feeder.counts();
+    CHECK_EQ(counts.flows, 1u);
+    CHECK_EQ(counts.idle_expired, 2u);
+    CHECK_EQ(state(counts, TcpConnState::None), 1u);
+    CHECK_EQ(state(counts, TcpConnState::Established), 0u);
+}
+
+void testExpiryWhileCaptureIsIdle()
+{
+    ShardFeeder feeder;
+    uint64_t t0 = 2000 * NS_PER_SECOND;
+
+    // Reset connections linger two seconds
+    feeder.tcp(true, 7000, TCP_ACK, t0);
+    feeder.tcp(false, 7000, TCP_RST, t0);
+    FlowCounts counts = feeder.counts();
+    CHECK_EQ(counts.flows, 1u);
+    CHECK_EQ(state(counts, TcpConnState::Closed), 1u);
+
+    // No further packets: the monotonic clock carries the flow clock on
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    counts = feeder.counts();
+    CHECK_EQ(counts.flows, 0u);
+    CHECK_EQ(counts.closed_retired, 1u);
+    CHECK_EQ(state(counts, TcpConnState::Closed), 0u);
+}
+
+void testSynOnReusedTupleStartsAfresh()
+{
+    ShardFeeder feeder;
+    uint64_t t0 = 3000 * NS_PER_SECOND;
+
+    feeder.tcp(true, 8000, TCP_SYN, t0);
+    feeder.tcp(false, 8000, TCP_SYN | TCP_ACK, t0);
+    feeder.tcp(true, 8000, TCP_ACK, t0);
+    feeder.tcp(false, 8000, TCP_ACK | TCP_PSH, t0);
+    feeder.tcp(true, 8000, TCP_FIN | TCP_ACK, t0);
+    feeder.tcp(false, 8000, TCP_FIN | TCP_ACK, t0);
+    FlowStats old_connection = feeder.flow(8000);
+    CHECK_EQ(old_connection.txPackets() + old_connection.rxPackets(), 6u);
+
+    uint64_t t1 = t0 + NS_PER_SECOND;
+    feeder.tcp(true, 8000, TCP_SYN, t1);
+    FlowStats reused = feeder.flow(8000);
+    CHECK(reused.tcp_state == TcpConnState::SynSent);
+    CHECK_EQ(reused.txPackets(), 1u);
+    CHECK_EQ(reused.rxPackets(), 0u);
+    CHECK_EQ(reused.rxBytes(), 0u);
+    CHECK_EQ(reused.txBytes(), old_connection.txBytes() / 3);
+    CHECK_EQ(reused.first_seen_ns, t1);
+
+    // The new connection keeps the flow past the old one's TIME_WAIT
+    FlowCounts counts = feeder.counts();
+    CHECK_EQ(state(counts, TcpConnState::SynSent), 1u);
+    CHECK_EQ(state(counts, TcpConnState::TimeWait), 0u);
+    feeder.feed(udpPacket(CLIENT, 5000, SERVER, 53), t0 + 10 * NS_PER_SECOND);
+    counts = feeder.counts();
+    CHECK_EQ(counts.flows, 2u);
+    CHECK_EQ(counts.closed_retired, 0u);
+
+    // A retransmitted SYN is the same connection
+    feeder.tcp(true, 8000, TCP_SYN, t1);
+    CHECK_EQ(feeder.flow(8000).txPackets(), 2u);
+}
+
+} // namespace
+
+int main()
+{
+    testIdleAndClosedExpiry();
+    testExpiryWhileCaptureIsIdle();
+    testSynOnReusedTupleStartsAfresh();
+    return testResult("flow_shard_test");
+}
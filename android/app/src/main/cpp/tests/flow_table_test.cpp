@@ -0,0 +1,159 @@
+#include "flow_table.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+namespace
+{
+
+void testInsertFindErase()
+{
+    FlowTable<int> table(16);
+    bool inserted = false;
+
+    for (uint16_t port = 1; port <= 200; ++port)
+    {
+        int *value = table.findOrInsert(udpKey(1, port), inserted);
+        CHECK(inserted);
+        *value = port;
+    }
+    CHECK_EQ(table.size(), 200u);
+    // Rebuilt as it grew, staying at most 3/4 full
+    CHECK(table.capacity() * 3 >= table.size() * 4);
+
+    for (uint16_t port = 1; port <= 200; ++port)
+    {
+        int *value = table.find(udpKey(1, port));
+        CHECK(value && *value == port);
+    }
+    CHECK(table.find(udpKey(2, 1)) == nullptr);
+
+    int *again = table.findOrInsert(udpKey(1, 7), inserted);
+    CHECK(!inserted && *again == 7);
+
+    for (uint16_t port = 1; port <= 200; port += 2)
+    {
+        CHECK(table.erase(udpKey(1, port)));
+    }
+    CHECK(!table.erase(udpKey(1, 1)));
+    CHECK_EQ(table.size(), 100u);
+    for (uint16_t port = 1; port <= 200; ++port)
+    {
+        CHECK((table.find(udpKey(1, port)) != nullptr) == (port % 2 == 0));
+    }
+
+    // Tombstones are reused, and the value starts out default-constructed
+    int *reused = table.findOrInsert(udpKey(1, 1), inserted);
+    CHECK(inserted && *reused == 0);
+}
+
+void testEraseIfAndForEach()
+{
+    FlowTable<int> table;
+    bool inserted = false;
+    for (uint16_t port = 0; port < 50; ++port)
+    {
+        *table.findOrInsert(udpKey(3, port), inserted) = port;
+    }
+
+    table.eraseIf([](const SessionKey &, int &value) { return value >= 20; });
+    CHECK_EQ(table.size(), 20u);
+
+    int sum = 0;
+    size_t visited = 0;
+    table.forEach([&sum, &visited](const SessionKey &key, int &value)
+                  {
+                      CHECK_EQ(key.sourcePort(), value);
+                      sum += value;
+                      visited++;
+                  });
+    CHECK_EQ(visited, 20u);
+    CHECK_EQ(sum, 190);
+
+    table.clear();
+    CHECK_EQ(table.size(), 0u);
+    CHECK(table.find(udpKey(3, 1)) == nullptr);
+}
+
+void testClockEvictsUnreferencedFirst()
+{
+    FlowTable<int> table;
+    table.setMaxSize(8);
+    bool inserted = false;
+
+    for (uint16_t port = 0; port < 8; ++port)
+    {
+        table.findOrInsert(udpKey(4, port), inserted);
+    }
+    // Ports 0-3 keep being used; 4-7 were seen once
+    for (uint16_t port = 0; port < 4; ++port)
+    {
+        CHECK(table.find(udpKey(4, port)) != nullptr);
+    }
+
+    std::vector<uint16_t> evicted;
+    auto on_evict = [&evicted](const SessionKey &key, int &) { evicted.push_back(key.sourcePort()); };
+    for (uint16_t port = 100; port < 104; ++port)
+    {
+        table.findOrInsert(udpKey(4, port), inserted, on_evict);
+        CHECK(inserted);
+    }
+
+    CHECK_EQ(table.size(), 8u);
+    CHECK_EQ(evicted.size(), 4u);
+    for (uint16_t port : evicted)
+    {
+        CHECK(port >= 4);
+    }
+    for (uint16_t port = 0; port < 4; ++port)
+    {
+        CHECK(table.find(udpKey(4, port)) != nullptr);
+    }
+
+    // A scan of one-packet flows never displaces the flows in use
+    for (uint16_t port = 200; port < 300; ++port)
+    {
+        for (uint16_t live = 0; live < 4; ++live)
+        {
+            table.find(udpKey(4, live));
+        }
+        table.findOrInsert(udpKey(4, port), inserted, on_evict);
+    }
+    CHECK_EQ(table.size(), 8u);
+    for (uint16_t port = 0; port < 4; ++port)
+    {
+        CHECK(table.find(udpKey(4, port)) != nullptr);
+    }
+}
+
+void testMaxEntriesWithin()
+{
+    // Below the smallest table the limit still allows the minimum
+    CHECK_EQ(FlowTable<int>::maxEntriesWithin(0), 7u);
+
+    size_t entries = FlowTable<int>::maxEntriesWithin(1024 * 1024);
+    CHECK(entries > 7);
+
+    // Filling to the limit stays within the budget
+    FlowTable<int> table(16);
+    table.setMaxSize(entries);
+    bool inserted = false;
+    for (size_t i = 0; i < entries; ++i)
+    {
+        table.findOrInsert(udpKey(static_cast<uint8_t>(i >> 16), static_cast<uint16_t>(i)), inserted);
+    }
+    CHECK_EQ(table.size(), entries);
+    // A slot holds at least the key and the value
+    CHECK(table.capacity() * (sizeof(SessionKey) + sizeof(int)) <= 1024 * 1024);
+}
+
+} // namespace
+
+int main()
+{
+    testInsertFindErase();
+    testEraseIfAndForEach();
+    testClockEvictsUnreferencedFirst();
+    testMaxEntriesWithin();
+    return testResult("flow_table_test");
+}
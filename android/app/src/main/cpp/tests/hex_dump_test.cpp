@@ -0,0 +1,104 @@
+#include "hex_dump.h"
+#include "test_check.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Reference rendering, one byte at a time
+std::string referenceHex(const uint8_t *data, size_t length, const char *separator)
+{
+    std::string hex;
+    char pair[3];
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (i > 0)
+            hex += separator;
+        std::snprintf(pair, sizeof(pair), "%02x", data[i]);
+        hex += pair;
+    }
+    return hex;
+}
+
+std::vector<uint8_t> allByteValues(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    return data;
+}
+
+void testEncodeMatchesScalar()
+{
+    // Lengths around the 16-byte SIMD block, and every byte value
+    std::vector<uint8_t> data = allByteValues(300);
+    for (size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 64, 255, 256, 300})
+    {
+        std::string simd(length * 2, '?');
+        std::string scalar(length * 2, '?');
+        HexDump::encode(data.data(), length, &simd[0]);
+        HexDump::encodeScalar(data.data(), length, &scalar[0]);
+        CHECK_STR(simd, referenceHex(data.data(), length, ""));
+        CHECK_STR(scalar, simd);
+    }
+}
+
+void testFormatSpaced()
+{
+    std::vector<uint8_t> data = allByteValues(100);
+    for (size_t length : {1, 16, 17, 32, 33, 64, 65, 100})
+    {
+        for (size_t max_bytes : {16, 64})
+        {
+            std::string expected = referenceHex(data.data(), length < max_bytes ? length : max_bytes, " ");
+            if (length > max_bytes)
+                expected += "...";
+            CHECK_EQ(HexDump::spacedLength(length, max_bytes), expected.size());
+
+            std::string out(expected.size() + 8, '#');
+            size_t written = HexDump::formatSpaced(data.data(), length, max_bytes, &out[0], out.size());
+            CHECK_EQ(written, expected.size());
+            // Nothing written past the reported length
+            CHECK_STR(out.substr(written), std::string(8, '#'));
+            out.resize(written);
+            CHECK_STR(out, expected);
+
+            std::string scalar(length < max_bytes ? length * 3 - 1 : max_bytes * 3 - 1, '?');
+            HexDump::formatSpacedScalar(data.data(), length < max_bytes ? length : max_bytes, &scalar[0]);
+            CHECK_STR(scalar, referenceHex(data.data(), length < max_bytes ? length : max_bytes, " "));
+        }
+    }
+
+    char small[4];
+    CHECK_EQ(HexDump::formatSpaced(data.data(), 4, 64, small, sizeof(small)), 0u);
+    CHECK_EQ(HexDump::spacedLength(0, 64), 0u);
+}
+
+void testFormatDump()
+{
+    const uint8_t data[] = "GET / HTTP/1.1\r\nHost: a\r\n";
+    size_t length = sizeof(data) - 1;
+    std::string out(HexDump::dumpLength(length), '\0');
+    out.resize(HexDump::formatDump(data, length, &out[0], out.size()));
+
+    CHECK_STR(out, "00000000  47 45 54 20 2f 20 48 54  54 50 2f 31 2e 31 0d 0a  |GET / HTTP/1.1..|\n"
+                   "00000010  48 6f 73 74 3a 20 61 0d  0a                       |Host: a..|\n");
+
+    char small[16];
+    CHECK_EQ(HexDump::formatDump(data, length, small, sizeof(small)), 0u);
+    CHECK_EQ(HexDump::formatDump(data, 0, small, sizeof(small)), 0u);
+}
+
+} // namespace
+
+int main()
+{
+    testEncodeMatchesScalar();
+    testFormatSpaced();
+    testFormatDump();
+    return testResult("hex_dump_test");
+}
@@ -0,0 +1,113 @@
+#include "link_layer.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+#if !HAVE_LIBPCAP
+// Only LinkDecoder::name() needs libpcap; the offsets are tested without it
+extern "C" const char *pcap_datalink_val_to_name(int)
+{
+    return nullptr;
+}
+#endif
+
+namespace
+{
+
+void putBe16(std::vector<uint8_t> &frame, size_t offset, uint16_t value)
+{
+    frame[offset] = static_cast<uint8_t>(value >> 8);
+    frame[offset + 1] = static_cast<uint8_t>(value);
+}
+
+// Ethernet header with the given EtherType/TPID chain, then an IPv4 datagram
+std::vector<uint8_t> ethernetFrame(const std::vector<uint16_t> &types)
+{
+    std::vector<uint8_t> frame(12, 0xAA);
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        frame.resize(frame.size() + 2);
+        putBe16(frame, frame.size() - 2, types[i]);
+        if (i + 1 < types.size())
+        {
+            // VLAN TCI
+            frame.resize(frame.size() + 2);
+            putBe16(frame, frame.size() - 2, static_cast<uint16_t>(100 + i));
+        }
+    }
+    std::vector<uint8_t> ip = udpPacket(0x0A000001, 1000, 0x0A000002, 2000);
+    frame.insert(frame.end(), ip.begin(), ip.end());
+    return frame;
+}
+
+int offsetOf(int linktype, const std::vector<uint8_t> &frame)
+{
+    LinkDecoder decoder(linktype);
+    return decoder.networkOffset(frame.data(), static_cast<uint32_t>(frame.size()));
+}
+
+void testEthernetVlanOffsets()
+{
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x0800})), 14);
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x86DD})), 14);
+    // 802.1Q
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x8100, 0x0800})), 18);
+    // QinQ: 802.1ad outer tag, and the pre-standard 0x9100
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x88A8, 0x8100, 0x0800})), 22);
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x9100, 0x8100, 0x86DD})), 22);
+
+    // Not IP: ARP, a VLAN-tagged ARP, and a third tag
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x0806})), -1);
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x8100, 0x0806})), -1);
+    CHECK_EQ(offsetOf(DLT_EN10MB, ethernetFrame({0x88A8, 0x8100, 0x8100, 0x0800})), -1);
+
+    // Too short to hold an IP header after the link header
+    std::vector<uint8_t> frame = ethernetFrame({0x0800});
+    LinkDecoder decoder(DLT_EN10MB);
+    CHECK_EQ(decoder.networkOffset(frame.data(), 14 + 19), -1);
+    CHECK_EQ(decoder.networkOffset(frame.data(), 14 + 20), 14);
+}
+
+void testCookedAndRawOffsets()
+{
+    std::vector<uint8_t> ip = udpPacket(0x0A000001, 1000, 0x0A000002, 2000);
+
+    // Linux cooked v1: protocol at 14, 16-byte header
+    std::vector<uint8_t> sll(16, 0);
+    putBe16(sll, 14, 0x0800);
+    sll.insert(sll.end(), ip.begin(), ip.end());
+    CHECK_EQ(offsetOf(DLT_LINUX_SLL, sll), 16);
+    putBe16(sll, 14, 0x0806);
+    CHECK_EQ(offsetOf(DLT_LINUX_SLL, sll), -1);
+
+    // Linux cooked v2: protocol first, 20-byte header
+    std::vector<uint8_t> sll2(20, 0);
+    putBe16(sll2, 0, 0x86DD);
+    sll2.insert(sll2.end(), ip.begin(), ip.end());
+    CHECK_EQ(offsetOf(DLT_LINUX_SLL2, sll2), 20);
+
+    CHECK_EQ(offsetOf(DLT_RAW, ip), 0);
+
+    std::vector<uint8_t> loopback(4, 0);
+    loopback[0] = 2; // AF_INET, host order
+    loopback.insert(loopback.end(), ip.begin(), ip.end());
+    CHECK_EQ(offsetOf(DLT_NULL, loopback), 4);
+}
+
+void testUnsupportedLinkType()
+{
+    LinkDecoder decoder(DLT_IEEE802_11_RADIO);
+    CHECK(!decoder.supported());
+    std::vector<uint8_t> frame = ethernetFrame({0x0800});
+    CHECK_EQ(decoder.networkOffset(frame.data(), static_cast<uint32_t>(frame.size())), -1);
+}
+
+} // namespace
+
+int main()
+{
+    testEthernetVlanOffsets();
+    testCookedAndRawOffsets();
+    testUnsupportedLinkType();
+    return testResult("link_layer_test");
+}
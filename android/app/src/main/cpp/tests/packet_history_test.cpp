@@ -0,0 +1,158 @@
+#include "packet_history.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+namespace
+{
+
+// UDP record from 10.0.0.<host>:<port> with `payload_bytes` of payload, each
+// byte set to `fill`
+PacketRecord udpRecord(uint8_t host, uint16_t port, size_t payload_bytes, uint8_t fill, uint64_t timestamp_ns)
+{
+    std::vector<uint8_t> payload(payload_bytes, fill);
+    std::vector<uint8_t> packet = udpPacket(0x0A000000 | host, port, 0xC0000201, 53, payload.data(), payload.size());
+    PacketView view;
+    PacketParser::parseInto(packet.data(), packet.size(), view);
+    view.timestamp_ns = timestamp_ns;
+
+    PacketRecord record;
+    PacketBatcher::toRecord(view, record);
+    return record;
+}
+
+bool payloadFilled(const PacketRecord &record, uint8_t fill)
+{
+    for (size_t i = 0; i < record.captured_payload; ++i)
+    {
+        if (record.payload[i] != fill)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testNewestFirstPaging()
+{
+    PacketHistory history(8, 1024);
+    std::vector<PacketRecord> records;
+    for (uint16_t i = 0; i < 12; ++i)
+    {
+        records.push_back(udpRecord(1, static_cast<uint16_t>(1000 + i), 4, 0, i));
+    }
+    history.append(records.data(), records.size());
+
+    HistoryStats stats = history.stats();
+    CHECK_EQ(stats.capacity, 8u);
+    CHECK_EQ(stats.stored, 8u);
+    CHECK_EQ(stats.appended, 12u);
+
+    std::vector<PacketRecord> page;
+    HistoryFilter all;
+    CHECK_EQ(history.query(0, 3, all, page), 8u);
+    CHECK_EQ(page.size(), 3u);
+    CHECK_EQ(page[0].source_port, 1011);
+    CHECK_EQ(page[2].source_port, 1009);
+
+    page.clear();
+    CHECK_EQ(history.query(6, 10, all, page), 8u);
+    CHECK_EQ(page.size(), 2u);
+    CHECK_EQ(page[1].source_port, 1004); // the oldest still stored
+
+    history.clear();
+    page.clear();
+    CHECK_EQ(history.query(0, 10, all, page), 0u);
+    CHECK(page.empty());
+}
+
+void testFilters()
+{
+    PacketHistory history(64, 4096);
+    for (uint8_t host = 1; host <= 4; ++host)
+    {
+        for (uint16_t i = 0; i < 5; ++i)
+        {
+            PacketRecord record = udpRecord(host, static_cast<uint16_t>(2000 + i), 8, host, i);
+            history.append(&record, 1);
+        }
+    }
+
+    HistoryFilter filter;
+    std::string error;
+    CHECK(filter.parse("udp", "10.0.0.3", 0, error));
+    std::vector<PacketRecord> page;
+    CHECK_EQ(history.query(1, 2, filter, page), 5u);
+    CHECK_EQ(page.size(), 2u);
+    CHECK_EQ(page[0].source_port, 2003);
+    CHECK(payloadFilled(page[0], 3));
+
+    CHECK(filter.parse("", "", 2001, error));
+    page.clear();
+    CHECK_EQ(history.query(0, 100, filter, page), 4u);
+
+    CHECK(filter.parse("TCP", "", 0, error));
+    page.clear();
+    CHECK_EQ(history.query(0, 100, filter, page), 0u);
+
+    CHECK(!filter.parse("sctp", "", 0, error));
+    CHECK(!filter.parse("", "10.0.0", 0, error));
+    CHECK(!filter.parse("", "", 70000, error));
+    CHECK(filter.parse("", "2001:db8::1", 0, error));
+    CHECK_EQ(filter.ip_version, 6);
+}
+
+void testPayloadRingWraps()
+{
+    // Room for two 48-byte slices; the third starts over at the front
+    // rather than straddling the end, overwriting the first
+    PacketHistory history(16, 128);
+    PacketRecord records[] = {udpRecord(1, 1, 48, 0x11, 1), udpRecord(1, 2, 48, 0x22, 2),
+                              udpRecord(1, 3, 48, 0x33, 3)};
+    history.append(records, 3);
+
+    std::vector<PacketRecord> page;
+    history.query(0, 3, HistoryFilter(), page);
+    CHECK_EQ(page.size(), 3u);
+    CHECK_EQ(page[0].captured_payload, 48);
+    CHECK(payloadFilled(page[0], 0x33));
+    CHECK_EQ(page[1].captured_payload, 48);
+    CHECK(payloadFilled(page[1], 0x22));
+    // Overwritten: the row stays, its payload is gone
+    CHECK_EQ(page[2].source_port, 1);
+    CHECK_EQ(page[2].payload_length, 48u);
+    CHECK_EQ(page[2].captured_payload, 0);
+
+    // Slices that share the ring with later ones survive until overrun
+    PacketHistory small(16, 128);
+    for (uint16_t i = 0; i < 10; ++i)
+    {
+        PacketRecord record = udpRecord(2, i, 32, static_cast<uint8_t>(i), i);
+        small.append(&record, 1);
+    }
+    page.clear();
+    small.query(0, 10, HistoryFilter(), page);
+    for (size_t i = 0; i < page.size(); ++i)
+    {
+        uint8_t fill = static_cast<uint8_t>(page[i].source_port);
+        if (i < 4)
+        {
+            CHECK_EQ(page[i].captured_payload, 32);
+            CHECK(payloadFilled(page[i], fill));
+        }
+        else
+        {
+            CHECK_EQ(page[i].captured_payload, 0);
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    testNewestFirstPaging();
+    testFilters();
+    testPayloadRingWraps();
+    return testResult("packet_history_test");
+}
@@ -0,0 +1,194 @@
+#include "packet_parser.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+namespace
+{
+
+// IPv6 header from 2001:db8::1 to 2001:db8::2; payload_length is filled in
+// from the bytes appended after it
+std::vector<uint8_t> ipv6Header(uint8_t next_header)
+{
+    std::vector<uint8_t> packet(40, 0);
+    packet[0] = 0x60;
+    packet[6] = next_header;
+    packet[7] = 64;
+    const uint8_t prefix[] = {0x20, 0x01, 0x0d, 0xb8};
+    std::memcpy(&packet[8], prefix, sizeof(prefix));
+    packet[23] = 1;
+    std::memcpy(&packet[24], prefix, sizeof(prefix));
+    packet[39] = 2;
+    return packet;
+}
+
+void setIpv6PayloadLength(std::vector<uint8_t> &packet)
+{
+    size_t payload = packet.size() - 40;
+    packet[4] = static_cast<uint8_t>(payload >> 8);
+    packet[5] = static_cast<uint8_t>(payload);
+}
+
+// Extension header of `units` 8-byte units (Hdr Ext Len = units - 1)
+void appendExtension(std::vector<uint8_t> &packet, uint8_t next_header, size_t units)
+{
+    size_t start = packet.size();
+    packet.resize(start + units * 8, 0);
+    packet[start] = next_header;
+    packet[start + 1] = static_cast<uint8_t>(units - 1);
+}
+
+void appendTcp(std::vector<uint8_t> &packet, uint16_t source_port, uint16_t dest_port, uint8_t flags,
+               const char *payload)
+{
+    size_t start = packet.size();
+    packet.resize(start + 20, 0);
+    packet[start] = static_cast<uint8_t>(source_port >> 8);
+    packet[start + 1] = static_cast<uint8_t>(source_port);
+    packet[start + 2] = static_cast<uint8_t>(dest_port >> 8);
+    packet[start + 3] = static_cast<uint8_t>(dest_port);
+    packet[start + 12] = 5 << 4;
+    packet[start + 13] = flags;
+    packet.insert(packet.end(), payload, payload + std::strlen(payload));
+}
+
+void testIpv4Tcp()
+{
+    const uint8_t payload[] = "GET / HTTP/1.1\r\n";
+    std::vector<uint8_t> packet = tcpPacket(0x0A000002, 40000, 0x5DB8D822, 80, 1000, 2000, TCP_ACK | TCP_PSH, 4096,
+                                            payload, sizeof(payload) - 1);
+
+    PacketView view;
+    CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+    CHECK(view.protocol == Protocol::TCP);
+    CHECK_EQ(view.ip_version, 4);
+    CHECK_STR(PacketParser::addressToString(view.source_addr, 4), "10.0.0.2");
+    CHECK_STR(PacketParser::addressToString(view.dest_addr, 4), "93.184.216.34");
+    CHECK_EQ(view.source_port, 40000);
+    CHECK_EQ(view.dest_port, 80);
+    CHECK_EQ(view.tcp_seq, 1000u);
+    CHECK_EQ(view.tcp_ack, 2000u);
+    CHECK_EQ(view.tcp_window, 4096);
+    CHECK_EQ(view.tcp_flags, TCP_ACK | TCP_PSH);
+    CHECK_EQ(view.size, packet.size());
+    CHECK_EQ(view.l4_offset, 20);
+    CHECK_EQ(view.payload_offset, 40);
+    CHECK_EQ(view.payload_length, sizeof(payload) - 1);
+    CHECK(std::memcmp(view.payload(), payload, sizeof(payload) - 1) == 0);
+}
+
+void testIpv4UdpIgnoresLinkPadding()
+{
+    const uint8_t payload[] = {1, 2, 3, 4};
+    std::vector<uint8_t> packet = udpPacket(0x0A000002, 5353, 0xE00000FB, 5353, payload, sizeof(payload));
+    size_t datagram = packet.size();
+    // Minimum-size Ethernet frames pad the datagram with trailing zeros
+    packet.resize(60, 0);
+
+    PacketView view;
+    CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+    CHECK(view.protocol == Protocol::UDP);
+    CHECK_EQ(view.size, datagram);
+    CHECK_EQ(view.payload_length, sizeof(payload));
+}
+
+void testRejectsMalformedIpv4()
+{
+    std::vector<uint8_t> packet = udpPacket(0x0A000002, 1, 0x0A000003, 2);
+    PacketView view;
+
+    CHECK(!PacketParser::parseInto(packet.data(), 19, view));
+
+    std::vector<uint8_t> bad_ihl = packet;
+    bad_ihl[0] = 0x44; // 16-byte header
+    CHECK(!PacketParser::parseInto(bad_ihl.data(), bad_ihl.size(), view));
+
+    std::vector<uint8_t> bad_version = packet;
+    bad_version[0] = 0x55;
+    CHECK(!PacketParser::parseInto(bad_version.data(), bad_version.size(), view));
+}
+
+void testIpv6ExtensionHeaders()
+{
+    // Hop-by-hop (8 bytes) -> destination options (16 bytes) -> TCP
+    std::vector<uint8_t> packet = ipv6Header(0);
+    appendExtension(packet, 60, 1);
+    appendExtension(packet, 6, 2);
+    appendTcp(packet, 443, 50000, TCP_SYN | TCP_ACK, "hi");
+    setIpv6PayloadLength(packet);
+
+    PacketView view;
+    CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+    CHECK(view.protocol == Protocol::TCP);
+    CHECK_EQ(view.ip_version, 6);
+    CHECK_EQ(view.ip_protocol, 6);
+    CHECK_EQ(view.l4_offset, 40 + 8 + 16);
+    CHECK_EQ(view.source_port, 443);
+    CHECK_EQ(view.dest_port, 50000);
+    CHECK_EQ(view.tcp_flags, TCP_SYN | TCP_ACK);
+    CHECK_EQ(view.payload_length, 2u);
+    CHECK_STR(PacketParser::addressToString(view.source_addr, 6), "2001:db8::1");
+    CHECK_STR(PacketParser::addressToString(view.dest_addr, 6), "2001:db8::2");
+
+    // Routing header then UDP
+    std::vector<uint8_t> routed = ipv6Header(43);
+    appendExtension(routed, 17, 3);
+    routed.resize(routed.size() + 8, 0);
+    routed[40 + 24 + 1] = 53;
+    routed[40 + 24 + 3] = 53;
+    setIpv6PayloadLength(routed);
+    CHECK(PacketParser::parseInto(routed.data(), routed.size(), view));
+    CHECK(view.protocol == Protocol::UDP);
+    CHECK_EQ(view.l4_offset, 40 + 24);
+    CHECK_EQ(view.dest_port, 53);
+
+    // An ICMPv6 packet carries no ports
+    std::vector<uint8_t> icmp = ipv6Header(58);
+    icmp.resize(48, 0);
+    setIpv6PayloadLength(icmp);
+    CHECK(PacketParser::parseInto(icmp.data(), icmp.size(), view));
+    CHECK(view.protocol == Protocol::ICMPv6);
+    CHECK_EQ(view.source_port, 0);
+}
+
+void testRejectsTruncatedIpv6Extension()
+{
+    // The hop-by-hop header claims 24 bytes, but only 8 were captured
+    std::vector<uint8_t> packet = ipv6Header(0);
+    appendExtension(packet, 6, 1);
+    packet[41] = 2;
+    setIpv6PayloadLength(packet);
+
+    PacketView view;
+    CHECK(!PacketParser::parseInto(packet.data(), packet.size(), view));
+    CHECK(!PacketParser::parseInto(packet.data(), 39, view));
+}
+
+void testPacketInfoFormatting()
+{
+    const uint8_t payload[] = {0xde, 0xad, 0xbe, 0xef, 0x00};
+    std::vector<uint8_t> packet = udpPacket(0x0A000002, 1234, 0x08080808, 53, payload, sizeof(payload));
+
+    PacketInfo info = PacketParser::parsePacket(packet.data(), static_cast<int>(packet.size()));
+    CHECK(info.valid());
+    CHECK_STR(info.sourceIp(), "10.0.0.2");
+    CHECK_STR(info.destIp(), "8.8.8.8");
+    CHECK_STR(info.protocolName(), "UDP");
+    CHECK_STR(info.payloadHex(), "de ad be ef 00");
+    CHECK_STR(info.payloadHex(3), "de ad be...");
+
+    CHECK(!PacketParser::parsePacket(packet.data(), 0).valid());
+}
+
+} // namespace
+
+int main()
+{
+    testIpv4Tcp();
+    testIpv4UdpIgnoresLinkPadding();
+    testRejectsMalformedIpv4();
+    testIpv6ExtensionHeaders();
+    testRejectsTruncatedIpv6Extension();
+    testPacketInfoFormatting();
+    return testResult("packet_parser_test");
+}
@@ -0,0 +1,225 @@
+#include "pcapng_writer.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+uint32_t get32(const std::vector<uint8_t> &file, size_t offset)
+{
+    uint32_t value;
+    std::memcpy(&value, &file[offset], sizeof(value));
+    return value;
+}
+
+uint16_t get16(const std::vector<uint8_t> &file, size_t offset)
+{
+    uint16_t value;
+    std::memcpy(&value, &file[offset], sizeof(value));
+    return value;
+}
+
+std::vector<uint8_t> readFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool exists(const std::string &path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+std::string tempPrefix(const char *name)
+{
+    char directory[] = "/tmp/pcapng_writer_testXXXXXX";
+    const char *created = mkdtemp(directory);
+    return std::string(created ? created : "/tmp") + "/" + name;
+}
+
+struct TestPacket
+{
+    std::vector<uint8_t> bytes;
+    PacketBuffer buffer;
+
+    TestPacket(const std::vector<uint8_t> &packet, uint64_t timestamp_ns, uint32_t wire_length = 0) : bytes(packet)
+    {
+        buffer.data = bytes.data();
+        buffer.capacity = static_cast<uint32_t>(bytes.size());
+        buffer.length = static_cast<uint32_t>(bytes.size());
+        buffer.wire_length = wire_length ? wire_length : buffer.length;
+        buffer.timestamp_ns = timestamp_ns;
+    }
+};
+
+struct Block
+{
+    uint32_t type;
+    size_t offset;
+    uint32_t length;
+};
+
+// Splits a file into blocks, checking each one's leading and trailing lengths agree
+std::vector<Block> blocksOf(const std::vector<uint8_t> &file)
+{
+    std::vector<Block> blocks;
+    size_t offset = 0;
+    while (offset + 12 <= file.size())
+    {
+        uint32_t length = get32(file, offset + 4);
+        CHECK(length % 4 == 0 && length >= 12);
+        if (length < 12 || offset + length > file.size())
+        {
+            CHECK(false);
+            break;
+        }
+        CHECK_EQ(get32(file, offset + length - 4), length);
+        blocks.push_back(Block{get32(file, offset), offset, length});
+        offset += length;
+    }
+    CHECK_EQ(offset, file.size());
+    return blocks;
+}
+
+void testBlockLayout()
+{
+    std::string prefix = tempPrefix("layout");
+    PcapngOptions options;
+    options.path_prefix = prefix;
+    options.snaplen = 40;
+
+    const uint8_t payload[] = {'p', 'i', 'n', 'g', '!'};
+    // 33 bytes: not a multiple of 4, so the packet data is padded
+    TestPacket small(udpPacket(0x0A000001, 1000, 0x0A000002, 2000, payload, sizeof(payload)),
+                     0x0000000123456789ULL);
+    // Larger than the snaplen, so it is truncated
+    std::vector<uint8_t> large_payload(100, 0x5A);
+    TestPacket large(udpPacket(0x0A000001, 1000, 0x0A000002, 2000, large_payload.data(), large_payload.size()),
+                     0x0000000223456789ULL, 1400);
+
+    PcapngWriter writer;
+    std::string error;
+    CHECK(writer.open(options, error));
+    writer.write(small.buffer);
+    writer.write(large.buffer);
+    writer.close();
+
+    PcapngStats stats = writer.stats();
+    CHECK_EQ(stats.packets, 2u);
+    CHECK_EQ(stats.files, 1u);
+    CHECK(!stats.failed);
+
+    std::vector<uint8_t> file = readFile(prefix + "_00001.pcapng");
+    CHECK_EQ(stats.bytes_written, file.size());
+    std::vector<Block> blocks = blocksOf(file);
+    CHECK_EQ(blocks.size(), 4u);
+    if (blocks.size() != 4)
+    {
+        return;
+    }
+
+    // Section header: magic, version 1.0, unknown section length
+    CHECK_EQ(blocks[0].type, 0x0A0D0D0Au);
+    CHECK_EQ(get32(file, 8), 0x1A2B3C4Du);
+    CHECK_EQ(get16(file, 12), 1);
+    CHECK_EQ(get16(file, 14), 0);
+    CHECK_EQ(get32(file, 16), 0xFFFFFFFFu);
+
+    // Interface: raw IP, the snaplen, if_tsresol = 9 (ns)
+    size_t idb = blocks[1].offset;
+    CHECK_EQ(blocks[1].type, 1u);
+    CHECK_EQ(get16(file, idb + 8), 101);
+    CHECK_EQ(get32(file, idb + 12), 40u);
+    CHECK_EQ(get16(file, idb + 16), 9);
+    CHECK_EQ(get16(file, idb + 18), 1);
+    CHECK_EQ(file[idb + 20], 9);
+
+    size_t epb = blocks[2].offset;
+    CHECK_EQ(blocks[2].type, 6u);
+    CHECK_EQ(blocks[2].length, 28u + 36 + 4);
+    CHECK_EQ(get32(file, epb + 8), 0u);
+    CHECK_EQ(get32(file, epb + 12), 0x00000001u);
+    CHECK_EQ(get32(file, epb + 16), 0x23456789u);
+    CHECK_EQ(get32(file, epb + 20), small.bytes.size());
+    CHECK_EQ(get32(file, epb + 24), small.bytes.size());
+    CHECK(std::memcmp(&file[epb + 28], small.bytes.data(), small.bytes.size()) == 0);
+    for (size_t i = small.bytes.size(); i < 36; ++i)
+    {
+        CHECK_EQ(file[epb + 28 + i], 0);
+    }
+
+    epb = blocks[3].offset;
+    CHECK_EQ(blocks[3].type, 6u);
+    CHECK_EQ(get32(file, epb + 12), 0x00000002u);
+    CHECK_EQ(get32(file, epb + 20), 40u);
+    CHECK_EQ(get32(file, epb + 24), 1400u);
+    CHECK(std::memcmp(&file[epb + 28], large.bytes.data(), 40) == 0);
+}
+
+void testRotationAndRing()
+{
+    std::string prefix = tempPrefix("ring");
+    PcapngOptions options;
+    options.path_prefix = prefix;
+    options.max_file_bytes = 420;
+    options.ring_files = 2;
+
+    std::vector<uint8_t> payload(100, 0x42);
+    PcapngWriter writer;
+    std::string error;
+    CHECK(writer.open(options, error));
+    // Headers take 84 bytes and each packet 160, so two packets per file
+    for (uint64_t i = 0; i < 9; ++i)
+    {
+        TestPacket packet(udpPacket(0x0A000001, 1000, 0x0A000002, 2000, payload.data(), payload.size()),
+                          (i + 1) * 1000);
+        writer.write(packet.buffer);
+    }
+    writer.close();
+
+    CHECK_EQ(writer.stats().files, 5u);
+    CHECK(!exists(prefix + "_00003.pcapng"));
+    CHECK(exists(prefix + "_00004.pcapng"));
+    CHECK(exists(prefix + "_00005.pcapng"));
+
+    // Every file is self-contained: headers first, then its packets
+    std::vector<uint8_t> file = readFile(prefix + "_00004.pcapng");
+    std::vector<Block> blocks = blocksOf(file);
+    CHECK_EQ(blocks.size(), 4u);
+    CHECK(file.size() <= 420);
+    if (blocks.size() == 4)
+    {
+        CHECK_EQ(blocks[0].type, 0x0A0D0D0Au);
+        CHECK_EQ(blocks[1].type, 1u);
+        CHECK_EQ(get32(file, blocks[2].offset + 16), 7000u);
+    }
+
+    std::vector<Block> last = blocksOf(readFile(prefix + "_00005.pcapng"));
+    CHECK_EQ(last.size(), 3u);
+}
+
+void testOpenFailsOnBadPath()
+{
+    PcapngOptions options;
+    options.path_prefix = "/nonexistent-directory/capture";
+    PcapngWriter writer;
+    std::string error;
+    CHECK(!writer.open(options, error));
+    CHECK(!error.empty());
+}
+
+} // namespace
+
+int main()
+{
+    testBlockLayout();
+    testRotationAndRing();
+    testOpenFailsOnBadPath();
+    return testResult("pcapng_writer_test");
+}
@@ -0,0 +1,185 @@
+#include "session_manager.h"
+#include "capture_clock.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+int openDescriptor()
+{
+    return open("/dev/null", O_RDONLY);
+}
+
+bool isOpen(int fd)
+{
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+void testStaleHandleAfterClose()
+{
+    SessionManager &manager = SessionManager::getInstance();
+    manager.reset();
+
+    SessionKey first = udpKey(1, 1000);
+    SessionHandle handle = manager.openSession(first);
+    CHECK(handle.valid());
+    CHECK_EQ(handle.generation % 2, 1u);
+
+    // The same key names the same session
+    SessionHandle again = manager.openSession(first);
+    CHECK_EQ(again.index, handle.index);
+    CHECK_EQ(again.generation, handle.generation);
+
+    manager.updateSession(first, 100, true);
+    manager.updateSession(first, 40, false);
+    SessionCounters counters;
+    CHECK(manager.readCounters(handle, counters));
+    CHECK_EQ(counters.bytes_sent, 100u);
+    CHECK_EQ(counters.packets_sent, 1u);
+    CHECK_EQ(counters.bytes_received, 40u);
+
+    manager.closeSession(first);
+    CHECK(!manager.readCounters(handle, counters));
+
+    // The freed slot goes to the next session under a newer generation;
+    // the old handle must not reach it
+    SessionKey second = udpKey(2, 2000);
+    SessionHandle reused = manager.openSession(second);
+    CHECK_EQ(reused.index, handle.index);
+    CHECK_EQ(reused.generation, handle.generation + 2);
+    CHECK(!manager.readCounters(handle, counters));
+    CHECK(manager.readCounters(reused, counters));
+    CHECK_EQ(counters.bytes_sent, 0u);
+
+    int fd = openDescriptor();
+    CHECK(!manager.attachSocket(handle, fd));
+    CHECK_EQ(manager.getSocketFd(second), -1);
+    CHECK(manager.attachSocket(reused, fd));
+    CHECK_EQ(manager.getSocketFd(second), fd);
+
+    // A session holds one socket; a second attach leaves it with the caller
+    int other = openDescriptor();
+    CHECK(!manager.attachSocket(reused, other));
+    close(other);
+
+    manager.closeSession(second);
+    CHECK(!isOpen(fd));
+    CHECK(!manager.readCounters(reused, counters));
+    CHECK(!manager.readCounters(SessionHandle(), counters));
+    CHECK(!manager.readCounters(SessionHandle(SessionManager::MAX_SESSIONS, 1), counters));
+}
+
+void testEvictionAndExpiryInvalidateHandles()
+{
+    SessionManager &manager = SessionManager::getInstance();
+    manager.reset();
+    manager.setLimits(2, 0);
+
+    SessionHandle a = manager.openSession(udpKey(1, 1));
+    SessionHandle b = manager.openSession(udpKey(1, 2));
+    int fd = openDescriptor();
+    CHECK(manager.attachSocket(a, fd));
+
+    // A third session evicts one of the first two, closing its socket
+    SessionHandle c = manager.openSession(udpKey(1, 3));
+    CHECK(c.valid());
+    SessionCounters counters;
+    bool a_live = manager.readCounters(a, counters);
+    bool b_live = manager.readCounters(b, counters);
+    CHECK(a_live != b_live);
+    CHECK_EQ(isOpen(fd), a_live);
+    if (a_live)
+    {
+        manager.closeSession(udpKey(1, 1));
+    }
+    CHECK_EQ(manager.stats().evicted, 1u);
+
+    // Idle UDP sessions expire after 30 s
+    manager.expireSessions(CaptureClock::monotonicMs() + 31000);
+    CHECK(!manager.readCounters(c, counters));
+    CHECK_EQ(manager.stats().sessions, 0u);
+    CHECK(manager.stats().expired >= 1);
+
+    // No count means the default, not a one-session table
+    manager.setLimits(0, 0);
+    CHECK_EQ(manager.stats().max_sessions, 4096u);
+    manager.reset();
+}
+
+SessionKey tcpKey(uint16_t port)
+{
+    std::vector<uint8_t> packet = tcpPacket(0x0A000002, port, 0xC0000201, 443, 1, 0, TCP_SYN);
+    PacketView view;
+    PacketParser::parseInto(packet.data(), packet.size(), view);
+    return SessionKey::fromPacket(view);
+}
+
+void testHalfClosedAndConfiguredTimeouts()
+{
+    SessionManager &manager = SessionManager::getInstance();
+    manager.reset();
+    // Ahead of the clock the earlier tests left behind
+    uint64_t t0 = CaptureClock::monotonicMs() + 100000;
+    manager.expireSessions(t0);
+
+    SessionHandle open = manager.openSession(tcpKey(1000));
+    SessionHandle half_closed = manager.openSession(tcpKey(1001));
+    manager.markHalfClosed(tcpKey(1001));
+
+    // A flow one side has finished with idles out long before an open one
+    SessionCounters counters;
+    manager.expireSessions(t0 + 31000);
+    CHECK(manager.readCounters(open, counters));
+    CHECK(!manager.readCounters(half_closed, counters));
+
+    // A shorter timeout applies to the live session straight away
+    SessionTimeouts timeouts;
+    timeouts.tcp_established_ms = 60000;
+    manager.setTimeouts(timeouts);
+    manager.expireSessions(t0 + 59000);
+    CHECK(manager.readCounters(open, counters));
+    manager.expireSessions(t0 + 62000);
+    CHECK(!manager.readCounters(open, counters));
+
+    manager.setTimeouts(SessionTimeouts());
+    manager.reset();
+}
+
+void testResetInvalidatesEveryHandle()
+{
+    SessionManager &manager = SessionManager::getInstance();
+    manager.reset();
+
+    SessionHandle handles[300];
+    for (uint16_t i = 0; i < 300; ++i)
+    {
+        handles[i] = manager.openSession(udpKey(3, static_cast<uint16_t>(i + 1)));
+        CHECK(handles[i].valid());
+    }
+    // Past one 256-slot chunk
+    CHECK(manager.stats().slab_slots >= 300);
+
+    manager.reset();
+    SessionCounters counters;
+    size_t live = 0;
+    for (const SessionHandle &handle : handles)
+    {
+        live += manager.readCounters(handle, counters) ? 1 : 0;
+    }
+    CHECK_EQ(live, 0u);
+    CHECK_EQ(manager.stats().sessions, 0u);
+}
+
+} // namespace
+
+int main()
+{
+    testStaleHandleAfterClose();
+    testEvictionAndExpiryInvalidateHandles();
+    testHalfClosedAndConfiguredTimeouts();
+    testResetInvalidatesEveryHandle();
+    return testResult("session_manager_test");
+}
@@ -0,0 +1,156 @@
+#include "tcp_metrics.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+namespace
+{
+
+const uint64_t NS_PER_MS = 1000000ULL;
+const uint32_t CLIENT = 0x0A000002;
+const uint32_t SERVER = 0xC0000201;
+const uint8_t FROM_CLIENT = 0;
+const uint8_t FROM_SERVER = 1;
+const uint32_t CLIENT_ISN = 100;
+const uint32_t SERVER_ISN = 500;
+
+struct Connection
+{
+    TcpMetrics metrics;
+
+    void segment(uint8_t direction, uint32_t seq, uint32_t ack, uint8_t flags, uint64_t timestamp_ns,
+                 size_t payload_length = 0, uint16_t window = 65535)
+    {
+        std::vector<uint8_t> payload(payload_length, 'x');
+        std::vector<uint8_t> packet =
+            direction == FROM_CLIENT
+                ? tcpPacket(CLIENT, 40000, SERVER, 443, seq, ack, flags, window, payload.data(), payload.size())
+                : tcpPacket(SERVER, 443, CLIENT, 40000, seq, ack, flags, window, payload.data(), payload.size());
+        PacketView view;
+        CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+        view.timestamp_ns = timestamp_ns;
+        metrics.update(view, direction, FROM_CLIENT);
+    }
+
+    // SYN, SYN-ACK 10 ms later and the client's ACK 10 ms after that
+    void handshake(uint64_t t0)
+    {
+        segment(FROM_CLIENT, CLIENT_ISN, 0, TCP_SYN, t0);
+        segment(FROM_SERVER, SERVER_ISN, CLIENT_ISN + 1, TCP_SYN | TCP_ACK, t0 + 10 * NS_PER_MS);
+        segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK, t0 + 20 * NS_PER_MS);
+    }
+};
+
+void testHandshakeAndDataRtt()
+{
+    Connection connection;
+    TcpMetrics &metrics = connection.metrics;
+    uint64_t t0 = 1000 * NS_PER_MS;
+    connection.handshake(t0);
+
+    CHECK_EQ(metrics.handshake_rtt_us, 20000u);
+    // Each side's SYN is timed until the other acknowledges it
+    CHECK_EQ(metrics.rtt_samples[FROM_CLIENT], 1u);
+    CHECK_EQ(metrics.srtt_us[FROM_CLIENT], 10000u);
+    CHECK_EQ(metrics.rtt_samples[FROM_SERVER], 1u);
+    CHECK_EQ(metrics.srtt_us[FROM_SERVER], 10000u);
+
+    // Client data acknowledged 2 ms later
+    uint64_t t1 = t0 + 100 * NS_PER_MS;
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK | TCP_PSH, t1, 100);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 101, TCP_ACK, t1 + 2 * NS_PER_MS);
+    CHECK_EQ(metrics.rtt_samples[FROM_CLIENT], 2u);
+    CHECK_EQ(metrics.min_rtt_us[FROM_CLIENT], 2000u);
+    CHECK_EQ(metrics.srtt_us[FROM_CLIENT], (7u * 10000u + 2000u) / 8);
+    CHECK_EQ(metrics.retransmits[FROM_CLIENT], 0u);
+    CHECK_EQ(metrics.out_of_order[FROM_CLIENT], 0u);
+
+    // A new SYN on the tuple starts the handshake timing afresh
+    connection.segment(FROM_CLIENT, 9000, 0, TCP_SYN, t1 + 1000 * NS_PER_MS);
+    CHECK_EQ(metrics.handshake_rtt_us, 0u);
+}
+
+void testResendIsCountedAndNotTimed()
+{
+    Connection connection;
+    TcpMetrics &metrics = connection.metrics;
+    uint64_t t0 = 2000 * NS_PER_MS;
+    connection.handshake(t0);
+
+    // Sent again well past the smoothed RTT: a retransmission, and Karn's
+    // rule keeps the acknowledgement that follows from being timed
+    uint64_t t1 = t0 + 100 * NS_PER_MS;
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK, t1, 100);
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK, t1 + 200 * NS_PER_MS, 100);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 101, TCP_ACK, t1 + 205 * NS_PER_MS);
+    CHECK_EQ(metrics.retransmits[FROM_CLIENT], 1u);
+    CHECK_EQ(metrics.out_of_order[FROM_CLIENT], 0u);
+    CHECK_EQ(metrics.rtt_samples[FROM_CLIENT], 1u);
+    CHECK_EQ(metrics.srtt_us[FROM_CLIENT], 10000u);
+
+    // The next fresh segment is timed again
+    uint64_t t2 = t1 + 300 * NS_PER_MS;
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 101, SERVER_ISN + 1, TCP_ACK, t2, 100);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 201, TCP_ACK, t2 + 4 * NS_PER_MS);
+    CHECK_EQ(metrics.rtt_samples[FROM_CLIENT], 2u);
+    CHECK_EQ(metrics.min_rtt_us[FROM_CLIENT], 4000u);
+}
+
+void testReorderAndBackwardTimestamps()
+{
+    Connection connection;
+    TcpMetrics &metrics = connection.metrics;
+    uint64_t t0 = 3000 * NS_PER_MS;
+    connection.handshake(t0);
+
+    // The second segment overtakes the first by 1 ms, inside the RTT
+    uint64_t t1 = t0 + 100 * NS_PER_MS;
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 101, SERVER_ISN + 1, TCP_ACK, t1, 100);
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK, t1 + NS_PER_MS, 100);
+    CHECK_EQ(metrics.out_of_order[FROM_CLIENT], 1u);
+    CHECK_EQ(metrics.retransmits[FROM_CLIENT], 0u);
+
+    // A trailing segment stamped before the advance it trails is
+    // reordered, not a resend a wrapped gap would make it look like
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 1, SERVER_ISN + 1, TCP_ACK, t1 - 50 * NS_PER_MS, 100);
+    CHECK_EQ(metrics.out_of_order[FROM_CLIENT], 2u);
+    CHECK_EQ(metrics.retransmits[FROM_CLIENT], 0u);
+
+    // An acknowledgement stamped before its probe yields no sample
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 201, TCP_ACK, t1 - 10 * NS_PER_MS);
+    CHECK_EQ(metrics.rtt_samples[FROM_CLIENT], 1u);
+    CHECK_EQ(metrics.srtt_us[FROM_CLIENT], 10000u);
+
+    // New data stamped in the past does not drag the reorder window back
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 201, SERVER_ISN + 1, TCP_ACK, t1 - 20 * NS_PER_MS, 100);
+    connection.segment(FROM_CLIENT, CLIENT_ISN + 201, SERVER_ISN + 1, TCP_ACK, t1 + 2 * NS_PER_MS, 100);
+    CHECK_EQ(metrics.out_of_order[FROM_CLIENT], 3u);
+    CHECK_EQ(metrics.retransmits[FROM_CLIENT], 0u);
+}
+
+void testZeroWindowsCountedOncePerClosure()
+{
+    Connection connection;
+    TcpMetrics &metrics = connection.metrics;
+    uint64_t t0 = 4000 * NS_PER_MS;
+    connection.handshake(t0);
+
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 1, TCP_ACK, t0 + 30 * NS_PER_MS, 0, 0);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 1, TCP_ACK, t0 + 40 * NS_PER_MS, 0, 0);
+    CHECK_EQ(metrics.zero_windows[FROM_SERVER], 1u);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 1, TCP_ACK, t0 + 50 * NS_PER_MS, 0, 8192);
+    connection.segment(FROM_SERVER, SERVER_ISN + 1, CLIENT_ISN + 1, TCP_ACK, t0 + 60 * NS_PER_MS, 0, 0);
+    CHECK_EQ(metrics.zero_windows[FROM_SERVER], 2u);
+    CHECK_EQ(metrics.zero_windows[FROM_CLIENT], 0u);
+}
+
+} // namespace
+
+int main()
+{
+    testHandshakeAndDataRtt();
+    testResendIsCountedAndNotTimed();
+    testReorderAndBackwardTimestamps();
+    testZeroWindowsCountedOncePerClosure();
+    return testResult("tcp_metrics_test");
+}
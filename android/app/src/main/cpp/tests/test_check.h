@@ -0,0 +1,62 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// Minimal assertions for the host tests: each test file is one executable
+// whose main() runs its cases and returns testResult(). A failed check
+// prints its location and the test carries on, so one run reports every
+// broken expectation.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static int g_test_failures = 0;
+
+#define CHECK(condition)                                                           \
+    do                                                                             \
+    {                                                                              \
+        if (!(condition))                                                          \
+        {                                                                          \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                         #condition);                                              \
+            g_test_failures++;                                                     \
+        }                                                                          \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                           \
+    do                                                                                       \
+    {                                                                                        \
+        if (!((actual) == (expected)))                                                       \
+        {                                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: got %lld, expected %lld\n", \
+                         __FILE__, __LINE__, #actual, #expected,                             \
+                         static_cast<long long>(actual), static_cast<long long>(expected));  \
+            g_test_failures++;                                                               \
+        }                                                                                    \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                                               \
+    do                                                                                            \
+    {                                                                                             \
+        std::string actual_value(actual);                                                         \
+        std::string expected_value(expected);                                                     \
+        if (actual_value != expected_value)                                                       \
+        {                                                                                         \
+            std::fprintf(stderr, "%s:%d: CHECK_STR(%s) failed:\n  got      \"%s\"\n  expected \"%s\"\n", \
+                         __FILE__, __LINE__, #actual, actual_value.c_str(), expected_value.c_str());     \
+            g_test_failures++;                                                                    \
+        }                                                                                         \
+    } while (0)
+
+static inline int testResult(const char *name)
+{
+    if (g_test_failures > 0)
+    {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, g_test_failures);
+        return 1;
+    }
+    std::printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif // TEST_CHECK_H
@@ -0,0 +1,64 @@
+#ifndef TEST_PACKETS_H
+#define TEST_PACKETS_H
+
+// Packets and keys for the host tests, crafted with PacketBuilder so they
+// carry valid lengths and checksums
+
+#include "packet_builder.h"
+#include "packet_parser.h"
+#include "session_key.h"
+#include <cstdint>
+#include <vector>
+
+static inline void testAddress(uint32_t host_order, uint8_t out[4])
+{
+    out[0] = static_cast<uint8_t>(host_order >> 24);
+    out[1] = static_cast<uint8_t>(host_order >> 16);
+    out[2] = static_cast<uint8_t>(host_order >> 8);
+    out[3] = static_cast<uint8_t>(host_order);
+}
+
+static inline std::vector<uint8_t> udpPacket(uint32_t source, uint16_t source_port, uint32_t dest,
+                                             uint16_t dest_port, const uint8_t *payload = nullptr,
+                                             size_t payload_length = 0)
+{
+    uint8_t source_addr[4];
+    uint8_t dest_addr[4];
+    testAddress(source, source_addr);
+    testAddress(dest, dest_addr);
+
+    std::vector<uint8_t> packet(2048);
+    size_t length = PacketBuilder::buildUdp(packet.data(), packet.size(), source_addr, source_port, dest_addr,
+                                            dest_port, payload, payload_length);
+    packet.resize(length);
+    return packet;
+}
+
+static inline std::vector<uint8_t> tcpPacket(uint32_t source, uint16_t source_port, uint32_t dest,
+                                             uint16_t dest_port, uint32_t seq, uint32_t ack, uint8_t flags,
+                                             uint16_t window = 65535, const uint8_t *payload = nullptr,
+                                             size_t payload_length = 0, uint16_t mss_option = 0)
+{
+    uint8_t source_addr[4];
+    uint8_t dest_addr[4];
+    testAddress(source, source_addr);
+    testAddress(dest, dest_addr);
+
+    std::vector<uint8_t> packet(2048);
+    size_t length = PacketBuilder::buildTcp(packet.data(), packet.size(), source_addr, source_port, dest_addr,
+                                            dest_port, seq, ack, flags, window, mss_option, payload,
+                                            payload_length);
+    packet.resize(length);
+    return packet;
+}
+
+// UDP key from 10.0.0.<host>:<port> to 192.0.2.1:53
+static inline SessionKey udpKey(uint8_t host, uint16_t port)
+{
+    std::vector<uint8_t> packet = udpPacket(0x0A000000 | host, port, 0xC0000201, 53);
+    PacketView view;
+    PacketParser::parseInto(packet.data(), packet.size(), view);
+    return SessionKey::fromPacket(view);
+}
+
+#endif // TEST_PACKETS_H
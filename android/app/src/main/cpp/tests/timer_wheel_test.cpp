@@ -0,0 +1,121 @@
+#include "timer_wheel.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <vector>
+
+namespace
+{
+
+struct Fired
+{
+    SessionKey key;
+    uint64_t deadline_ms;
+    uint64_t at_ms;
+};
+
+// Advances one tick at a time, recording when each entry fires
+void runUntil(TimerWheel &wheel, uint64_t &now_ms, uint64_t until_ms, std::vector<Fired> &fired)
+{
+    while (now_ms < until_ms)
+    {
+        now_ms += 1000;
+        uint64_t at_ms = now_ms;
+        wheel.advance(now_ms, [&fired, at_ms](const TimerWheel::Entry &entry)
+                      { fired.push_back(Fired{entry.key, entry.deadline_ms, at_ms}); });
+    }
+}
+
+void testFiresAtDeadline()
+{
+    TimerWheel wheel;
+    uint64_t now_ms = 5000;
+    wheel.advance(now_ms, [](const TimerWheel::Entry &) {});
+
+    wheel.schedule(udpKey(1, 1000), now_ms + 3000);
+    wheel.schedule(udpKey(2, 1000), now_ms + 2500); // rounds up to the next tick
+    CHECK_EQ(wheel.size(), 2u);
+
+    std::vector<Fired> fired;
+    runUntil(wheel, now_ms, 7000, fired);
+    CHECK(fired.empty());
+
+    runUntil(wheel, now_ms, 8000, fired);
+    CHECK_EQ(fired.size(), 2u);
+    for (const Fired &entry : fired)
+    {
+        CHECK(entry.at_ms >= entry.deadline_ms);
+        CHECK(entry.at_ms < entry.deadline_ms + 1000);
+    }
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+void testCascadesThroughOuterLevels()
+{
+    TimerWheel wheel;
+    uint64_t now_ms = 0;
+    wheel.advance(now_ms, [](const TimerWheel::Entry &) {});
+
+    // Level 1 (64 s .. 68 min) and level 2 (past 68 min)
+    SessionKey minutes = udpKey(1, 2000);
+    SessionKey hours = udpKey(2, 2000);
+    wheel.schedule(minutes, 100 * 1000);
+    wheel.schedule(hours, 5000 * 1000);
+
+    std::vector<Fired> fired;
+    runUntil(wheel, now_ms, 99 * 1000, fired);
+    CHECK(fired.empty());
+    runUntil(wheel, now_ms, 100 * 1000, fired);
+    CHECK_EQ(fired.size(), 1u);
+    CHECK(fired.size() == 1 && fired[0].key == minutes && fired[0].at_ms == 100 * 1000);
+
+    fired.clear();
+    runUntil(wheel, now_ms, 4999 * 1000, fired);
+    CHECK(fired.empty());
+    runUntil(wheel, now_ms, 5000 * 1000, fired);
+    CHECK_EQ(fired.size(), 1u);
+    CHECK(fired.size() == 1 && fired[0].key == hours && fired[0].at_ms == 5000 * 1000);
+}
+
+void testLongJumpFiresEverythingDue()
+{
+    TimerWheel wheel;
+    uint64_t now_ms = 1000;
+    wheel.advance(now_ms, [](const TimerWheel::Entry &) {});
+    for (uint16_t i = 0; i < 50; ++i)
+    {
+        wheel.schedule(udpKey(static_cast<uint8_t>(i), 3000), now_ms + (i + 1) * 7000);
+    }
+
+    size_t fired = 0;
+    wheel.advance(now_ms + 200 * 1000, [&fired, now_ms](const TimerWheel::Entry &entry)
+                  {
+                      CHECK(entry.deadline_ms <= now_ms + 200 * 1000);
+                      fired++;
+                  });
+    CHECK_EQ(fired, 28u); // deadlines up to 196 s out
+    CHECK_EQ(wheel.size(), 22u);
+}
+
+void testClearDropsEntries()
+{
+    TimerWheel wheel;
+    wheel.advance(0, [](const TimerWheel::Entry &) {});
+    wheel.schedule(udpKey(1, 4000), 2000);
+    wheel.clear();
+    CHECK_EQ(wheel.size(), 0u);
+
+    size_t fired = 0;
+    wheel.advance(10000, [&fired](const TimerWheel::Entry &) { fired++; });
+    CHECK_EQ(fired, 0u);
+}
+
+} // namespace
+
+int main()
+{
+    testFiresAtDeadline();
+    testCascadesThroughOuterLevels();
+    testLongJumpFiresEverythingDue();
+    testClearDropsEntries();
+    return testResult("timer_wheel_test");
+}
@@ -0,0 +1,188 @@
+#include "top_talkers.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+
+const uint32_t CLIENT = 0x0A000002;
+const uint32_t SERVER = 0xC0000201;
+
+const TalkerEntry *findEntry(const SpaceSaving &summary, const SessionKey &key)
+{
+    for (const TalkerEntry &entry : summary.entries())
+    {
+        if (entry.key == key)
+            return &entry;
+    }
+    return nullptr;
+}
+
+void testExactWhileFilling()
+{
+    SpaceSaving summary(4);
+    summary.add(udpKey(1, 1), 100, 1);
+    summary.add(udpKey(2, 2), 30, 1);
+    summary.add(udpKey(1, 1), 50, 1);
+
+    CHECK_EQ(summary.entries().size(), 2u);
+    CHECK_EQ(summary.minCount(), 0u);
+    CHECK_EQ(summary.total(), 180u);
+    const TalkerEntry *heavy = findEntry(summary, udpKey(1, 1));
+    CHECK(heavy != nullptr);
+    if (heavy)
+    {
+        CHECK_EQ(heavy->count, 150u);
+        CHECK_EQ(heavy->error, 0u);
+        CHECK_EQ(heavy->other, 2u);
+    }
+}
+
+void testNewKeyTakesOverSmallestCounter()
+{
+    SpaceSaving summary(2);
+    summary.add(udpKey(1, 1), 10, 1);
+    summary.add(udpKey(2, 2), 3, 1);
+    CHECK_EQ(summary.minCount(), 3u);
+
+    // The third key evicts the lighter of the two and inherits its count
+    // as error; its passenger count starts afresh
+    summary.add(udpKey(3, 3), 1, 1);
+    CHECK_EQ(summary.entries().size(), 2u);
+    CHECK(findEntry(summary, udpKey(2, 2)) == nullptr);
+    const TalkerEntry *heavy = findEntry(summary, udpKey(1, 1));
+    const TalkerEntry *newcomer = findEntry(summary, udpKey(3, 3));
+    CHECK(heavy != nullptr && newcomer != nullptr);
+    if (heavy && newcomer)
+    {
+        CHECK_EQ(heavy->count, 10u);
+        CHECK_EQ(heavy->error, 0u);
+        CHECK_EQ(newcomer->count, 4u);
+        CHECK_EQ(newcomer->error, 3u);
+        CHECK_EQ(newcomer->other, 1u);
+    }
+    CHECK_EQ(summary.minCount(), 4u);
+
+    // The evicted key comes back the same way
+    summary.add(udpKey(2, 2), 1, 1);
+    const TalkerEntry *returned = findEntry(summary, udpKey(2, 2));
+    CHECK(returned != nullptr);
+    if (returned)
+    {
+        CHECK_EQ(returned->count, 5u);
+        CHECK_EQ(returned->error, 4u);
+    }
+    CHECK(findEntry(summary, udpKey(3, 3)) == nullptr);
+}
+
+void testErrorBoundsOnSkewedStream()
+{
+    const size_t capacity = 16;
+    const size_t keys = 200;
+    SpaceSaving summary(capacity);
+    std::vector<SessionKey> key_of(keys);
+    std::vector<uint64_t> truth(keys, 0);
+    for (size_t i = 0; i < keys; ++i)
+    {
+        key_of[i] = udpKey(static_cast<uint8_t>(i % 250 + 1), static_cast<uint16_t>(i + 1));
+    }
+
+    // A few heavy keys buried in a long tail, in a fixed pseudo-random order
+    uint32_t state = 12345;
+    for (int n = 0; n < 50000; ++n)
+    {
+        state = state * 1103515245 + 12345;
+        uint32_t draw = (state >> 8) % 1000;
+        size_t id = draw < 400 ? draw % 4 : 4 + draw % (keys - 4);
+        uint32_t weight = 40 + (state >> 20) % 1400;
+        summary.add(key_of[id], weight, 1);
+        truth[id] += weight;
+    }
+
+    uint64_t total = 0;
+    for (uint64_t count : truth)
+        total += count;
+    CHECK_EQ(summary.total(), total);
+    CHECK_EQ(summary.entries().size(), capacity);
+    // Counters only ever move weight around, never lose it
+    uint64_t counted = 0;
+    for (const TalkerEntry &entry : summary.entries())
+        counted += entry.count;
+    CHECK_EQ(counted, total);
+    CHECK(summary.minCount() <= total / capacity);
+
+    for (const TalkerEntry &entry : summary.entries())
+    {
+        size_t id = 0;
+        while (id < keys && !(key_of[id] == entry.key))
+            ++id;
+        CHECK(id < keys);
+        if (id == keys)
+            continue;
+        // Never an underestimate, and never off by more than the error
+        CHECK(entry.count >= truth[id]);
+        CHECK(entry.count - entry.error <= truth[id]);
+        CHECK(entry.error <= summary.minCount());
+    }
+
+    // Any key heavier than total / capacity is guaranteed a counter
+    for (size_t id = 0; id < keys; ++id)
+    {
+        if (truth[id] > total / capacity)
+            CHECK(findEntry(summary, key_of[id]) != nullptr);
+    }
+}
+
+uint64_t countOf(const SpaceSaving &summary, uint32_t address)
+{
+    std::vector<uint8_t> packet = udpPacket(address, 1, address, 1);
+    PacketView view;
+    PacketParser::parseInto(packet.data(), packet.size(), view);
+    const TalkerEntry *entry = findEntry(summary, TopTalkers::hostKey(view.source_addr, 4));
+    return entry ? entry->count : 0;
+}
+
+void testBytesAndPacketsRankedSeparately()
+{
+    TopTalkers talkers;
+    std::vector<uint8_t> payload(1400, 0);
+
+    // One host sends a few large datagrams, the other many small ones
+    for (int i = 0; i < 5; ++i)
+    {
+        std::vector<uint8_t> packet = udpPacket(CLIENT, 1000, SERVER, 53, payload.data(), payload.size());
+        PacketView view;
+        CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+        talkers.add(view);
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        std::vector<uint8_t> packet = udpPacket(CLIENT + 1, 1000, SERVER, 53);
+        PacketView view;
+        CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+        talkers.add(view);
+    }
+
+    CHECK(countOf(talkers.by_bytes.sources, CLIENT) > countOf(talkers.by_bytes.sources, CLIENT + 1));
+    CHECK_EQ(countOf(talkers.by_packets.sources, CLIENT), 5u);
+    CHECK_EQ(countOf(talkers.by_packets.sources, CLIENT + 1), 50u);
+    CHECK_EQ(talkers.by_packets.destinations.total(), 55u);
+    CHECK_EQ(talkers.by_packets.conversations.entries().size(), 2u);
+
+    talkers.clear();
+    CHECK_EQ(talkers.by_bytes.sources.total(), 0u);
+    CHECK_EQ(talkers.by_packets.sources.entries().size(), 0u);
+}
+
+} // namespace
+
+int main()
+{
+    testExactWhileFilling();
+    testNewKeyTakesOverSmallestCounter();
+    testErrorBoundsOnSkewedStream();
+    testBytesAndPacketsRankedSeparately();
+    return testResult("top_talkers_test");
+}
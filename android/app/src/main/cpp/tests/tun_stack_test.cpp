@@ -0,0 +1,302 @@
+#include "tun_stack.h"
+#include "socket_forwarder.h"
+#include "test_check.h"
+#include "test_packets.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// Drives TunStack the way the VPN does: packets an app "wrote" to the TUN
+// interface go in through handleOutbound(), and the replies the stack
+// crafts come out of one end of a SOCK_SEQPACKET socketpair. The upstream
+// side is a real TCP listener on the loopback interface.
+
+namespace
+{
+
+const uint32_t APP_ADDRESS = 0x0A000002; // 10.0.0.2
+const uint32_t LOOPBACK = 0x7F000001;
+const int REPLY_TIMEOUT_MS = 2000;
+
+struct Harness
+{
+    int tun[2];
+    int listener;
+    uint16_t port;
+
+    Harness() : listener(-1), port(0)
+    {
+        tun[0] = tun[1] = -1;
+        CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, tun) == 0);
+        TunStack::getInstance().setOutputFd(tun[0]);
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(LOOPBACK);
+        socklen_t length = sizeof(address);
+        CHECK(bind(listener, reinterpret_cast<struct sockaddr *>(&address), length) == 0);
+        CHECK(listen(listener, 4) == 0);
+        CHECK(getsockname(listener, reinterpret_cast<struct sockaddr *>(&address), &length) == 0);
+        port = ntohs(address.sin_port);
+    }
+
+    ~Harness()
+    {
+        TunStack::getInstance().reset();
+        close(listener);
+        close(tun[0]);
+        close(tun[1]);
+    }
+
+    // An app segment from 10.0.0.2:<app_port> to the listener
+    void send(uint16_t app_port, uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window = 65535,
+              const char *payload = nullptr, size_t payload_length = 0, uint16_t mss_option = 0)
+    {
+        std::vector<uint8_t> packet = tcpPacket(APP_ADDRESS, app_port, LOOPBACK, port, seq, ack, flags, window,
+                                                reinterpret_cast<const uint8_t *>(payload), payload_length,
+                                                mss_option);
+        PacketView view;
+        CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+        TunStack::getInstance().handleOutbound(view);
+    }
+
+    // Next packet the stack wrote to the TUN side, parsed into `view`
+    bool receive(std::vector<uint8_t> &packet, PacketView &view, int timeout_ms = REPLY_TIMEOUT_MS)
+    {
+        struct pollfd readable = {tun[1], POLLIN, 0};
+        if (poll(&readable, 1, timeout_ms) != 1)
+        {
+            return false;
+        }
+        packet.resize(65536);
+        ssize_t length = recv(tun[1], packet.data(), packet.size(), 0);
+        if (length <= 0)
+        {
+            return false;
+        }
+        packet.resize(static_cast<size_t>(length));
+        return PacketParser::parseInto(packet.data(), packet.size(), view);
+    }
+
+    bool quiet(int timeout_ms)
+    {
+        struct pollfd readable = {tun[1], POLLIN, 0};
+        return poll(&readable, 1, timeout_ms) == 0;
+    }
+};
+
+std::string payloadOf(const PacketView &view)
+{
+    return std::string(reinterpret_cast<const char *>(view.payload()), view.payload_length);
+}
+
+std::string receiveUpstream(int socket_fd, size_t length)
+{
+    std::string data;
+    char buffer[256];
+    while (data.size() < length)
+    {
+        ssize_t received = recv(socket_fd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        data.append(buffer, static_cast<size_t>(received));
+    }
+    return data;
+}
+
+// SYN in, SYN-ACK out once the upstream connect completes; returns the
+// stack's initial sequence number and the accepted upstream socket
+bool handshake(Harness &harness, uint16_t app_port, uint32_t app_isn, uint16_t window, uint32_t &iss,
+               int &upstream)
+{
+    harness.send(app_port, app_isn, 0, TCP_SYN, 65535, nullptr, 0, 1400);
+
+    upstream = accept(harness.listener, nullptr, nullptr);
+    CHECK(upstream >= 0);
+
+    std::vector<uint8_t> packet;
+    PacketView view;
+    if (!harness.receive(packet, view))
+    {
+        CHECK(false);
+        return false;
+    }
+    CHECK_EQ(view.tcp_flags, TCP_SYN | TCP_ACK);
+    CHECK_EQ(view.tcp_ack, app_isn + 1);
+    CHECK_EQ(view.source_port, harness.port);
+    CHECK_EQ(view.dest_port, app_port);
+    iss = view.tcp_seq;
+
+    harness.send(app_port, app_isn + 1, iss + 1, TCP_ACK, window);
+    return true;
+}
+
+void testHandshakeDataAndClose()
+{
+    Harness harness;
+    const uint16_t app_port = 40001;
+    const uint32_t app_isn = 1000;
+    uint32_t iss;
+    int upstream;
+    if (!handshake(harness, app_port, app_isn, 65535, iss, upstream))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> packet;
+    PacketView view;
+
+    // App to upstream: acknowledged once the socket has taken it
+    harness.send(app_port, app_isn + 1, iss + 1, TCP_ACK | TCP_PSH, 65535, "hello", 5);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_flags, TCP_ACK);
+    CHECK_EQ(view.tcp_ack, app_isn + 6);
+    CHECK_STR(receiveUpstream(upstream, 5), "hello");
+
+    // Upstream to app
+    CHECK_EQ(::send(upstream, "world!", 6, 0), 6);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_seq, iss + 1);
+    CHECK_EQ(view.tcp_ack, app_isn + 6);
+    CHECK_STR(payloadOf(view), "world!");
+    harness.send(app_port, app_isn + 6, iss + 7, TCP_ACK);
+
+    // App closes first: the FIN is acknowledged and upstream sees EOF
+    harness.send(app_port, app_isn + 6, iss + 7, TCP_FIN | TCP_ACK);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_flags, TCP_ACK);
+    CHECK_EQ(view.tcp_ack, app_isn + 7);
+    char byte;
+    CHECK_EQ(recv(upstream, &byte, 1, 0), 0);
+
+    // Upstream closes: our FIN follows, and the app's ACK ends the flow
+    close(upstream);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_flags, TCP_FIN | TCP_ACK);
+    CHECK_EQ(view.tcp_seq, iss + 7);
+    harness.send(app_port, app_isn + 7, iss + 8, TCP_ACK);
+    CHECK(harness.quiet(100));
+
+    // The flow is gone, so another segment on it is reset
+    harness.send(app_port, app_isn + 7, iss + 8, TCP_ACK);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_flags, TCP_RST);
+    CHECK_EQ(view.tcp_seq, iss + 8);
+}
+
+void testZeroWindowProbe()
+{
+    Harness harness;
+    const uint16_t app_port = 40002;
+    const uint32_t app_isn = 5000;
+    uint32_t iss;
+    int upstream;
+    // The app completes the handshake advertising no room at all
+    if (!handshake(harness, app_port, app_isn, 0, iss, upstream))
+    {
+        return;
+    }
+
+    std::vector<uint8_t> packet;
+    PacketView view;
+    CHECK_EQ(::send(upstream, "abcdef", 6, 0), 6);
+
+    // Nothing may be sent into the closed window until the timer probes it
+    // with a single byte
+    CHECK(harness.quiet(100));
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_seq, iss + 1);
+    CHECK_STR(payloadOf(view), "a");
+
+    // A reply that keeps the window shut holds the rest back, and the next
+    // probe still goes out rather than the flow being counted as lost
+    harness.send(app_port, app_isn + 1, iss + 1, TCP_ACK, 0);
+    CHECK(harness.quiet(100));
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_seq, iss + 1);
+    CHECK_EQ(view.payload_length, 1u);
+
+    // Reopening the window, having taken the probe byte, releases the rest
+    harness.send(app_port, app_isn + 1, iss + 2, TCP_ACK, 65535);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_seq, iss + 2);
+    CHECK_STR(payloadOf(view), "bcdef");
+
+    close(upstream);
+}
+
+void testUnknownFlowIsReset()
+{
+    Harness harness;
+    std::vector<uint8_t> packet;
+    PacketView view;
+
+    // A stray data segment with no ACK is answered RST|ACK covering it
+    harness.send(40003, 7000, 0, TCP_PSH, 65535, "xyz", 3);
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.tcp_flags, TCP_RST | TCP_ACK);
+    CHECK_EQ(view.tcp_ack, 7003u);
+    CHECK_EQ(view.dest_port, 40003);
+
+    // RSTs are never answered
+    harness.send(40003, 7003, 0, TCP_RST);
+    CHECK(harness.quiet(50));
+}
+
+void testUdpRelay()
+{
+    Harness harness;
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(LOOPBACK);
+    socklen_t length = sizeof(address);
+    CHECK(bind(server, reinterpret_cast<struct sockaddr *>(&address), length) == 0);
+    CHECK(getsockname(server, reinterpret_cast<struct sockaddr *>(&address), &length) == 0);
+    uint16_t server_port = ntohs(address.sin_port);
+
+    const uint8_t ping[] = {'p', 'i', 'n', 'g'};
+    std::vector<uint8_t> packet = udpPacket(APP_ADDRESS, 40004, LOOPBACK, server_port, ping, sizeof(ping));
+    PacketView view;
+    CHECK(PacketParser::parseInto(packet.data(), packet.size(), view));
+    TunStack::getInstance().handleOutbound(view);
+
+    char buffer[64];
+    struct sockaddr_in relay = {};
+    socklen_t relay_length = sizeof(relay);
+    CHECK_EQ(recvfrom(server, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr *>(&relay), &relay_length),
+             4);
+
+    // An empty datagram is data, not the end of the session: the one
+    // after it still comes through
+    CHECK_EQ(sendto(server, "", 0, 0, reinterpret_cast<struct sockaddr *>(&relay), relay_length), 0);
+    CHECK_EQ(sendto(server, "pong", 4, 0, reinterpret_cast<struct sockaddr *>(&relay), relay_length), 4);
+
+    CHECK(harness.receive(packet, view));
+    CHECK_EQ(view.protocol, Protocol::UDP);
+    CHECK_EQ(view.source_port, server_port);
+    CHECK_EQ(view.dest_port, 40004);
+    CHECK_EQ(view.payload_length, 0u);
+    CHECK(harness.receive(packet, view));
+    CHECK_STR(payloadOf(view), "pong");
+
+    close(server);
+}
+
+} // namespace
+
+int main()
+{
+    testHandshakeDataAndClose();
+    testZeroWindowProbe();
+    testUnknownFlowIsReset();
+    testUdpRelay();
+    SocketForwarder::getInstance().cleanup();
+    return testResult("tun_stack_test");
+}
@@ -0,0 +1,157 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "session_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Three-level hierarchical timing wheel of SessionKeys with 64 slots per
+// level. With a 1 s tick the levels span about 64 s, 68 min and 72 h;
+// later deadlines are clamped to the outermost slot. advance() visits
+// only the slots that came due, so expiry costs O(expired) plus the
+// occasional cascade rather than a scan of every flow.
+//
+// Entries are never moved when a flow sees traffic. The owner re-checks
+// each fired entry against the flow's real deadline and schedules it
+// again if the flow is still alive, which keeps the wheel off the
+// per-packet path. advance() must be called once before the first
+// schedule() so the wheel knows the current time.
+class TimerWheel
+{
+public:
+    struct Entry
+    {
+        SessionKey key;
+        uint64_t deadline_ms;
+    };
+
+    explicit TimerWheel(uint64_t tick_ms = 1000)
+        : tick_ms_(tick_ms), current_tick_(0), started_(false), size_(0)
+    {
+    }
+
+    void schedule(const SessionKey &key, uint64_t deadline_ms)
+    {
+        Entry entry{key, deadline_ms};
+        place(entry, current_tick_ + 1);
+        ++size_;
+    }
+
+    // Calls fn(const Entry &) for every entry whose slot fires at or before now_ms
+    template <typename Fn>
+    void advance(uint64_t now_ms, Fn fn)
+    {
+        uint64_t target_tick = now_ms / tick_ms_;
+        if (!started_ || size_ == 0)
+        {
+            if (!started_ || target_tick > current_tick_)
+            {
+                current_tick_ = target_tick;
+            }
+            started_ = true;
+            return;
+        }
+
+        while (current_tick_ < target_tick && size_ > 0)
+        {
+            ++current_tick_;
+
+            if ((current_tick_ & SLOT_MASK) == 0)
+            {
+                if (((current_tick_ >> SLOT_BITS) & SLOT_MASK) == 0)
+                {
+                    cascade(2, (current_tick_ >> (2 * SLOT_BITS)) & SLOT_MASK);
+                }
+                cascade(1, (current_tick_ >> SLOT_BITS) & SLOT_MASK);
+            }
+
+            std::vector<Entry> &slot = slots_[0][current_tick_ & SLOT_MASK];
+            if (slot.empty())
+            {
+                continue;
+            }
+
+            fired_.swap(slot);
+            size_ -= fired_.size();
+            for (const Entry &entry : fired_)
+            {
+                fn(entry);
+            }
+            fired_.clear();
+        }
+
+        if (current_tick_ < target_tick)
+        {
+            current_tick_ = target_tick;
+        }
+    }
+
+    void clear()
+    {
+        for (auto &level : slots_)
+        {
+            for (auto &slot : level)
+            {
+                slot.clear();
+            }
+        }
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    static const unsigned SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1ULL << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const unsigned LEVELS = 3;
+
+    // Slots at or before the current tick have already fired, so new
+    // entries go no earlier than min_tick = current + 1. Cascaded entries
+    // may land on the current tick, whose slot is fired right afterwards.
+    void place(const Entry &entry, uint64_t min_tick)
+    {
+        uint64_t deadline_tick = (entry.deadline_ms + tick_ms_ - 1) / tick_ms_;
+        if (deadline_tick < min_tick)
+        {
+            deadline_tick = min_tick;
+        }
+
+        uint64_t delta = deadline_tick - current_tick_;
+        if (delta < SLOTS)
+        {
+            slots_[0][deadline_tick & SLOT_MASK].push_back(entry);
+        }
+        else if (delta < SLOTS * SLOTS)
+        {
+            slots_[1][(deadline_tick >> SLOT_BITS) & SLOT_MASK].push_back(entry);
+        }
+        else
+        {
+            uint64_t max_tick = current_tick_ + SLOTS * SLOTS * SLOTS - 1;
+            deadline_tick = deadline_tick < max_tick ? deadline_tick : max_tick;
+            slots_[2][(deadline_tick >> (2 * SLOT_BITS)) & SLOT_MASK].push_back(entry);
+        }
+    }
+
+    // Redistribute one outer slot into the finer levels
+    void cascade(unsigned level, uint64_t index)
+    {
+        std::vector<Entry> entries;
+        entries.swap(slots_[level][index]);
+        for (const Entry &entry : entries)
+        {
+            place(entry, current_tick_);
+        }
+    }
+
+    uint64_t tick_ms_;
+    uint64_t current_tick_;
+    bool started_;
+    size_t size_;
+    std::vector<Entry> slots_[LEVELS][SLOTS];
+    std::vector<Entry> fired_;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,211 @@
+#include "top_talkers.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+const uint16_t SpaceSaving::NO_ENTRY;
+const size_t TopTalkers::CAPACITY;
+
+static size_t roundUpPow2(size_t value)
+{
+    size_t size = 1;
+    while (size < value)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+SpaceSaving::SpaceSaving(size_t capacity)
+    : capacity_(capacity), heap_position_(capacity), index_(roundUpPow2(capacity * 2), NO_ENTRY),
+      index_mask_(index_.size() - 1), total_(0)
+{
+    entries_.reserve(capacity_);
+    heap_.reserve(capacity_);
+}
+
+void SpaceSaving::add(const SessionKey &key, uint32_t weight, uint32_t other)
+{
+    total_ += weight;
+
+    size_t slot = findSlot(key);
+    uint16_t entry = index_[slot];
+    if (entry == NO_ENTRY)
+    {
+        if (entries_.size() < capacity_)
+        {
+            // Still filling: the key is counted exactly and sifts up into place
+            entry = static_cast<uint16_t>(entries_.size());
+            entries_.push_back({key, weight, 0, other});
+            index_[slot] = entry;
+
+            size_t position = heap_.size();
+            heap_.push_back(entry);
+            while (position > 0)
+            {
+                size_t parent = (position - 1) / 2;
+                if (entries_[heap_[parent]].count <= weight)
+                {
+                    break;
+                }
+                heap_[position] = heap_[parent];
+                heap_position_[heap_[position]] = static_cast<uint16_t>(position);
+                position = parent;
+            }
+            heap_[position] = entry;
+            heap_position_[entry] = static_cast<uint16_t>(position);
+            return;
+        }
+
+        // Take over the smallest counter; its count becomes the error bound
+        entry = heap_[0];
+        TalkerEntry &victim = entries_[entry];
+        eraseIndex(findSlot(victim.key));
+        victim.key = key;
+        victim.error = victim.count;
+        victim.other = 0;
+        insertIndex(entry);
+    }
+
+    TalkerEntry &counter = entries_[entry];
+    counter.count += weight;
+    counter.other += other;
+    siftDown(heap_position_[entry]);
+}
+
+void SpaceSaving::clear()
+{
+    entries_.clear();
+    heap_.clear();
+    std::fill(index_.begin(), index_.end(), NO_ENTRY);
+    total_ = 0;
+}
+
+uint64_t SpaceSaving::minCount() const
+{
+    return entries_.size() < capacity_ ? 0 : entries_[heap_[0]].count;
+}
+
+size_t SpaceSaving::findSlot(const SessionKey &key) const
+{
+    size_t slot = SessionKeyHash()(key) & index_mask_;
+    while (index_[slot] != NO_ENTRY && !(entries_[index_[slot]].key == key))
+    {
+        slot = (slot + 1) & index_mask_;
+    }
+    return slot;
+}
+
+void SpaceSaving::insertIndex(uint16_t entry)
+{
+    index_[findSlot(entries_[entry].key)] = entry;
+}
+
+// Backward-shift deletion, so the index never collects tombstones
+void SpaceSaving::eraseIndex(size_t slot)
+{
+    size_t hole = slot;
+    size_t next = (hole + 1) & index_mask_;
+    while (index_[next] != NO_ENTRY)
+    {
+        size_t home = SessionKeyHash()(entries_[index_[next]].key) & index_mask_;
+        // The entry may fill the hole unless its home lies between the two
+        if (((next - home) & index_mask_) >= ((next - hole) & index_mask_))
+        {
+            index_[hole] = index_[next];
+            hole = next;
+        }
+        next = (next + 1) & index_mask_;
+    }
+    index_[hole] = NO_ENTRY;
+}
+
+void SpaceSaving::siftDown(size_t position)
+{
+    uint16_t entry = heap_[position];
+    uint64_t count = entries_[entry].count;
+    size_t size = heap_.size();
+
+    while (true)
+    {
+        size_t child = position * 2 + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && entries_[heap_[child + 1]].count < entries_[heap_[child]].count)
+        {
+            child++;
+        }
+        if (count <= entries_[heap_[child]].count)
+        {
+            break;
+        }
+        heap_[position] = heap_[child];
+        heap_position_[heap_[position]] = static_cast<uint16_t>(position);
+        position = child;
+    }
+    heap_[position] = entry;
+    heap_position_[entry] = static_cast<uint16_t>(position);
+}
+
+TalkerSummaries::TalkerSummaries(size_t capacity)
+    : sources(capacity), destinations(capacity), conversations(capacity)
+{
+}
+
+TopTalkers::TopTalkers() : by_bytes(CAPACITY), by_packets(CAPACITY)
+{
+}
+
+void TopTalkers::add(const PacketView &view)
+{
+    if (view.ip_version != 4 && view.ip_version != 6)
+    {
+        return;
+    }
+    SessionKey source = hostKey(view.source_addr, view.ip_version);
+    SessionKey destination = hostKey(view.dest_addr, view.ip_version);
+    SessionKey conversation = conversationKey(view);
+
+    by_bytes.sources.add(source, view.size, 1);
+    by_bytes.destinations.add(destination, view.size, 1);
+    by_bytes.conversations.add(conversation, view.size, 1);
+    by_packets.sources.add(source, 1, view.size);
+    by_packets.destinations.add(destination, 1, view.size);
+    by_packets.conversations.add(conversation, 1, view.size);
+}
+
+void TopTalkers::clear()
+{
+    for (TalkerSummaries *summaries : {&by_bytes, &by_packets})
+    {
+        summaries->sources.clear();
+        summaries->destinations.clear();
+        summaries->conversations.clear();
+    }
+}
+
+SessionKey TopTalkers::hostKey(const uint8_t *addr, uint8_t ip_version)
+{
+    SessionKey key;
+    key.length = ip_version == 6 ? 16 : 4;
+    std::memcpy(key.bytes, addr, key.length);
+    return key;
+}
+
+SessionKey TopTalkers::conversationKey(const PacketView &view)
+{
+    SessionKey key;
+    size_t addr_length = view.ip_version == 6 ? 16 : 4;
+    const uint8_t *first = view.source_addr;
+    const uint8_t *second = view.dest_addr;
+    if (std::memcmp(first, second, addr_length) > 0)
+    {
+        std::swap(first, second);
+    }
+    std::memcpy(key.bytes, first, addr_length);
+    std::memcpy(key.bytes + addr_length, second, addr_length);
+    key.length = static_cast<uint8_t>(addr_length * 2);
+    return key;
+}
@@ -0,0 +1,95 @@
+#ifndef TOP_TALKERS_H
+#define TOP_TALKERS_H
+
+#include "packet_parser.h"
+#include "session_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One monitored key. count, in whatever the summary ranks by, may
+// overestimate the true total by at most error; other is the second
+// measure, counted exactly but only while the key was monitored.
+struct TalkerEntry
+{
+    SessionKey key;
+    uint64_t count;
+    uint64_t error;
+    uint64_t other;
+};
+
+// Space-Saving summary (Metwally et al.) of the heaviest keys by weight, in
+// fixed memory: `capacity` counters, a min-heap over them and an
+// open-addressing index, all allocated up front. A key that is not
+// monitored takes over the smallest counter and inherits its count as
+// error, so every key whose true total exceeds total() / capacity is
+// guaranteed to be monitored and no estimate is off by more than
+// minCount(). An update is a hash probe plus a heap sift that, for keys
+// already heavy, rarely moves.
+class SpaceSaving
+{
+public:
+    explicit SpaceSaving(size_t capacity);
+
+    // weight is ranked; other only rides along with the key's counter
+    void add(const SessionKey &key, uint32_t weight, uint32_t other);
+    void clear();
+
+    // Unordered
+    const std::vector<TalkerEntry> &entries() const { return entries_; }
+    // Bound on the error of any estimate, and the count of an unmonitored key
+    uint64_t minCount() const;
+    uint64_t total() const { return total_; }
+
+private:
+    static const uint16_t NO_ENTRY = 0xFFFF;
+
+    size_t findSlot(const SessionKey &key) const;
+    void insertIndex(uint16_t entry);
+    void eraseIndex(size_t slot);
+    void siftDown(size_t position);
+
+    size_t capacity_;
+    std::vector<TalkerEntry> entries_;
+    std::vector<uint16_t> heap_;          // entry indices, smallest count first
+    std::vector<uint16_t> heap_position_; // per entry
+    std::vector<uint16_t> index_;         // hash slots holding entry indices
+    size_t index_mask_;
+    uint64_t total_;
+};
+
+// Heaviest sources, destinations and conversations (address pairs, either
+// direction) under one weight
+struct TalkerSummaries
+{
+    explicit TalkerSummaries(size_t capacity);
+
+    SpaceSaving sources;
+    SpaceSaving destinations;
+    SpaceSaving conversations;
+};
+
+// Top talkers seen by one analysis worker, ranked separately by bytes and
+// by packets: a host sending floods of small packets can lead one list
+// and never appear in the other
+class TopTalkers
+{
+public:
+    // Counters per summary; estimates are within the summary's total / CAPACITY
+    static const size_t CAPACITY = 128;
+
+    TopTalkers();
+
+    void add(const PacketView &view);
+    void clear();
+
+    TalkerSummaries by_bytes;   // other counts packets
+    TalkerSummaries by_packets; // other counts bytes
+
+    // Key layouts: one address (4 or 16 bytes) for hosts, two for
+    // conversations with the lower address first
+    static SessionKey hostKey(const uint8_t *addr, uint8_t ip_version);
+    static SessionKey conversationKey(const PacketView &view);
+};
+
+#endif // TOP_TALKERS_H
@@ -0,0 +1,636 @@
+#include "tun_stack.h"
+#include "packet_builder.h"
+#include "capture_clock.h"
+#include "session_manager.h"
+#include "socket_forwarder.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <netinet/in.h>
+
+#define TAG "TunStack"
+#include "native_log.h"
+
+// MSS we advertise in SYN-ACKs (1500-byte MTU minus IPv4 and TCP headers)
+static const uint16_t LOCAL_MSS = 1460;
+// RFC 9293 default when the app's SYN carries no MSS option
+static const uint16_t DEFAULT_APP_MSS = 536;
+// Window advertised to apps; no window scaling is negotiated
+static const uint16_t LOCAL_WINDOW = 65535;
+
+// The app sits on the same device, so loss on the TUN side is rare and a
+// short initial RTO is enough
+static const uint64_t INITIAL_RTO_MS = 200;
+static const uint64_t MAX_RTO_MS = 60000;
+static const uint8_t MAX_RETRANSMITS = 8;
+
+// Stop reading the upstream socket once this much is waiting for the app
+static const size_t SEND_BUFFER_HIGH_WATER = 256 * 1024;
+static const size_t SEND_BUFFER_RESUME = 64 * 1024;
+
+// Sequence number comparison modulo 2^32
+static bool seqBefore(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+TunStack &TunStack::getInstance()
+{
+    static TunStack instance;
+    return instance;
+}
+
+TunStack::TunStack() : output_fd_(-1), isn_rng_(std::random_device()()), dropped_writes_(0)
+{
+}
+
+void TunStack::setOutputFd(int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    output_fd_ = fd;
+}
+
+void TunStack::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tcp_flows_.clear();
+    timers_.clear();
+    output_fd_ = -1;
+    dropped_writes_ = 0;
+}
+
+void TunStack::handleOutbound(const PacketView &view)
+{
+    if (view.ip_version != 4)
+    {
+        return;
+    }
+
+    SessionKey key = SessionKey::fromPacket(view);
+
+    if (view.protocol == Protocol::TCP)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        handleTcp(key, view);
+    }
+    else if (view.protocol == Protocol::UDP)
+    {
+        SocketForwarder::getInstance().forwardPacket(key, view.payload(), view.payload_length);
+    }
+}
+
+void TunStack::handleTcp(const SessionKey &key, const PacketView &view)
+{
+    uint8_t flags = view.tcp_flags;
+    auto it = tcp_flows_.find(key);
+
+    if (flags & TCP_RST)
+    {
+        if (it != tcp_flows_.end())
+        {
+            finishFlow(key);
+        }
+        return;
+    }
+
+    if (flags & TCP_SYN)
+    {
+        if (it != tcp_flows_.end())
+        {
+            if (it->second.state != TcpState::Established)
+            {
+                // Retransmitted SYN; the retransmission timer covers the SYN-ACK
+                return;
+            }
+            // Tuple reused for a new connection
+            finishFlow(key);
+        }
+        acceptSyn(key, view);
+        return;
+    }
+
+    if (it == tcp_flows_.end())
+    {
+        // Not a connection we know about; tell the app to give up on it
+        uint32_t segment_length = view.payload_length + ((flags & TCP_FIN) ? 1 : 0);
+        if (flags & TCP_ACK)
+        {
+            sendReset(key, view.tcp_ack, 0, TCP_RST);
+        }
+        else
+        {
+            sendReset(key, 0, view.tcp_seq + segment_length, TCP_RST | TCP_ACK);
+        }
+        return;
+    }
+
+    TcpFlow &flow = it->second;
+    uint64_t now_ms = CaptureClock::monotonicMs();
+    flow.snd_wnd = view.tcp_window;
+    // Any segment shows the app is still there, whatever its window
+    flow.unanswered_probes = 0;
+
+    if ((flags & TCP_ACK) && !processAck(key, flow, view.tcp_ack, now_ms))
+    {
+        return;
+    }
+
+    if (flow.state != TcpState::Established)
+    {
+        return;
+    }
+
+    bool need_ack = false;
+
+    if (view.payload_length > 0)
+    {
+        need_ack = true;
+        if (view.tcp_seq == flow.rcv_nxt && !flow.app_fin)
+        {
+            // Acknowledge only what the socket took; the app resends the rest
+            ssize_t sent = SocketForwarder::getInstance().sendToSession(key, view.payload(), view.payload_length);
+            if (sent < 0)
+            {
+                abortFlow(key, flow);
+                return;
+            }
+            flow.rcv_nxt += static_cast<uint32_t>(sent);
+        }
+    }
+
+    if (flags & TCP_FIN)
+    {
+        need_ack = true;
+        if (!flow.app_fin && view.tcp_seq + view.payload_length == flow.rcv_nxt)
+        {
+            flow.app_fin = true;
+            flow.rcv_nxt += 1;
+            SocketForwarder::getInstance().shutdownSession(key);
+            SessionManager::getInstance().markHalfClosed(key);
+        }
+    }
+
+    if (need_ack)
+    {
+        sendSegment(key, flow, flow.snd_nxt, TCP_ACK, nullptr, 0);
+    }
+
+    if (flow.app_fin && flow.fin_sent && flow.snd_una == flow.snd_nxt)
+    {
+        finishFlow(key);
+    }
+}
+
+void TunStack::acceptSyn(const SessionKey &key, const PacketView &view)
+{
+    TcpFlow &flow = tcp_flows_[key];
+    flow.state = TcpState::Connecting;
+    flow.iss = isn_rng_();
+    flow.snd_una = flow.iss;
+    flow.snd_nxt = flow.iss;
+    flow.rcv_nxt = view.tcp_seq + 1;
+    flow.snd_wnd = view.tcp_window;
+    flow.mss = std::min(parseMss(view), LOCAL_MSS);
+    flow.app_fin = false;
+    flow.remote_eof = false;
+    flow.fin_sent = false;
+    flow.reading_paused = false;
+    flow.timer_queued = false;
+    flow.retransmits = 0;
+    flow.unanswered_probes = 0;
+    flow.rto_ms = INITIAL_RTO_MS;
+    flow.rto_deadline = 0;
+    flow.send_buffer.clear();
+    flow.send_head = 0;
+
+    // The SYN-ACK goes out once the upstream connect completes (onSocketConnected)
+    if (!SocketForwarder::getInstance().openSession(key))
+    {
+        uint32_t rcv_nxt = flow.rcv_nxt;
+        tcp_flows_.erase(key);
+        SessionManager::getInstance().closeSession(key);
+        sendReset(key, 0, rcv_nxt, TCP_RST | TCP_ACK);
+    }
+}
+
+bool TunStack::processAck(const SessionKey &key, TcpFlow &flow, uint32_t ack, uint64_t now_ms)
+{
+    if (flow.state == TcpState::SynReceived)
+    {
+        if (ack != flow.iss + 1)
+        {
+            return true;
+        }
+        flow.state = TcpState::Established;
+        flow.snd_una = ack;
+        flow.retransmits = 0;
+        flow.rto_ms = INITIAL_RTO_MS;
+        flow.rto_deadline = 0;
+        // Upstream may already have sent data while the handshake finished
+        trySend(key, flow, now_ms);
+        return true;
+    }
+
+    if (flow.state != TcpState::Established)
+    {
+        return true;
+    }
+
+    // Only an ACK inside (snd_una, snd_nxt] moves the window; duplicates and
+    // ACKs for data never sent are ignored
+    if (seqBefore(flow.snd_una, ack) && !seqBefore(flow.snd_nxt, ack))
+    {
+        size_t data_acked = ack - flow.snd_una;
+        if (flow.fin_sent && ack == flow.snd_nxt)
+        {
+            data_acked -= 1; // the FIN takes the last sequence number
+        }
+
+        flow.send_head += data_acked;
+        if (flow.send_head == flow.send_buffer.size())
+        {
+            flow.send_buffer.clear();
+            flow.send_head = 0;
+        }
+        else if (flow.send_head > SEND_BUFFER_RESUME && flow.send_head * 2 > flow.send_buffer.size())
+        {
+            flow.send_buffer.erase(flow.send_buffer.begin(), flow.send_buffer.begin() + flow.send_head);
+            flow.send_head = 0;
+        }
+
+        flow.snd_una = ack;
+        flow.retransmits = 0;
+        flow.rto_ms = INITIAL_RTO_MS;
+        // Restart the timer for whatever is still outstanding; the queued heap
+        // entry picks up the new deadline when it fires
+        flow.rto_deadline = flow.snd_una == flow.snd_nxt ? 0 : now_ms + flow.rto_ms;
+    }
+
+    trySend(key, flow, now_ms);
+
+    if (flow.reading_paused && buffered(flow) < SEND_BUFFER_RESUME)
+    {
+        flow.reading_paused = false;
+        SocketForwarder::getInstance().resumeReading(key);
+    }
+
+    if (flow.app_fin && flow.fin_sent && flow.snd_una == flow.snd_nxt)
+    {
+        finishFlow(key);
+        return false;
+    }
+    return true;
+}
+
+// Sends as much buffered data as the app's window allows, then our FIN
+// once upstream is done and everything has been sent
+void TunStack::trySend(const SessionKey &key, TcpFlow &flow, uint64_t now_ms)
+{
+    if (flow.state != TcpState::Established || flow.fin_sent)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        uint32_t in_flight = flow.snd_nxt - flow.snd_una;
+        size_t unsent = buffered(flow) - in_flight;
+
+        if (unsent == 0)
+        {
+            if (flow.remote_eof)
+            {
+                sendSegment(key, flow, flow.snd_nxt, TCP_FIN | TCP_ACK, nullptr, 0);
+                flow.snd_nxt += 1;
+                flow.fin_sent = true;
+                if (flow.rto_deadline == 0)
+                {
+                    armTimer(key, flow, now_ms);
+                }
+            }
+            return;
+        }
+
+        if (in_flight >= flow.snd_wnd)
+        {
+            // Window closed; the timer doubles as the zero-window probe
+            if (flow.rto_deadline == 0)
+            {
+                armTimer(key, flow, now_ms);
+            }
+            return;
+        }
+
+        size_t segment = std::min(unsent, static_cast<size_t>(flow.mss));
+        segment = std::min(segment, static_cast<size_t>(flow.snd_wnd - in_flight));
+
+        sendSegment(key, flow, flow.snd_nxt, TCP_ACK | TCP_PSH,
+                    flow.send_buffer.data() + flow.send_head + in_flight, segment);
+        flow.snd_nxt += static_cast<uint32_t>(segment);
+
+        if (flow.rto_deadline == 0)
+        {
+            armTimer(key, flow, now_ms);
+        }
+    }
+}
+
+void TunStack::retransmit(const SessionKey &key, TcpFlow &flow, uint64_t now_ms)
+{
+    // While the app's window is closed the timer is probing it, not
+    // recovering loss. A slow reader answers every probe and may keep its
+    // window shut indefinitely; only probes that get no reply count.
+    bool probing = flow.state == TcpState::Established && flow.snd_wnd == 0;
+    if (probing ? ++flow.unanswered_probes > MAX_RETRANSMITS : ++flow.retransmits > MAX_RETRANSMITS)
+    {
+        LOGD("Giving up on %s after %d %s", key.toString().c_str(), MAX_RETRANSMITS,
+             probing ? "unanswered window probes" : "retransmissions");
+        abortFlow(key, flow);
+        return;
+    }
+
+    uint32_t in_flight = flow.snd_nxt - flow.snd_una;
+
+    if (flow.state == TcpState::SynReceived)
+    {
+        sendSegment(key, flow, flow.iss, TCP_SYN | TCP_ACK, nullptr, 0, LOCAL_MSS);
+    }
+    else if (in_flight == 0)
+    {
+        if (buffered(flow) == 0)
+        {
+            flow.rto_deadline = 0;
+            return;
+        }
+        // Zero-window probe: push one byte past the closed window
+        sendSegment(key, flow, flow.snd_nxt, TCP_ACK, flow.send_buffer.data() + flow.send_head, 1);
+        flow.snd_nxt += 1;
+    }
+    else
+    {
+        size_t data_in_flight = in_flight - (flow.fin_sent ? 1 : 0);
+        if (data_in_flight > 0)
+        {
+            size_t segment = std::min(data_in_flight, static_cast<size_t>(flow.mss));
+            sendSegment(key, flow, flow.snd_una, TCP_ACK | TCP_PSH,
+                        flow.send_buffer.data() + flow.send_head, segment);
+        }
+        else
+        {
+            sendSegment(key, flow, flow.snd_nxt - 1, TCP_FIN | TCP_ACK, nullptr, 0);
+        }
+    }
+
+    flow.rto_ms = std::min(flow.rto_ms * 2, MAX_RTO_MS);
+    armTimer(key, flow, now_ms);
+}
+
+void TunStack::armTimer(const SessionKey &key, TcpFlow &flow, uint64_t now_ms)
+{
+    flow.rto_deadline = now_ms + flow.rto_ms;
+    if (!flow.timer_queued)
+    {
+        flow.timer_queued = true;
+        timers_.push_back(TimerEntry{flow.rto_deadline, key});
+        std::push_heap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+    }
+}
+
+// Resets both sides of the connection
+void TunStack::abortFlow(const SessionKey &key, TcpFlow &flow)
+{
+    sendSegment(key, flow, flow.snd_nxt, TCP_RST | TCP_ACK, nullptr, 0);
+    finishFlow(key);
+}
+
+void TunStack::finishFlow(const SessionKey &key)
+{
+    // Stale timer entries are skipped when they come due
+    tcp_flows_.erase(key);
+    SessionManager::getInstance().closeSession(key);
+}
+
+void TunStack::onSocketConnected(const SessionKey &key, bool success)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = tcp_flows_.find(key);
+    if (it == tcp_flows_.end() || it->second.state != TcpState::Connecting)
+    {
+        return;
+    }
+
+    TcpFlow &flow = it->second;
+    if (!success)
+    {
+        sendReset(key, 0, flow.rcv_nxt, TCP_RST | TCP_ACK);
+        finishFlow(key);
+        return;
+    }
+
+    sendSegment(key, flow, flow.iss, TCP_SYN | TCP_ACK, nullptr, 0, LOCAL_MSS);
+    flow.snd_nxt = flow.iss + 1;
+    flow.state = TcpState::SynReceived;
+    armTimer(key, flow, CaptureClock::monotonicMs());
+}
+
+bool TunStack::onSocketData(const SessionKey &key, const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (key.protocol() == IPPROTO_UDP)
+    {
+        // Reply comes from the original destination back to the app
+        size_t packet_length = PacketBuilder::buildUdp(packet_buffer_, sizeof(packet_buffer_),
+                                                       key.destAddr(), key.destPort(),
+                                                       key.sourceAddr(), key.sourcePort(),
+                                                       data, length);
+        if (packet_length > 0)
+        {
+            writePacket(packet_length);
+        }
+        return true;
+    }
+
+    auto it = tcp_flows_.find(key);
+    if (it == tcp_flows_.end())
+    {
+        return true;
+    }
+
+    TcpFlow &flow = it->second;
+    flow.send_buffer.insert(flow.send_buffer.end(), data, data + length);
+    trySend(key, flow, CaptureClock::monotonicMs());
+
+    if (buffered(flow) >= SEND_BUFFER_HIGH_WATER)
+    {
+        flow.reading_paused = true;
+        return false;
+    }
+    return true;
+}
+
+void TunStack::onSocketEof(const SessionKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = tcp_flows_.find(key);
+    if (it == tcp_flows_.end())
+    {
+        return;
+    }
+
+    TcpFlow &flow = it->second;
+    flow.remote_eof = true;
+    SessionManager::getInstance().markHalfClosed(key);
+    trySend(key, flow, CaptureClock::monotonicMs());
+}
+
+void TunStack::onSocketError(const SessionKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = tcp_flows_.find(key);
+    if (it != tcp_flows_.end())
+    {
+        abortFlow(key, it->second);
+    }
+    else
+    {
+        SessionManager::getInstance().closeSession(key);
+    }
+}
+
+void TunStack::onSessionsClosed(const std::vector<SessionKey> &keys)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Sessions that expired or were reset underneath a live connection. A
+    // flow that already has a new socket reuses the tuple and is left alone.
+    for (const SessionKey &key : keys)
+    {
+        auto it = tcp_flows_.find(key);
+        if (it != tcp_flows_.end() && SessionManager::getInstance().getSocketFd(key) == -1)
+        {
+            sendSegment(key, it->second, it->second.snd_nxt, TCP_RST | TCP_ACK, nullptr, 0);
+            tcp_flows_.erase(it);
+        }
+    }
+}
+
+int TunStack::onTimer(uint64_t now_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    while (!timers_.empty() && timers_.front().deadline <= now_ms)
+    {
+        std::pop_heap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+        TimerEntry entry = timers_.back();
+        timers_.pop_back();
+
+        auto it = tcp_flows_.find(entry.key);
+        if (it == tcp_flows_.end())
+        {
+            continue;
+        }
+
+        TcpFlow &flow = it->second;
+        flow.timer_queued = false;
+        if (flow.rto_deadline == 0)
+        {
+            continue;
+        }
+        if (flow.rto_deadline > now_ms)
+        {
+            // Restarted by an ACK since it was queued
+            flow.timer_queued = true;
+            timers_.push_back(TimerEntry{flow.rto_deadline, entry.key});
+            std::push_heap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+            continue;
+        }
+
+        retransmit(entry.key, flow, now_ms);
+    }
+
+    if (timers_.empty())
+    {
+        return -1;
+    }
+    return static_cast<int>(timers_.front().deadline - now_ms);
+}
+
+void TunStack::sendSegment(const SessionKey &key, const TcpFlow &flow, uint32_t seq, uint8_t flags,
+                           const uint8_t *payload, size_t length, uint16_t mss_option)
+{
+    size_t packet_length = PacketBuilder::buildTcp(packet_buffer_, sizeof(packet_buffer_),
+                                                   key.destAddr(), key.destPort(),
+                                                   key.sourceAddr(), key.sourcePort(),
+                                                   seq, flow.rcv_nxt, flags, LOCAL_WINDOW,
+                                                   mss_option, payload, length);
+    if (packet_length > 0)
+    {
+        writePacket(packet_length);
+    }
+}
+
+void TunStack::sendReset(const SessionKey &key, uint32_t seq, uint32_t ack, uint8_t flags)
+{
+    size_t packet_length = PacketBuilder::buildTcp(packet_buffer_, sizeof(packet_buffer_),
+                                                   key.destAddr(), key.destPort(),
+                                                   key.sourceAddr(), key.sourcePort(),
+                                                   seq, ack, flags, 0, 0, nullptr, 0);
+    if (packet_length > 0)
+    {
+        writePacket(packet_length);
+    }
+}
+
+void TunStack::writePacket(size_t length)
+{
+    if (output_fd_ == -1)
+    {
+        return;
+    }
+
+    // The TUN fd is non-blocking; a dropped segment is recovered by retransmission
+    ssize_t written = write(output_fd_, packet_buffer_, length);
+    if (written < 0 && ++dropped_writes_ % 1000 == 1)
+    {
+        LOGE("Failed to write to TUN: %d (%llu dropped)", errno,
+             static_cast<unsigned long long>(dropped_writes_));
+    }
+}
+
+uint16_t TunStack::parseMss(const PacketView &view)
+{
+    const uint8_t *tcp = view.data + view.l4_offset;
+    size_t header_length = view.payload_offset - view.l4_offset;
+    size_t offset = sizeof(TCPHeader);
+
+    while (offset < header_length)
+    {
+        uint8_t kind = tcp[offset];
+        if (kind == 0)
+        {
+            break;
+        }
+        if (kind == 1)
+        {
+            offset++;
+            continue;
+        }
+        if (offset + 1 >= header_length || tcp[offset + 1] < 2)
+        {
+            break;
+        }
+        if (kind == 2 && tcp[offset + 1] == 4 && offset + 4 <= header_length)
+        {
+            uint16_t mss = static_cast<uint16_t>((tcp[offset + 2] << 8) | tcp[offset + 3]);
+            return mss > 0 ? mss : DEFAULT_APP_MSS;
+        }
+        offset += tcp[offset + 1];
+    }
+
+    return DEFAULT_APP_MSS;
+}
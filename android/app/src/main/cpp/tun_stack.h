@@ -0,0 +1,117 @@
+#ifndef TUN_STACK_H
+#define TUN_STACK_H
+
+#include "packet_parser.h"
+#include "session_key.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Userspace TCP/UDP termination for VPN mode. TCP connections the apps
+// open through the TUN interface are accepted here and relayed as byte
+// streams over ordinary sockets (SocketForwarder); UDP payloads are relayed
+// datagram by datagram. Replies are written back to the output fd as
+// crafted IPv4 packets.
+//
+// Per flow the stack keeps the TUN-side TCP state: sequence numbers, the
+// app's advertised window, a buffer of bytes not yet acknowledged by the
+// app and a retransmission timer. App data is acknowledged only once the
+// upstream socket has accepted it, so the app's own retransmissions
+// provide backpressure in that direction.
+//
+// Only IPv4 is terminated, matching the address the VPN interface is
+// configured with. The output fd may be anything that takes one IP packet
+// per write(): the TUN fd, or one end of a SOCK_SEQPACKET socketpair when
+// exercising the stack off-device.
+class TunStack
+{
+public:
+    static TunStack &getInstance();
+
+    void setOutputFd(int fd);
+    void reset();
+
+    // Capture thread: a packet an app wrote to the TUN interface
+    void handleOutbound(const PacketView &view);
+
+    // Reactor thread: socket-side events from SocketForwarder
+    void onSocketConnected(const SessionKey &key, bool success);
+    // Returns false when the flow has buffered enough and reading should pause
+    bool onSocketData(const SessionKey &key, const uint8_t *data, size_t length);
+    void onSocketEof(const SessionKey &key);
+    void onSocketError(const SessionKey &key);
+    void onSessionsClosed(const std::vector<SessionKey> &keys);
+    // Fires due retransmissions; returns ms until the next one, or -1
+    int onTimer(uint64_t now_ms);
+
+private:
+    enum class TcpState : uint8_t
+    {
+        Connecting,  // SYN seen, upstream connect in progress
+        SynReceived, // SYN-ACK sent to the app
+        Established
+    };
+
+    struct TcpFlow
+    {
+        TcpState state;
+        uint32_t iss;     // our initial sequence number
+        uint32_t snd_una; // oldest sequence number the app has not acknowledged
+        uint32_t snd_nxt; // next sequence number we send
+        uint32_t rcv_nxt; // next sequence number expected from the app
+        uint32_t snd_wnd; // window advertised by the app
+        uint16_t mss;     // largest segment we send to the app
+        bool app_fin;     // app has closed its sending side
+        bool remote_eof;  // upstream socket has reached EOF
+        bool fin_sent;
+        bool reading_paused;
+        bool timer_queued;
+        uint8_t retransmits;
+        uint8_t unanswered_probes; // zero-window probes sent since the app's last segment
+        uint64_t rto_ms;
+        uint64_t rto_deadline; // 0 when no timer is running
+        // Bytes from snd_una onwards (sent-unacked, then unsent), starting at send_head
+        std::vector<uint8_t> send_buffer;
+        size_t send_head;
+    };
+
+    struct TimerEntry
+    {
+        uint64_t deadline;
+        SessionKey key;
+
+        bool operator>(const TimerEntry &other) const { return deadline > other.deadline; }
+    };
+
+    TunStack();
+
+    void handleTcp(const SessionKey &key, const PacketView &view);
+    void acceptSyn(const SessionKey &key, const PacketView &view);
+    bool processAck(const SessionKey &key, TcpFlow &flow, uint32_t ack, uint64_t now_ms);
+    void trySend(const SessionKey &key, TcpFlow &flow, uint64_t now_ms);
+    void retransmit(const SessionKey &key, TcpFlow &flow, uint64_t now_ms);
+    void armTimer(const SessionKey &key, TcpFlow &flow, uint64_t now_ms);
+    void abortFlow(const SessionKey &key, TcpFlow &flow);
+    void finishFlow(const SessionKey &key);
+
+    void sendSegment(const SessionKey &key, const TcpFlow &flow, uint32_t seq, uint8_t flags,
+                     const uint8_t *payload, size_t length, uint16_t mss_option = 0);
+    void sendReset(const SessionKey &key, uint32_t seq, uint32_t ack, uint8_t flags);
+    void writePacket(size_t length);
+
+    static size_t buffered(const TcpFlow &flow) { return flow.send_buffer.size() - flow.send_head; }
+    static uint16_t parseMss(const PacketView &view);
+
+    std::mutex mutex_;
+    int output_fd_;
+    std::unordered_map<SessionKey, TcpFlow, SessionKeyHash> tcp_flows_;
+    std::vector<TimerEntry> timers_; // min-heap on deadline
+    std::mt19937 isn_rng_;
+    uint64_t dropped_writes_;
+    uint8_t packet_buffer_[65536];
+};
+
+#endif // TUN_STACK_H
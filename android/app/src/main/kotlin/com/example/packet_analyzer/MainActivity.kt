@@ -5,7 +5,12 @@ import android.net.VpnService
 import android.util.Log
 import io.flutter.embedding.android.FlutterActivity
 import io.flutter.embedding.engine.FlutterEngine
+import io.flutter.plugin.common.MethodCall
 import io.flutter.plugin.common.MethodChannel
+import java.io.File
+import java.text.SimpleDateFormat
+import java.util.Date
+import java.util.Locale
 
 class MainActivity : FlutterActivity() {
 
@@ -44,6 +49,77 @@ class MainActivity : FlutterActivity() {
                 "stopRootedCapture" -> {
                     stopRootedCapture(result)
                 }
+                "setCaptureTunables" -> {
+                    nativeInterface.setCaptureTunables(
+                        call.argument<Int>("bufferSizeBytes") ?: 8 * 1024 * 1024,
+                        call.argument<Int>("blockTimeoutMs") ?: 100,
+                        call.argument<Int>("snaplen") ?: 65535,
+                        call.argument<Boolean>("immediateMode") ?: false
+                    )
+                    result.success(true)
+                }
+                "setFlowLimits" -> {
+                    nativeInterface.setFlowLimits(
+                        call.argument<Int>("maxFlows") ?: 64 * 1024,
+                        call.argument<Int>("maxSessions") ?: 4096,
+                        call.argument<Number>("memoryBytes")?.toLong() ?: 32L * 1024 * 1024
+                    )
+                    result.success(true)
+                }
+                "setSessionTimeouts" -> {
+                    nativeInterface.setSessionTimeouts(
+                        call.argument<Number>("udpMs")?.toLong() ?: 0L,
+                        call.argument<Number>("tcpMs")?.toLong() ?: 0L,
+                        call.argument<Number>("tcpHalfClosedMs")?.toLong() ?: 0L,
+                        call.argument<Number>("otherMs")?.toLong() ?: 0L
+                    )
+                    result.success(true)
+                }
+                "setCaptureFilter" -> {
+                    val error = nativeInterface.setCaptureFilter(call.argument<String>("expression") ?: "")
+                    if (error == null) {
+                        result.success(true)
+                    } else {
+                        result.error("INVALID_FILTER", error, null)
+                    }
+                }
+                "getPackets" -> {
+                    try {
+                        result.success(nativeInterface.getPackets(
+                            call.argument<Int>("offset") ?: 0,
+                            call.argument<Int>("count") ?: 0,
+                            call.argument<String>("protocol") ?: "",
+                            call.argument<String>("host") ?: "",
+                            call.argument<Int>("port") ?: 0
+                        ))
+                    } catch (e: IllegalArgumentException) {
+                        result.error("INVALID_FILTER", e.message, null)
+                    }
+                }
+                "startRecording" -> {
+                    startRecording(call, result)
+                }
+                "stopRecording" -> {
+                    nativeInterface.stopRecording()
+                    result.success(true)
+                }
+                "getPipelineStats" -> {
+                    result.success(nativeInterface.getPipelineStats())
+                }
+                "getTopTalkers" -> {
+                    result.success(nativeInterface.getTopTalkers(call.argument<Int>("count") ?: 10))
+                }
+                "getFlowMetrics" -> {
+                    try {
+                        result.success(nativeInterface.getFlowMetrics(
+                            call.argument<Int>("count") ?: 10,
+                            call.argument<String>("host") ?: "",
+                            call.argument<Int>("port") ?: 0
+                        ))
+                    } catch (e: IllegalArgumentException) {
+                        result.error("INVALID_FILTER", e.message, null)
+                    }
+                }
                 "isDeviceRooted" -> {
                     val isRooted = nativeInterface.isDeviceRooted()
                     Log.d(TAG, "Device rooted: $isRooted")
@@ -93,6 +169,26 @@ class MainActivity : FlutterActivity() {
         result.success(success)
     }
 
+    private fun startRecording(call: MethodCall, result: MethodChannel.Result) {
+        val directory = File(getExternalFilesDir(null) ?: filesDir, "captures")
+        directory.mkdirs()
+        val stamp = SimpleDateFormat("yyyyMMdd_HHmmss", Locale.US).format(Date())
+        val pathPrefix = File(directory, "capture_$stamp").absolutePath
+
+        Log.d(TAG, "Starting recording to $pathPrefix")
+        val error = nativeInterface.startRecording(
+            pathPrefix,
+            call.argument<Number>("maxFileBytes")?.toLong() ?: 0L,
+            call.argument<Int>("maxFileSeconds") ?: 0,
+            call.argument<Int>("ringFiles") ?: 0
+        )
+        if (error == null) {
+            result.success(pathPrefix)
+        } else {
+            result.error("RECORDING_FAILED", error, null)
+        }
+    }
+
     private fun stopRootedCapture(result: MethodChannel.Result) {
         Log.d(TAG, "Stopping rooted capture")
         val success = nativeInterface.stopRootedCapture()
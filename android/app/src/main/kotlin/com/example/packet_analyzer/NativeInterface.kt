@@ -1,17 +1,25 @@
 package com.example.packet_analyzer
 
 import io.flutter.plugin.common.MethodChannel
+import android.net.VpnService
+import android.os.Handler
+import android.os.Looper
 import android.util.Log
 import java.io.File
+import java.nio.ByteBuffer
 
 class NativeInterface {
     
     companion object {
         private const val TAG = "NativeInterface"
+
+        var isLoaded = false
+            private set
         
         init {
             try {
                 System.loadLibrary("packet_analyzer")
+                isLoaded = true
                 Log.d(TAG, "Native library loaded successfully")
             } catch (e: UnsatisfiedLinkError) {
                 Log.w(TAG, "Native library not found: ${e.message}")
@@ -26,36 +34,38 @@ class NativeInterface {
             Log.d(TAG, "Method channel set")
         }
         
+        // Size of one PacketRecord in native-lib's packed batch (see packet_batcher.h)
+        const val PACKET_RECORD_SIZE = 128
+
+        private val mainHandler = Handler(Looper.getMainLooper())
+
+        // Called from the native capture thread with `count` packed records at the start of `batch`.
+        // The buffer is reused by native code as soon as this returns, so it is copied once here.
         @JvmStatic
-        fun sendPacketToFlutter(
-            sourceIp: String,
-            destIp: String,
-            sourcePort: Int,
-            destPort: Int,
-            protocol: String,
-            size: Int,
-            timestamp: String,
-            payload: String
-        ) {
-            val packetData = mapOf(
-                "sourceIp" to sourceIp,
-                "destinationIp" to destIp,
-                "sourcePort" to sourcePort,
-                "destinationPort" to destPort,
-                "protocol" to protocol,
-                "size" to size,
-                "timestamp" to timestamp,
-                "payload" to payload
-            )
-            
-            try {
-                _methodChannel?.invokeMethod("onPacketReceived", packetData)
-                Log.d(TAG, "Packet sent to Flutter: $sourceIp:$sourcePort -> $destIp:$destPort")
-            } catch (e: Exception) {
-                Log.e(TAG, "Error sending packet to Flutter", e)
+        fun sendPacketBatchToFlutter(batch: ByteBuffer, count: Int) {
+            val records = ByteArray(count * PACKET_RECORD_SIZE)
+            val view = batch.duplicate()
+            view.clear()
+            view.get(records)
+
+            mainHandler.post {
+                try {
+                    _methodChannel?.invokeMethod("onPacketBatch", records)
+                } catch (e: Exception) {
+                    Log.e(TAG, "Error sending packet batch to Flutter", e)
+                }
             }
         }
         
+        // Service whose protect() keeps native forwarding sockets out of the tunnel
+        var vpnService: VpnService? = null
+
+        // Called from native code for every socket it opens on behalf of a VPN flow
+        @JvmStatic
+        fun protectSocket(fd: Int): Boolean {
+            return vpnService?.protect(fd) ?: false
+        }
+        
         @JvmStatic
         fun sendStatsToFlutter(statsJson: String) {
             try {
@@ -122,6 +132,106 @@ class NativeInterface {
         }
     }
     
+    // Rooted capture ring settings, applied the next time capture starts
+    fun setCaptureTunables(bufferSizeBytes: Int, blockTimeoutMs: Int, snaplen: Int, immediateMode: Boolean) {
+        try {
+            nativeSetCaptureTunables(bufferSizeBytes, blockTimeoutMs, snaplen, immediateMode)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native setCaptureTunables not available")
+        }
+    }
+    
+    // Bounds on the analysis flow tables (from the next capture start) and the VPN session table;
+    // maxFlows or maxSessions <= 0 keeps that table's default count, and memoryBytes <= 0 bounds them
+    // by count alone
+    fun setFlowLimits(maxFlows: Int, maxSessions: Int, memoryBytes: Long) {
+        try {
+            nativeSetFlowLimits(maxFlows, maxSessions, memoryBytes)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native setFlowLimits not available")
+        }
+    }
+    
+    // Idle timeouts of the VPN session table in ms, applied at once; a value <= 0 keeps its default
+    fun setSessionTimeouts(udpMs: Long, tcpMs: Long, tcpHalfClosedMs: Long, otherMs: Long) {
+        try {
+            nativeSetSessionTimeouts(udpMs, tcpMs, tcpHalfClosedMs, otherMs)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native setSessionTimeouts not available")
+        }
+    }
+    
+    // BPF filter expression for both capture modes; returns the compile error, or null
+    fun setCaptureFilter(expression: String): String? {
+        return try {
+            nativeSetCaptureFilter(expression)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native setCaptureFilter not available")
+            "Native capture filtering not available"
+        }
+    }
+    
+    // Page of the native packet history, newest first: a 16-byte header (matching, returned and
+    // stored packet counts) followed by packed records. Null when the native library is missing;
+    // throws IllegalArgumentException for an invalid filter.
+    fun getPackets(offset: Int, count: Int, protocol: String, host: String, port: Int): ByteArray? {
+        return try {
+            nativeGetPackets(offset, count, protocol, host, port)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native getPackets not available")
+            null
+        }
+    }
+    
+    // Per-ring occupancy and drop counters of the native pipeline plus buffer pool usage, as JSON
+    fun getPipelineStats(): String? {
+        return try {
+            nativeGetPipelineStats()
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native getPipelineStats not available")
+            null
+        }
+    }
+    
+    // Top sources, destinations and conversations by bytes and by packets, as JSON
+    fun getTopTalkers(count: Int): String? {
+        return try {
+            nativeGetTopTalkers(count)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native getTopTalkers not available")
+            null
+        }
+    }
+    
+    // Per-flow and per-destination TCP RTT, loss and throughput figures, as JSON;
+    // throws IllegalArgumentException for an invalid host or port
+    fun getFlowMetrics(count: Int, host: String, port: Int): String? {
+        return try {
+            nativeGetFlowMetrics(count, host, port)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native getFlowMetrics not available")
+            null
+        }
+    }
+    
+    // Streams captured packets to <pathPrefix>_00001.pcapng onwards; returns the error, or null
+    fun startRecording(pathPrefix: String, maxFileBytes: Long, maxFileSeconds: Int, ringFiles: Int): String? {
+        return try {
+            nativeStartRecording(pathPrefix, maxFileBytes, maxFileSeconds, ringFiles)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native startRecording not available")
+            "Native recording not available"
+        }
+    }
+    
+    fun stopRecording() {
+        try {
+            nativeStopRecording()
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native stopRecording not available")
+        }
+    }
+    
     fun cleanup() {
         try {
             nativeCleanup()
@@ -208,6 +318,16 @@ class NativeInterface {
     private external fun nativeProcessPacket(packet: ByteArray, length: Int): Boolean
     private external fun nativeStartRootedCapture(): Boolean
     private external fun nativeStopRootedCapture(): Boolean
+    private external fun nativeSetCaptureTunables(bufferSizeBytes: Int, blockTimeoutMs: Int, snaplen: Int, immediateMode: Boolean)
+    private external fun nativeSetFlowLimits(maxFlows: Int, maxSessions: Int, memoryBytes: Long)
+    private external fun nativeSetSessionTimeouts(udpMs: Long, tcpMs: Long, tcpHalfClosedMs: Long, otherMs: Long)
+    private external fun nativeSetCaptureFilter(expression: String): String?
+    private external fun nativeGetPipelineStats(): String?
+    private external fun nativeGetTopTalkers(count: Int): String?
+    private external fun nativeGetFlowMetrics(count: Int, host: String, port: Int): String?
+    private external fun nativeGetPackets(offset: Int, count: Int, protocol: String, host: String, port: Int): ByteArray?
+    private external fun nativeStartRecording(pathPrefix: String, maxFileBytes: Long, maxFileSeconds: Int, ringFiles: Int): String?
+    private external fun nativeStopRecording()
     private external fun nativeCleanup()
     private external fun nativeClearPackets()
     private external fun nativePauseCapture()
@@ -16,8 +16,6 @@ import java.io.FileInputStream
 import java.io.FileOutputStream
 import java.net.*
 import java.util.concurrent.ConcurrentHashMap
-import java.util.concurrent.ExecutorService
-import java.util.concurrent.Executors
 import java.util.concurrent.atomic.AtomicLong
 
 class PacketVpnService : VpnService() {
@@ -35,8 +33,8 @@ class PacketVpnService : VpnService() {
     private var vpnInterface: ParcelFileDescriptor? = null
     private var isRunning = false
     private var captureThread: Thread? = null
+    private var nativeInterface: NativeInterface? = null
     private val mainHandler = Handler(Looper.getMainLooper())
-    private val executorService: ExecutorService = Executors.newCachedThreadPool()
     private val tcpConnections = ConcurrentHashMap<String, Socket>()
     private var udpSocket: DatagramSocket? = null
     
@@ -75,8 +73,10 @@ class PacketVpnService : VpnService() {
             if (vpnInterface != null) {
                 isRunning = true
                 Log.d(TAG, "VPN capture initialized with FD: ${vpnInterface!!.fd}")
-                initializeForwarding()
-                startPacketProcessing()
+                if (!startNativeProcessing()) {
+                    initializeForwarding()
+                    startPacketProcessing()
+                }
             }
         } catch (e: Exception) {
             Log.e(TAG, "Failed to establish VPN", e)
@@ -84,6 +84,23 @@ class PacketVpnService : VpnService() {
         }
     }
 
+    // The native engine terminates TCP/UDP itself and relays it over protected sockets
+    private fun startNativeProcessing(): Boolean {
+        if (!NativeInterface.isLoaded) return false
+
+        val native = NativeInterface()
+        NativeInterface.vpnService = this
+        if (native.initializeVpnCapture(vpnInterface!!.fd) && native.processPacket(ByteArray(0), 0)) {
+            nativeInterface = native
+            Log.d(TAG, "Using native packet engine")
+            return true
+        }
+
+        NativeInterface.vpnService = null
+        Log.w(TAG, "Native packet engine unavailable, falling back")
+        return false
+    }
+
     private fun initializeForwarding() {
         try {
             udpSocket = DatagramSocket()
@@ -103,12 +120,11 @@ class PacketVpnService : VpnService() {
                 while (isRunning) {
                     val length = inputStream.read(reusableBuffer)
                     if (length > 0) {
-                        val packetData = reusableBuffer.copyOf(length)
-                        
-                        executorService.execute { processPacketForDisplay(packetData, length) }
+                        // Header fields are pulled out before the buffer is reused, so no per-packet copy
+                        processPacketForDisplay(reusableBuffer, length)
                         
                         // Direct forwarding to maintain internet
-                        forwardPacketDirect(packetData, length, outputStream)
+                        forwardPacketDirect(reusableBuffer, length, outputStream)
                     }
                 }
             } catch (e: Exception) {
@@ -340,11 +356,13 @@ class PacketVpnService : VpnService() {
     override fun onDestroy() {
         Log.d(TAG, "Cleaning up VPN service - Total packets: ${packetCount.get()}")
         isRunning = false
+        nativeInterface?.cleanup()
+        nativeInterface = null
+        NativeInterface.vpnService = null
         tcpConnections.values.forEach { try { it.close() } catch (e: Exception) {} }
         tcpConnections.clear()
         udpSocket?.close()
         udpSocket = null
-        executorService.shutdown()
         captureThread?.interrupt()
         captureThread = null
         vpnInterface?.close()
@@ -1,6 +1,9 @@
 import 'package:flutter/material.dart';
 import 'package:flutter/services.dart';
 import 'dart:async';
+import 'dart:convert';
+import 'dart:io';
+import 'dart:typed_data';
 
 void main() {
   runApp(PacketAnalyzerApp());
@@ -32,7 +35,15 @@ class PacketInfo {
   final String protocol;
   final int size;
   final String timestamp;
-  final String payload;
+  // Capture time in ns since the epoch (0 for packets from the Kotlin fallback)
+  final int timestampNs;
+  // Captured start of the payload (a view into the delivered batch) and the
+  // payload's full length on the wire
+  final Uint8List payloadBytes;
+  final int payloadLength;
+
+  // Rendered on first use only; most packets are never opened
+  late final String payloadDump = _formatDump();
 
   PacketInfo({
     required this.sourceIp,
@@ -42,7 +53,9 @@ class PacketInfo {
     required this.protocol,
     required this.size,
     required this.timestamp,
-    required this.payload,
+    this.timestampNs = 0,
+    required this.payloadBytes,
+    required this.payloadLength,
   });
 
   factory PacketInfo.fromMap(Map<String, dynamic> map) {
@@ -54,9 +67,104 @@ class PacketInfo {
       protocol: map['protocol'] ?? '',
       size: map['size'] ?? 0,
       timestamp: map['timestamp'] ?? '',
-      payload: map['payload'] ?? '',
+      payloadBytes: Uint8List(0),
+      payloadLength: 0,
     );
   }
+
+  // Size and field offsets of the native PacketRecord (packet_batcher.h)
+  static const int recordSize = 128;
+  static const List<String> _protocolNames = [
+    '',
+    'TCP',
+    'UDP',
+    'OTHER',
+    'ICMP',
+    'ICMPv6',
+  ];
+
+  factory PacketInfo.fromRecord(ByteData data, int offset) {
+    final timestampNs = data.getUint64(offset, Endian.little);
+    final ipVersion = data.getUint8(offset + 52);
+    final protocol = data.getUint8(offset + 54);
+    final payloadLength = data.getUint32(offset + 48, Endian.little);
+    final captured = data.getUint8(offset + 56);
+
+    return PacketInfo(
+      sourceIp: _formatAddress(data, offset + 8, ipVersion),
+      destinationIp: _formatAddress(data, offset + 24, ipVersion),
+      sourcePort: data.getUint16(offset + 40, Endian.little),
+      destinationPort: data.getUint16(offset + 42, Endian.little),
+      protocol: protocol < _protocolNames.length
+          ? _protocolNames[protocol]
+          : 'OTHER',
+      size: data.getUint32(offset + 44, Endian.little),
+      timestamp: _formatTimestamp(timestampNs),
+      timestampNs: timestampNs,
+      payloadBytes: Uint8List.sublistView(
+        data,
+        offset + 64,
+        offset + 64 + captured,
+      ),
+      payloadLength: payloadLength,
+    );
+  }
+
+  // Local "HH:MM:SS" of the last second seen; packets arrive in bursts, so
+  // the calendar conversion runs about once per second rather than per packet
+  static int _cachedSecond = -1;
+  static String _cachedPrefix = '';
+
+  static String _formatTimestamp(int timestampNs) {
+    final second = timestampNs ~/ 1000000000;
+    if (second != _cachedSecond) {
+      final time = DateTime.fromMillisecondsSinceEpoch(second * 1000);
+      _cachedPrefix =
+          '${time.hour.toString().padLeft(2, '0')}:'
+          '${time.minute.toString().padLeft(2, '0')}:'
+          '${time.second.toString().padLeft(2, '0')}.';
+      _cachedSecond = second;
+    }
+    final millis = (timestampNs ~/ 1000000) % 1000;
+    return _cachedPrefix + millis.toString().padLeft(3, '0');
+  }
+
+  static final List<String> _hexPairs = List.generate(
+    256,
+    (i) => i.toRadixString(16).padLeft(2, '0'),
+  );
+
+  // Offset, hex columns and printable ASCII, 16 bytes per line
+  String _formatDump() {
+    final dump = StringBuffer();
+    for (int line = 0; line < payloadBytes.length; line += 16) {
+      final end = line + 16 < payloadBytes.length
+          ? line + 16
+          : payloadBytes.length;
+      dump.write(line.toRadixString(16).padLeft(4, '0'));
+      dump.write('  ');
+      for (int i = line; i < line + 16; i++) {
+        dump.write(i < end ? _hexPairs[payloadBytes[i]] : '  ');
+        dump.write(i == line + 7 ? '  ' : ' ');
+      }
+      dump.write(' |');
+      for (int i = line; i < end; i++) {
+        final byte = payloadBytes[i];
+        dump.writeCharCode(byte >= 0x20 && byte < 0x7f ? byte : 0x2e);
+      }
+      dump.write('|\n');
+    }
+    if (payloadLength > payloadBytes.length) {
+      dump.write('... ${payloadLength - payloadBytes.length} more bytes');
+    }
+    return dump.toString();
+  }
+
+  static String _formatAddress(ByteData data, int offset, int ipVersion) {
+    final length = ipVersion == 6 ? 16 : 4;
+    final bytes = data.buffer.asUint8List(data.offsetInBytes + offset, length);
+    return InternetAddress.fromRawAddress(Uint8List.fromList(bytes)).address;
+  }
 }
 
 class ProtocolStats {
@@ -79,6 +187,39 @@ class ProtocolStats {
   }
 }
 
+// One page of the native packet history, newest first
+class PacketPage {
+  // Stored packets matching the query's filter, and stored packets in total
+  final int matching;
+  final int stored;
+  final List<PacketInfo> packets;
+
+  PacketPage({
+    required this.matching,
+    required this.stored,
+    required this.packets,
+  });
+
+  // Header size of a native page (see nativeGetPackets in native-lib.cpp)
+  static const int headerSize = 16;
+
+  factory PacketPage.fromBytes(Uint8List bytes) {
+    final data = ByteData.sublistView(bytes);
+    final returned = data.getUint32(4, Endian.little);
+    return PacketPage(
+      matching: data.getUint32(0, Endian.little),
+      stored: data.getUint32(8, Endian.little),
+      packets: List.generate(
+        returned,
+        (i) => PacketInfo.fromRecord(
+          data,
+          headerSize + i * PacketInfo.recordSize,
+        ),
+      ),
+    );
+  }
+}
+
 // Service with proper error handling
 class PacketService {
   static const MethodChannel _channel = MethodChannel('packet_analyzer');
@@ -89,7 +230,14 @@ class PacketService {
   static final StreamController<List<ProtocolStats>> _statsController =
       StreamController<List<ProtocolStats>>.broadcast();
 
+  // Records delivered to the native history per batch; the UI pages them
+  // back with getPackets() instead of decoding every one
+  static final StreamController<int> _historyController =
+      StreamController<int>.broadcast();
+
+  // Packets parsed by the Kotlin fallback when the native engine is missing
   static Stream<PacketInfo> get packetStream => _packetController.stream;
+  static Stream<int> get historyStream => _historyController.stream;
   static Stream<List<ProtocolStats>> get statsStream => _statsController.stream;
 
   static Future<void> initialize() async {
@@ -103,6 +251,10 @@ class PacketService {
         final packet = PacketInfo.fromMap(packetData);
         _packetController.add(packet);
         break;
+      case 'onPacketBatch':
+        final records = call.arguments as Uint8List;
+        _historyController.add(records.lengthInBytes ~/ PacketInfo.recordSize);
+        break;
       case 'onStatsUpdated':
         final statsData = List<Map<String, dynamic>>.from(call.arguments);
         final stats = statsData.map((e) => ProtocolStats.fromMap(e)).toList();
@@ -151,6 +303,136 @@ class PacketService {
     }
   }
 
+  // Compiled natively as a pcap filter expression; returns the error message, or null
+  static Future<String?> setCaptureFilter(String expression) async {
+    try {
+      await _channel.invokeMethod('setCaptureFilter', {'expression': expression});
+      return null;
+    } on PlatformException catch (e) {
+      return e.message ?? 'Invalid filter';
+    } catch (e) {
+      print('Error setting capture filter: $e');
+      return e.toString();
+    }
+  }
+
+  // Newest-first page of the native packet history after skipping offset
+  // matching packets; protocol, host and port narrow the match when set.
+  // Null when the native engine is unavailable.
+  static Future<PacketPage?> getPackets(
+    int offset,
+    int count, {
+    String protocol = '',
+    String host = '',
+    int port = 0,
+  }) async {
+    try {
+      final Uint8List? bytes = await _channel.invokeMethod('getPackets', {
+        'offset': offset,
+        'count': count,
+        'protocol': protocol,
+        'host': host,
+        'port': port,
+      });
+      if (bytes == null) return null;
+      return PacketPage.fromBytes(bytes);
+    } on MissingPluginException {
+      return null;
+    } catch (e) {
+      print('Error getting packets: $e');
+      return PacketPage(matching: 0, stored: 0, packets: []);
+    }
+  }
+
+  // Streams every captured packet to pcapng files in the app's external
+  // files directory, rotating by size and/or time (0 = unlimited) and
+  // keeping only the newest ringFiles files when non-zero. Returns the
+  // error message, or null once recording has started.
+  static Future<String?> startRecording({
+    int maxFileBytes = 0,
+    int maxFileSeconds = 0,
+    int ringFiles = 0,
+  }) async {
+    try {
+      await _channel.invokeMethod('startRecording', {
+        'maxFileBytes': maxFileBytes,
+        'maxFileSeconds': maxFileSeconds,
+        'ringFiles': ringFiles,
+      });
+      return null;
+    } on PlatformException catch (e) {
+      return e.message ?? 'Recording failed';
+    } catch (e) {
+      print('Error starting recording: $e');
+      return e.toString();
+    }
+  }
+
+  static Future<void> stopRecording() async {
+    try {
+      await _channel.invokeMethod('stopRecording');
+    } catch (e) {
+      print('Error stopping recording: $e');
+    }
+  }
+
+  // Ring occupancy, high-water mark and drops for each native pipeline
+  // stage ("rings"), packet buffer pool usage ("pool"), analysed flows by
+  // TCP state ("flows"), packet history usage ("history") and, while
+  // recording, the pcapng writer's counters ("recorder")
+  static Future<Map<String, dynamic>> getPipelineStats() async {
+    try {
+      final String? json = await _channel.invokeMethod('getPipelineStats');
+      if (json == null) return {};
+      return Map<String, dynamic>.from(jsonDecode(json));
+    } catch (e) {
+      print('Error getting pipeline stats: $e');
+      return {};
+    }
+  }
+
+  // Heaviest "sources", "destinations" and "conversations" by bytes, each
+  // with "totalBytes", "errorBound" and a "top" list of at most `count`
+  // entries ("host", or "hostA"/"hostB", plus "bytes", "error", "packets").
+  // "byPackets" holds the same three ranked by packets, with
+  // "totalPackets" and an "error" on the packet count instead.
+  static Future<Map<String, dynamic>> getTopTalkers({int count = 10}) async {
+    try {
+      final String? json =
+          await _channel.invokeMethod('getTopTalkers', {'count': count});
+      if (json == null) return {};
+      return Map<String, dynamic>.from(jsonDecode(json));
+    } catch (e) {
+      print('Error getting top talkers: $e');
+      return {};
+    }
+  }
+
+  // TCP metrics of the busiest `count` flows ("flows": endpoints, tx/rx
+  // bytes and packets, "throughputBps", "handshakeRttUs", smoothed and
+  // minimum RTT, retransmits, out-of-order and zero-window counts per
+  // side) and the same summed per responding host ("destinations"). host
+  // and port narrow the flows when set; "complete" is false if part of
+  // the flow table could not be read in time.
+  static Future<Map<String, dynamic>> getFlowMetrics({
+    int count = 10,
+    String host = '',
+    int port = 0,
+  }) async {
+    try {
+      final String? json = await _channel.invokeMethod('getFlowMetrics', {
+        'count': count,
+        'host': host,
+        'port': port,
+      });
+      if (json == null) return {};
+      return Map<String, dynamic>.from(jsonDecode(json));
+    } catch (e) {
+      print('Error getting flow metrics: $e');
+      return {};
+    }
+  }
+
   static Future<bool> isDeviceRooted() async {
     try {
       final result = await _channel.invokeMethod('isDeviceRooted');
@@ -175,6 +457,7 @@ class PacketService {
 
   static void dispose() {
     _packetController.close();
+    _historyController.close();
     _statsController.close();
   }
 }
@@ -192,11 +475,26 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
   bool _isCapturing = false;
   bool _isRooted = false;
   bool _useRootedMode = false;
+  // Only filled by the Kotlin fallback; native captures are paged from the
+  // engine's packet history so just the rows on screen are held here
   final List<PacketInfo> _packets = [];
   List<ProtocolStats> _stats = [];
   String _selectedProtocolFilter = 'ALL';
 
+  static const int _pageSize = 64;
+  bool _usesHistory = false;
+  final Map<int, List<PacketInfo>> _pages = {};
+  // Pages from before the last refresh, shown until their reload arrives
+  Map<int, List<PacketInfo>> _stalePages = {};
+  final Set<int> _loadingPages = {};
+  int _historyMatching = 0;
+  int _historyStored = 0;
+  // Bumped whenever cached pages go stale, so late responses are ignored
+  int _historyGeneration = 0;
+  Timer? _historyRefresh;
+
   StreamSubscription<PacketInfo>? _packetSubscription;
+  StreamSubscription<int>? _historySubscription;
   StreamSubscription<List<ProtocolStats>>? _statsSubscription;
 
   late AnimationController _statusAnimationController;
@@ -253,6 +551,10 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
       });
     });
 
+    _historySubscription = PacketService.historyStream.listen(
+      (_) => _scheduleHistoryRefresh(),
+    );
+
     _statsSubscription = PacketService.statsStream.listen((stats) {
       setState(() {
         _stats = stats;
@@ -295,10 +597,75 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
     }
   }
 
+  // Batches arrive up to every 100 ms; the first page is refetched at most
+  // this often and the rest reload as they scroll into view
+  void _scheduleHistoryRefresh() {
+    if (_historyRefresh?.isActive ?? false) return;
+    _historyRefresh = Timer(Duration(milliseconds: 250), _refreshHistory);
+  }
+
+  String get _protocolQuery =>
+      _selectedProtocolFilter == 'ALL' ? '' : _selectedProtocolFilter;
+
+  Future<void> _refreshHistory() async {
+    final generation = ++_historyGeneration;
+    final page = await PacketService.getPackets(
+      0,
+      _pageSize,
+      protocol: _protocolQuery,
+    );
+    if (page == null || !mounted || generation != _historyGeneration) return;
+    setState(() {
+      _usesHistory = true;
+      _stalePages = Map.of(_pages);
+      _pages
+        ..clear()
+        ..[0] = page.packets;
+      _loadingPages.clear();
+      _historyMatching = page.matching;
+      _historyStored = page.stored;
+    });
+  }
+
+  Future<void> _loadPage(int index) async {
+    if (!_loadingPages.add(index)) return;
+    final generation = _historyGeneration;
+    final page = await PacketService.getPackets(
+      index * _pageSize,
+      _pageSize,
+      protocol: _protocolQuery,
+    );
+    if (page == null || !mounted || generation != _historyGeneration) return;
+    setState(() {
+      _pages[index] = page.packets;
+      _loadingPages.remove(index);
+      _historyMatching = page.matching;
+      _historyStored = page.stored;
+    });
+  }
+
+  // Row `index` of the filtered history, or null while its page loads
+  PacketInfo? _historyPacket(int index) {
+    var page = _pages[index ~/ _pageSize];
+    if (page == null) {
+      _loadPage(index ~/ _pageSize);
+      page = _stalePages[index ~/ _pageSize];
+      if (page == null) return null;
+    }
+    final offset = index % _pageSize;
+    return offset < page.length ? page[offset] : null;
+  }
+
   void _clearPackets() {
     setState(() {
       _packets.clear();
       _stats.clear();
+      _pages.clear();
+      _stalePages.clear();
+      _loadingPages.clear();
+      _historyMatching = 0;
+      _historyStored = 0;
+      _historyGeneration++;
     });
     PacketService.clearPackets();
     _showSnackBar('Packets cleared', Colors.blue);
@@ -712,7 +1079,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                             borderRadius: BorderRadius.circular(8),
                           ),
                           child: Text(
-                            'Total: ${_packets.length}',
+                            'Total: ${_usesHistory ? _historyStored : _packets.length}',
                             style: TextStyle(
                               fontSize: 12,
                               fontWeight: FontWeight.bold,
@@ -823,6 +1190,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
 
   Widget _buildProtocolFilter() {
     Set<String> protocols = {'ALL'};
+    protocols.addAll(_stats.map((s) => s.protocol.toUpperCase()));
     protocols.addAll(_packets.map((p) => p.protocol.toUpperCase()).toSet());
 
     return Container(
@@ -840,7 +1208,10 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                   onSelected: (selected) {
                     setState(() {
                       _selectedProtocolFilter = protocol;
+                      _pages.clear();
+                      _stalePages.clear();
                     });
+                    if (_usesHistory) _refreshHistory();
                   },
                   selectedColor: Colors.indigo.shade100,
                   checkmarkColor: Colors.indigo,
@@ -861,7 +1232,10 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
   }
 
   Widget _buildPacketList() {
-    final filteredPackets = _filteredPackets;
+    final filteredPackets = _usesHistory ? <PacketInfo>[] : _filteredPackets;
+    final packetCount = _usesHistory
+        ? _historyMatching
+        : filteredPackets.length;
     return Card(
       margin: EdgeInsets.all(8),
       elevation: 4,
@@ -898,7 +1272,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                     borderRadius: BorderRadius.circular(8),
                   ),
                   child: Text(
-                    '${filteredPackets.length}',
+                    '$packetCount',
                     style: TextStyle(
                       color: Colors.white,
                       fontSize: 12,
@@ -910,7 +1284,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
             ),
           ),
           Expanded(
-            child: filteredPackets.isEmpty
+            child: packetCount == 0
                 ? Container(
                     padding: EdgeInsets.all(32),
                     child: Center(
@@ -944,10 +1318,15 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                     ),
                   )
                 : ListView.builder(
-                    itemCount: filteredPackets.length,
+                    itemCount: packetCount,
                     itemBuilder: (context, index) {
-                      final packet = filteredPackets[index];
-                      return _buildPacketItem(packet, index);
+                      if (!_usesHistory) {
+                        return _buildPacketItem(filteredPackets[index], index);
+                      }
+                      final packet = _historyPacket(index);
+                      return packet == null
+                          ? SizedBox(height: 48)
+                          : _buildPacketItem(packet, index);
                     },
                   ),
           ),
@@ -1150,7 +1529,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                           Icons.access_time,
                         ),
                         SizedBox(height: 16),
-                        if (packet.payload.isNotEmpty) ...[
+                        if (packet.payloadBytes.isNotEmpty) ...[
                           Text(
                             'Payload Data:',
                             style: TextStyle(
@@ -1169,7 +1548,7 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
                               border: Border.all(color: Colors.grey.shade300),
                             ),
                             child: SelectableText(
-                              packet.payload,
+                              packet.payloadDump,
                               style: TextStyle(
                                 fontFamily: 'monospace',
                                 fontSize: 10,
@@ -1309,6 +1688,8 @@ class _PacketAnalyzerScreenState extends State<PacketAnalyzerScreen>
   @override
   void dispose() {
     _packetSubscription?.cancel();
+    _historySubscription?.cancel();
+    _historyRefresh?.cancel();
     _statsSubscription?.cancel();
     _statusAnimationController.dispose();
     _statsAnimationController.dispose();